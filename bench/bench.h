@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+
+struct Wide
+{
+	int32_t field1;
+	int64_t field2;
+	uint32_t field3;
+	uint64_t field4;
+	float field5;
+	double field6;
+	bool field7;
+	int64_t field8;
+	int32_t field9;
+	int64_t field10;
+	uint32_t field11;
+	uint64_t field12;
+	float field13;
+	double field14;
+	bool field15;
+	int64_t field16;
+	int32_t field17;
+	int64_t field18;
+	uint32_t field19;
+	uint64_t field20;
+	float field21;
+	double field22;
+	bool field23;
+	int64_t field24;
+	int32_t field25;
+	int64_t field26;
+	uint32_t field27;
+	uint64_t field28;
+	float field29;
+	double field30;
+	bool field31;
+	int64_t field32;
+	int32_t field33;
+	int64_t field34;
+	uint32_t field35;
+	uint64_t field36;
+	float field37;
+	double field38;
+	bool field39;
+	int64_t field40;
+	int32_t field41;
+	int64_t field42;
+	uint32_t field43;
+	uint64_t field44;
+	float field45;
+	double field46;
+	bool field47;
+	int64_t field48;
+	int32_t field49;
+	int64_t field50;
+	uint32_t field51;
+	uint64_t field52;
+	float field53;
+	double field54;
+	bool field55;
+	int64_t field56;
+	int32_t field57;
+	int64_t field58;
+	uint32_t field59;
+	uint64_t field60;
+	float field61;
+	double field62;
+	bool field63;
+	int64_t field64;
+	int32_t field65;
+	int64_t field66;
+	uint32_t field67;
+	uint64_t field68;
+	float field69;
+	double field70;
+	bool field71;
+	int64_t field72;
+	int32_t field73;
+	int64_t field74;
+	uint32_t field75;
+	uint64_t field76;
+	float field77;
+	double field78;
+	bool field79;
+	int64_t field80;
+	int32_t field81;
+	int64_t field82;
+	uint32_t field83;
+	uint64_t field84;
+	float field85;
+	double field86;
+	bool field87;
+	int64_t field88;
+	int32_t field89;
+	int64_t field90;
+	uint32_t field91;
+	uint64_t field92;
+	float field93;
+	double field94;
+	bool field95;
+	int64_t field96;
+	int32_t field97;
+	int64_t field98;
+	uint32_t field99;
+	uint64_t field100;
+	float field101;
+	double field102;
+	bool field103;
+	int64_t field104;
+	int32_t field105;
+	int64_t field106;
+	uint32_t field107;
+	uint64_t field108;
+	float field109;
+	double field110;
+	bool field111;
+	int64_t field112;
+	int32_t field113;
+	int64_t field114;
+	uint32_t field115;
+	uint64_t field116;
+	float field117;
+	double field118;
+	bool field119;
+	int64_t field120;
+	int32_t field121;
+	int64_t field122;
+	uint32_t field123;
+	uint64_t field124;
+	float field125;
+	double field126;
+	bool field127;
+	int64_t field128;
+};
+
+// same layout as Wide.
+struct Sparse : Wide {};
+
+struct Samples
+{
+	std::vector<double> values;
+	std::vector<int64_t> times;
+	std::vector<bool> flags;
+};
+
+struct Nested
+{
+	struct Item
+	{
+		std::string name;
+		std::vector<int64_t> values;
+		std::map<int64_t, std::string> tags;
+	};
+	std::map<std::string, Item> items;
+	std::vector<Item> list;
+};
+
+struct Deep
+{
+	int64_t id;
+	std::string name;
+	std::vector<Deep> children;
+};
+
+struct Record
+{
+	int64_t id;
+	std::string name;
+	double score;
+	std::vector<int32_t> tags;
+};
+
+struct Records
+{
+	std::vector<Record> records;
+};
+
+struct Dict
+{
+	std::map<std::string, Record> items;
+	std::map<std::string, int64_t> counters;
+};
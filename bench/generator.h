@@ -0,0 +1,139 @@
+#pragma once
+
+// generate the structs of benchmark, the payload grows with size.
+
+#include <string>
+
+#include "bench.h"
+#include "bench.pb.h"
+#include "convert_proto_struct.h"
+
+// fill every scalar field of message with non-default value.
+inline void FillScalars(google::protobuf::Message &msg)
+{
+	using google::protobuf::FieldDescriptor;
+	auto desc = msg.GetDescriptor();
+	auto refl = msg.GetReflection();
+	for (int i = 0; i < desc->field_count(); ++i) {
+		auto field = desc->field(i);
+		switch (field->cpp_type()) {
+		case FieldDescriptor::CPPTYPE_INT32:
+			refl->SetInt32(&msg, field, -i * 1000);
+			break;
+		case FieldDescriptor::CPPTYPE_INT64:
+			refl->SetInt64(&msg, field, -i * 1000000007ll);
+			break;
+		case FieldDescriptor::CPPTYPE_UINT32:
+			refl->SetUInt32(&msg, field, i * 1000);
+			break;
+		case FieldDescriptor::CPPTYPE_UINT64:
+			refl->SetUInt64(&msg, field, i * 1000000007ull);
+			break;
+		case FieldDescriptor::CPPTYPE_FLOAT:
+			refl->SetFloat(&msg, field, i * 0.5f);
+			break;
+		case FieldDescriptor::CPPTYPE_DOUBLE:
+			refl->SetDouble(&msg, field, i * 0.25);
+			break;
+		case FieldDescriptor::CPPTYPE_BOOL:
+			refl->SetBool(&msg, field, true);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+// 128 scalar fields, the size is fixed.
+inline Wide MakeWide()
+{
+	bench::Wide proto;
+	FillScalars(proto);
+	Wide wide;
+	cps::ProtoToStruct(proto, &wide, sizeof(wide));
+	return wide;
+}
+
+// size samples in each array.
+inline Samples MakeSamples(int size)
+{
+	Samples samples;
+	for (int i = 0; i < size; ++i) {
+		samples.values.push_back(i * 0.125);
+		samples.times.push_back(1600000000000ll + i);
+		samples.flags.push_back(i % 3 == 0);
+	}
+	return samples;
+}
+
+// a chain of size levels.
+inline Deep MakeDeep(int size)
+{
+	Deep deep;
+	deep.id = size;
+	deep.name = "level " + std::to_string(size);
+	if (size > 1) {
+		deep.children.push_back(MakeDeep(size - 1));
+	}
+	return deep;
+}
+
+inline Record MakeRecord(int index)
+{
+	Record record;
+	record.id = 1000000007ll * index;
+	record.name = "record name " + std::to_string(index);
+	record.score = index * 0.5;
+	record.tags.assign({ index, index * 2, index * 3, -index });
+	return record;
+}
+
+// size records.
+inline Records MakeRecords(int size)
+{
+	Records records;
+	for (int i = 0; i < size; ++i) {
+		records.records.push_back(MakeRecord(i));
+	}
+	return records;
+}
+
+// size entries in each map.
+inline Dict MakeDict(int size)
+{
+	Dict dict;
+	for (int i = 0; i < size; ++i) {
+		auto key = "dict key " + std::to_string(i);
+		dict.items.emplace(key, MakeRecord(i));
+		dict.counters.emplace(key, i * 1000000007ll);
+	}
+	return dict;
+}
+
+// size entries in the counters map only.
+inline Dict MakeCounters(int size)
+{
+	Dict dict;
+	for (int i = 0; i < size; ++i) {
+		dict.counters.emplace("counter key " + std::to_string(i),
+			i * 1000000007ll);
+	}
+	return dict;
+}
+
+// size items in the map and the list.
+inline Nested MakeNested(int size)
+{
+	Nested nested;
+	for (int i = 0; i < size; ++i) {
+		Nested::Item item;
+		item.name = "item name " + std::to_string(i);
+		item.values.assign(8, i);
+		for (int j = 0; j < 8; ++j) {
+			item.tags.emplace(j, "tag value " + std::to_string(j));
+		}
+		nested.items.emplace("item key " + std::to_string(i), item);
+		nested.list.push_back(item);
+	}
+	return nested;
+}
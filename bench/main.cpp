@@ -0,0 +1,929 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/field_mask.pb.h>
+
+#include "bench.h"
+#include "bench.pb.h"
+#include "convert_proto_struct.h"
+#include "convert_aggregate.h"
+#include "convert_parallel.h"
+#include "convert_pipeline.h"
+#include "convert_stream.h"
+#include "bench.cps.h"
+#include "generator.h"
+
+// count of heap allocations, include allocations of protobuf. the whole
+// family of global operator new and delete is replaced, every form is
+// allocated by malloc and released by free.
+static std::atomic<size_t> g_allocs(0);
+
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+// allocate counted memory, or null if failed. never inlined, so the compiler
+// does not pair malloc and free with new and delete.
+static BENCH_NOINLINE void *Allocate(size_t size)
+{
+	g_allocs.fetch_add(1, std::memory_order_relaxed);
+	return malloc(size ? size : 1);
+}
+
+static BENCH_NOINLINE void Release(void *ptr)
+{
+	free(ptr);
+}
+
+// allocate memory, or throw std::bad_alloc if failed.
+static inline void *AllocateOrThrow(size_t size)
+{
+	void *ptr = Allocate(size);
+	if (ptr == nullptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void *operator new(size_t size)
+{
+	return AllocateOrThrow(size);
+}
+
+void *operator new[](size_t size)
+{
+	return AllocateOrThrow(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return Allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return Allocate(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+	Release(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+	Release(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+	Release(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+	Release(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t&) noexcept
+{
+	Release(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept
+{
+	Release(ptr);
+}
+
+#ifdef __cpp_aligned_new
+// allocate counted memory aligned to align, or null if failed. the pointer
+// of malloc is stored before the aligned memory.
+static void *AllocateAligned(size_t size, std::align_val_t align)
+{
+	size_t alignment = static_cast<size_t>(align);
+	if (alignment < sizeof(void*)) {
+		alignment = sizeof(void*);
+	}
+	auto raw = static_cast<uint8_t*>(
+		Allocate(size + alignment + sizeof(void*)));
+	if (raw == nullptr) {
+		return nullptr;
+	}
+	auto address = reinterpret_cast<uintptr_t>(raw + sizeof(void*));
+	address = (address + alignment - 1) / alignment * alignment;
+	reinterpret_cast<void**>(address)[-1] = raw;
+	return reinterpret_cast<void*>(address);
+}
+
+static void ReleaseAligned(void *ptr)
+{
+	if (ptr != nullptr) {
+		Release(static_cast<void**>(ptr)[-1]);
+	}
+}
+
+// allocate aligned memory, or throw std::bad_alloc if failed.
+static inline void *AllocateAlignedOrThrow(size_t size, std::align_val_t align)
+{
+	void *ptr = AllocateAligned(size, align);
+	if (ptr == nullptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void *operator new(size_t size, std::align_val_t align)
+{
+	return AllocateAlignedOrThrow(size, align);
+}
+
+void *operator new[](size_t size, std::align_val_t align)
+{
+	return AllocateAlignedOrThrow(size, align);
+}
+
+void *operator new(size_t size, std::align_val_t align,
+	const std::nothrow_t&) noexcept
+{
+	return AllocateAligned(size, align);
+}
+
+void *operator new[](size_t size, std::align_val_t align,
+	const std::nothrow_t&) noexcept
+{
+	return AllocateAligned(size, align);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+	ReleaseAligned(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+	ReleaseAligned(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept
+{
+	ReleaseAligned(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept
+{
+	ReleaseAligned(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t,
+	const std::nothrow_t&) noexcept
+{
+	ReleaseAligned(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t,
+	const std::nothrow_t&) noexcept
+{
+	ReleaseAligned(ptr);
+}
+#endif
+
+// keep the result of conversion, so it is not optimized away.
+template<typename Ty>
+static inline bool Escape(const Ty &value)
+{
+#if defined(_MSC_VER)
+	static const void *volatile sink;
+	sink = &value;
+#else
+	asm volatile("" : : "g"(&value) : "memory");
+#endif
+	return true;
+}
+
+// run function count times, and print the average cost. bytes is the size of
+// serialized payload of an op, for throughput.
+template<typename Func>
+static void Bench(const std::string &name, int count, size_t bytes, Func func)
+{
+	size_t allocs = g_allocs.load(std::memory_order_relaxed);
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; ++i) {
+		if (!func()) {
+			printf("%-40s failed\n", name.c_str());
+			return;
+		}
+	}
+	auto end = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration<double, std::nano>(end - begin).count();
+	allocs = g_allocs.load(std::memory_order_relaxed) - allocs;
+	printf("%-40s %12.1f ns/op %9.1f MB/s %10.1f allocs/op\n", name.c_str(),
+		ns / count, bytes * count * 1e3 / ns,
+		static_cast<double>(allocs) / count);
+}
+
+// the iterations for payload of bytes, the large payload runs less.
+static int Iterations(int count, size_t bytes)
+{
+	size_t iterations = count * size_t(1024) / (bytes + 1024);
+	return iterations < 3 ? 3 : static_cast<int>(iterations);
+}
+
+// run both directions of a shape, by the reflection converter with plan, the
+// generated converter and the wire format.
+template<typename STRUCT, typename PROTO>
+static void BenchShape(const std::string &name, const STRUCT &in, int count)
+{
+	auto &plan = cps::CompilePlan(PROTO::descriptor());
+	PROTO proto;
+	if (!cps::StructToProto(plan, &in, sizeof(in), proto)) {
+		printf("%s struct to proto failed.\n", name.c_str());
+		return;
+	}
+	std::string wire = proto.SerializeAsString();
+	size_t bytes = wire.size();
+	count = Iterations(count, bytes);
+	printf("%s, %zu bytes\n", name.c_str(), bytes);
+
+	Bench(name + " struct to proto", count, bytes, [&] {
+		PROTO out;
+		return cps::StructToProto(plan, &in, sizeof(in), out) && Escape(out);
+	});
+	Bench(name + " struct to proto (generated)", count, bytes, [&] {
+		PROTO out;
+		return cps::StructToProto(in, out) && Escape(out);
+	});
+#ifdef CPS_AGGREGATE_REFLECTION
+	Bench(name + " struct to proto (aggregate)", count, bytes, [&] {
+		PROTO out;
+		return cps::aggregate::StructToProto(in, out) && Escape(out);
+	});
+#endif
+	Bench(name + " struct to proto + serialize", count, bytes, [&] {
+		PROTO out;
+		std::string result;
+		return cps::StructToProto(plan, &in, sizeof(in), out) &&
+			out.SerializeToString(&result);
+	});
+	Bench(name + " struct to wire", count, bytes, [&] {
+		std::string result;
+		return cps::StructToWire<PROTO>(in, result) && Escape(result);
+	});
+	Bench(name + " proto to struct", count, bytes, [&] {
+		STRUCT out;
+		return cps::ProtoToStruct(plan, proto, &out, sizeof(out)) &&
+			Escape(out);
+	});
+	Bench(name + " proto to struct (generated)", count, bytes, [&] {
+		STRUCT out;
+		return cps::ProtoToStruct(proto, out) && Escape(out);
+	});
+#ifdef CPS_AGGREGATE_REFLECTION
+	Bench(name + " proto to struct (aggregate)", count, bytes, [&] {
+		STRUCT out;
+		return cps::aggregate::ProtoToStruct(proto, out) && Escape(out);
+	});
+#endif
+	Bench(name + " parse + proto to struct", count, bytes, [&] {
+		PROTO parsed;
+		STRUCT out;
+		return parsed.ParseFromString(wire) &&
+			cps::ProtoToStruct(plan, parsed, &out, sizeof(out));
+	});
+	Bench(name + " wire to struct", count, bytes, [&] {
+		STRUCT out;
+		return cps::ProtoToStruct<PROTO>(wire.data(), wire.size(), out) &&
+			Escape(out);
+	});
+}
+
+// convert a large map<string, int64>, which is converted pair by pair.
+static void BenchCounters(int size, int count)
+{
+	Dict dict = MakeCounters(size);
+	auto &plan = cps::CompilePlan(bench::Dict::descriptor());
+	bench::Dict proto;
+	if (!cps::StructToProto(plan, &dict, sizeof(dict), proto)) {
+		printf("counters struct to proto failed.\n");
+		return;
+	}
+	std::string wire = proto.SerializeAsString();
+	size_t bytes = wire.size();
+	count = Iterations(count, bytes);
+	printf("counters/%d, %zu bytes\n", size, bytes);
+
+	Bench("counters struct to proto", count, bytes, [&] {
+		bench::Dict out;
+		return cps::StructToProto(plan, &dict, sizeof(dict), out) &&
+			Escape(out);
+	});
+	Bench("counters struct to proto (generated)", count, bytes, [&] {
+		bench::Dict out;
+		return cps::StructToProto(dict, out) && Escape(out);
+	});
+	// the map of message is complete only after serialized.
+	Bench("counters struct to proto + serialize", count, bytes, [&] {
+		bench::Dict out;
+		std::string result;
+		return cps::StructToProto(plan, &dict, sizeof(dict), out) &&
+			out.SerializeToString(&result);
+	});
+	Bench("counters proto to struct", count, bytes, [&] {
+		Dict out;
+		return cps::ProtoToStruct(plan, proto, &out, sizeof(out)) &&
+			Escape(out);
+	});
+	Bench("counters proto to struct (generated)", count, bytes, [&] {
+		Dict out;
+		return cps::ProtoToStruct(proto, out) && Escape(out);
+	});
+	// the parsed map has never been read as repeated entries.
+	Bench("counters parse + proto to struct", count, bytes, [&] {
+		bench::Dict parsed;
+		Dict out;
+		return parsed.ParseFromString(wire) &&
+			cps::ProtoToStruct(plan, parsed, &out, sizeof(out));
+	});
+}
+
+// read and write a file of length delimited records, by the message parsed
+// record by record, or the stream parsed to struct directly.
+static void BenchStream(int size, int count)
+{
+	const std::string path = "bench_stream.bin";
+	std::vector<Record> records;
+	for (int i = 0; i < size; ++i) {
+		records.push_back(MakeRecord(i));
+	}
+	cps::StreamWriter<bench::Record, Record> writer;
+	if (!writer.open(path) || !writer.write(records.begin(), records.end()) ||
+		!writer.close()) {
+		printf("stream write failed.\n");
+		return;
+	}
+	cps::MappedFile file;
+	if (!file.open(path)) {
+		printf("stream map failed.\n");
+		return;
+	}
+	size_t bytes = file.size();
+	count = Iterations(count, bytes);
+	printf("stream, %d records, %zu bytes\n", size, bytes);
+
+	Bench("stream write", count, bytes, [&] {
+		return writer.open(path) &&
+			writer.write(records.begin(), records.end()) && writer.close();
+	});
+	auto &plan = cps::CompilePlan(bench::Record::descriptor());
+	Bench("stream parse + proto to struct", count, bytes, [&] {
+		// the message is reused.
+		cps::RecordReader reader(file.data(), file.size());
+		bench::Record proto;
+		const uint8_t *data = nullptr;
+		size_t length = 0;
+		while (reader.next(data, length)) {
+			Record out;
+			if (!proto.ParseFromArray(data, static_cast<int>(length)) ||
+				!cps::ProtoToStruct(plan, proto, &out, sizeof(out))) {
+				return false;
+			}
+			Escape(out);
+		}
+		return !reader.failed();
+	});
+	Bench("stream read", count, bytes, [&] {
+		cps::StreamReader<bench::Record, Record> reader;
+		return reader.open(path) &&
+			reader.for_each([](Record &out) { Escape(out); });
+	});
+	file.close();
+	std::remove(path.c_str());
+}
+
+// convert the records inline on the producer, or on the workers of pipeline.
+static void BenchPipeline(int size, int count)
+{
+	std::vector<bench::Record> messages(size);
+	size_t bytes = 0;
+	for (int i = 0; i < size; ++i) {
+		auto record = MakeRecord(i);
+		if (!cps::StructToProto(record, messages[i])) {
+			printf("pipeline prepare failed.\n");
+			return;
+		}
+		bytes += messages[i].ByteSizeLong();
+	}
+	count = Iterations(count, bytes);
+	printf("pipeline, %d records, %zu bytes\n", size, bytes);
+
+	auto &plan = cps::CompilePlan(bench::Record::descriptor());
+	Bench("inline proto to struct", count, bytes, [&] {
+		for (auto &message : messages) {
+			Record out;
+			if (!cps::ProtoToStruct(plan, message, &out, sizeof(out))) {
+				return false;
+			}
+			Escape(out);
+		}
+		return true;
+	});
+	bool result = true;
+	cps::ProtoToStructPipeline<bench::Record, Record> pipeline(
+		[&](bench::Record &, Record &out, bool converted) {
+		result = result && converted;
+		Escape(out);
+	});
+	Bench("pipeline proto to struct", count, bytes, [&] {
+		// the messages are copied in, as received from network.
+		for (auto &message : messages) {
+			pipeline.push(bench::Record(message));
+		}
+		pipeline.wait();
+		return result;
+	});
+}
+
+// convert a wide message with only a few fields set, by all fields or by the
+// present fields.
+static void BenchSparse(int count)
+{
+	bench::Sparse proto;
+	auto desc = proto.GetDescriptor();
+	auto refl = proto.GetReflection();
+	FillScalars(proto);
+	for (int i = 0; i < desc->field_count(); ++i) {
+		if (i % 16 != 0) {
+			refl->ClearField(&proto, desc->field(i));
+		}
+	}
+	auto &plan = cps::CompilePlan(desc);
+	size_t bytes = proto.ByteSizeLong();
+	count = Iterations(count, bytes);
+	printf("sparse, %d of %d fields\n", (desc->field_count() + 15) / 16,
+		desc->field_count());
+
+	Bench("sparse proto to struct (all fields)", count, bytes, [&] {
+		Sparse out;
+		return cps::ProtoToStruct(plan, proto, &out, sizeof(out)) &&
+			Escape(out);
+	});
+	Bench("sparse proto to struct (present fields)", count, bytes, [&] {
+		Sparse out;
+		return cps::SparseProtoToStruct(plan, proto, &out, sizeof(out)) &&
+			Escape(out);
+	});
+}
+
+// convert many small records one by one, or by the batch converter.
+static void BenchBatch(int count)
+{
+	const int kRecords = 100;
+	std::vector<Wide> records(kRecords, MakeWide());
+	google::protobuf::RepeatedPtrField<bench::Wide> protos;
+	cps::Converter<Wide, bench::Wide> converter;
+	if (!converter.to_proto(records, protos)) {
+		printf("batch struct to proto failed.\n");
+		return;
+	}
+	size_t bytes = protos.Get(0).ByteSizeLong() * kRecords;
+	count = Iterations(count, bytes);
+	printf("batch, %d records\n", kRecords);
+
+	Bench("batch struct to proto (loop)", count, bytes, [&] {
+		protos.Clear();
+		for (auto &record : records) {
+			if (!cps::StructToProto(&record, sizeof(record), *protos.Add())) {
+				return false;
+			}
+		}
+		return true;
+	});
+	Bench("batch struct to proto", count, bytes, [&] {
+		protos.Clear();
+		return converter.to_proto(records, protos);
+	});
+	Bench("batch proto to struct (loop)", count, bytes, [&] {
+		std::vector<Wide> out;
+		for (auto &msg : protos) {
+			out.emplace_back();
+			if (!cps::ProtoToStruct(msg, &out.back(), sizeof(Wide))) {
+				return false;
+			}
+		}
+		return true;
+	});
+	Bench("batch proto to struct", count, bytes, [&] {
+		std::vector<Wide> out;
+		return converter.to_struct(protos, out);
+	});
+}
+
+// convert large repeated messages concurrently.
+static void BenchParallel(int size, int count)
+{
+	Records records = MakeRecords(size);
+	auto &plan = cps::CompilePlan(bench::Records::descriptor());
+	bench::Records proto;
+	if (!cps::StructToProto(plan, &records, sizeof(records), proto)) {
+		printf("records struct to proto failed.\n");
+		return;
+	}
+	size_t bytes = proto.ByteSizeLong();
+	count = Iterations(count, bytes);
+	cps::Parallel parallel;
+	parallel.threshold = 1024;
+	printf("parallel, %d records, %zu threads\n", size,
+		cps::ThreadPool::Default().concurrency());
+
+	Bench("records struct to proto (parallel)", count, bytes, [&] {
+		bench::Records out;
+		return cps::StructToProto(plan, &records, sizeof(records), out,
+			parallel);
+	});
+	Bench("records proto to struct (parallel)", count, bytes, [&] {
+		Records out;
+		return cps::ProtoToStruct(plan, proto, &out, sizeof(out), parallel);
+	});
+}
+
+// scan a column of large repeated messages, converted to structs or columns.
+static void BenchColumns(int size, int count)
+{
+	Records records = MakeRecords(size);
+	auto &plan = cps::CompilePlan(bench::Records::descriptor());
+	bench::Records proto;
+	if (!cps::StructToProto(plan, &records, sizeof(records), proto)) {
+		printf("records struct to proto failed.\n");
+		return;
+	}
+	size_t bytes = proto.ByteSizeLong();
+	count = Iterations(count, bytes);
+	auto field = bench::Records::descriptor()->FindFieldByName("records");
+	printf("columns, %d records\n", size);
+
+	Bench("records proto to struct + scan", count, bytes, [&] {
+		Records out;
+		if (!cps::ProtoToStruct(plan, proto, &out, sizeof(out))) {
+			return false;
+		}
+		double sum = 0;
+		for (auto &record : out.records) {
+			sum += record.score;
+		}
+		return Escape(sum);
+	});
+	cps::Columns columns;
+	Bench("records proto to columns + scan", count, bytes, [&] {
+		if (!cps::ProtoToColumns(proto, field, columns)) {
+			return false;
+		}
+		auto scores = columns.find("score")->cast<double>();
+		double sum = 0;
+		for (size_t i = 0; i < columns.rows; ++i) {
+			sum += scores[i];
+		}
+		return Escape(sum);
+	});
+}
+
+// update a mirror message when a record changes, by full or delta conversion.
+static void BenchDelta(int size, int count)
+{
+	Records prev = MakeRecords(size);
+	Records cur = prev;
+	cur.records[size / 2].score += 1;
+	auto &plan = cps::CompilePlan(bench::Records::descriptor());
+	bench::Records mirror;
+	if (!cps::StructToProto(plan, &prev, sizeof(prev), mirror)) {
+		printf("records struct to proto failed.\n");
+		return;
+	}
+	size_t bytes = mirror.ByteSizeLong();
+	count = Iterations(count, bytes);
+	printf("delta, %d records, 1 changed\n", size);
+
+	Bench("records struct to proto (full)", count, bytes, [&] {
+		mirror.Clear();
+		return cps::StructToProto(plan, &cur, sizeof(cur), mirror);
+	});
+	Bench("records struct to proto (delta)", count, bytes, [&] {
+		return cps::StructDeltaToProto(plan, &prev, &cur, sizeof(cur), mirror);
+	});
+}
+
+// convert to a new struct, or overwrite a long-lived struct.
+template<typename STRUCT, typename PROTO>
+static void BenchOverwrite(const std::string &name, const STRUCT &in,
+	int count)
+{
+	auto &plan = cps::CompilePlan(PROTO::descriptor());
+	PROTO proto;
+	STRUCT out;
+	if (!cps::StructToProto(plan, &in, sizeof(in), proto) ||
+		!cps::ProtoToStruct(plan, proto, &out, sizeof(out))) {
+		printf("%s conversion failed.\n", name.c_str());
+		return;
+	}
+	size_t bytes = proto.ByteSizeLong();
+	count = Iterations(count, bytes);
+
+	Bench(name + " proto to struct (new)", count, bytes, [&] {
+		STRUCT fresh;
+		return cps::ProtoToStruct(plan, proto, &fresh, sizeof(fresh)) &&
+			Escape(fresh);
+	});
+	Bench(name + " proto to struct (overwrite)", count, bytes, [&] {
+		return cps::OverwriteProtoToStruct(plan, proto, &out, sizeof(out));
+	});
+}
+
+// convert a field of each record selected by mask.
+static void BenchMask(int size, int count)
+{
+	Records records = MakeRecords(size);
+	auto desc = bench::Records::descriptor();
+	bench::Records proto;
+	if (!cps::StructToProto(cps::CompilePlan(desc), &records, sizeof(records),
+		proto)) {
+		printf("records struct to proto failed.\n");
+		return;
+	}
+	google::protobuf::FieldMask mask;
+	mask.add_paths("records.id");
+	auto selection = cps::CompileFieldMask(desc, mask);
+	size_t bytes = proto.ByteSizeLong();
+	count = Iterations(count, bytes);
+	printf("mask, %d records, records.id\n", size);
+
+	Bench("records struct to proto (mask)", count, bytes, [&] {
+		bench::Records out;
+		return cps::StructToProto(*selection, &records, sizeof(records), out);
+	});
+	Bench("records proto to struct (mask)", count, bytes, [&] {
+		Records out;
+		return cps::ProtoToStruct(*selection, proto, &out, sizeof(out)) &&
+			Escape(out);
+	});
+}
+
+// allocate the output message on heap or arena.
+static void BenchArena(int size, int count)
+{
+	Nested nested = MakeNested(size);
+	bench::Nested proto;
+	if (!cps::StructToProto(&nested, sizeof(nested), proto)) {
+		printf("nested struct to proto failed.\n");
+		return;
+	}
+	size_t bytes = proto.ByteSizeLong();
+	count = Iterations(count, bytes);
+	printf("arena, %d items\n", size);
+
+	Bench("nested struct to proto (heap)", count, bytes, [&] {
+		bench::Nested out;
+		return cps::StructToProto(&nested, sizeof(nested), out);
+	});
+	Bench("nested struct to proto (arena)", count, bytes, [&] {
+		google::protobuf::Arena arena;
+		return cps::StructToProto<bench::Nested>(nested, &arena) != nullptr;
+	});
+	// the arena reuses the initial block, nothing is allocated from heap.
+	std::vector<char> block(bytes * 16 + 4096);
+	google::protobuf::ArenaOptions options;
+	options.initial_block = block.data();
+	options.initial_block_size = block.size();
+	Bench("nested struct to proto (block)", count, bytes, [&] {
+		google::protobuf::Arena arena(options);
+		return cps::StructToProto<bench::Nested>(nested, &arena) != nullptr;
+	});
+}
+
+// same as Dict, but declared with other map containers.
+struct HashDict
+{
+	std::unordered_map<std::string, Record> items;
+	std::unordered_map<std::string, int64_t> counters;
+};
+
+struct SortedDict
+{
+	std::vector<std::pair<std::string, Record>> items;
+	std::vector<std::pair<std::string, int64_t>> counters;
+};
+
+// decode the maps to tree, hash table or sorted vector.
+static void BenchMapLayout(int size, int count)
+{
+	Dict dict = MakeDict(size);
+	bench::Dict proto;
+	if (!cps::StructToProto(&dict, sizeof(dict), proto)) {
+		printf("dict struct to proto failed.\n");
+		return;
+	}
+	size_t bytes = proto.ByteSizeLong();
+	count = Iterations(count, bytes);
+	printf("map layout, %d items\n", size);
+
+	auto desc = bench::Dict::descriptor();
+	auto &tree_plan = cps::CompilePlan(desc, cps::MAP_TREE);
+	auto &hash_plan = cps::CompilePlan(desc, cps::MAP_HASH);
+	auto &sorted_plan = cps::CompilePlan(desc, cps::MAP_SORTED);
+	Bench("dict proto to struct (tree)", count, bytes, [&] {
+		Dict out;
+		return cps::ProtoToStruct(tree_plan, proto, &out, sizeof(out)) &&
+			Escape(out);
+	});
+	Bench("dict proto to struct (hash)", count, bytes, [&] {
+		HashDict out;
+		return cps::ProtoToStruct(hash_plan, proto, &out, sizeof(out)) &&
+			Escape(out);
+	});
+	Bench("dict proto to struct (sorted)", count, bytes, [&] {
+		SortedDict out;
+		return cps::ProtoToStruct(sorted_plan, proto, &out, sizeof(out)) &&
+			Escape(out);
+	});
+	HashDict hash_dict;
+	SortedDict sorted_dict;
+	if (!cps::ProtoToStruct(hash_plan, proto, &hash_dict, sizeof(hash_dict)) ||
+		!cps::ProtoToStruct(sorted_plan, proto, &sorted_dict,
+			sizeof(sorted_dict))) {
+		printf("dict proto to struct failed.\n");
+		return;
+	}
+	Bench("dict struct to proto (tree)", count, bytes, [&] {
+		bench::Dict out;
+		return cps::StructToProto(tree_plan, &dict, sizeof(dict), out);
+	});
+	Bench("dict struct to proto (hash)", count, bytes, [&] {
+		bench::Dict out;
+		return cps::StructToProto(hash_plan, &hash_dict, sizeof(hash_dict),
+			out);
+	});
+	Bench("dict struct to proto (sorted)", count, bytes, [&] {
+		bench::Dict out;
+		return cps::StructToProto(sorted_plan, &sorted_dict,
+			sizeof(sorted_dict), out);
+	});
+}
+
+#ifdef CPS_MEMORY_RESOURCE
+// same as Record and Dict, but declared with std::pmr containers.
+struct PmrRecord
+{
+	int64_t id;
+	std::pmr::string name;
+	double score;
+	std::pmr::vector<int32_t> tags;
+};
+
+struct PmrDict
+{
+	std::pmr::map<std::pmr::string, PmrRecord> items;
+	std::pmr::map<std::pmr::string, int64_t> counters;
+};
+
+// decode to containers of heap, or of a monotonic buffer freed at once.
+static void BenchMemoryResource(int size, int count)
+{
+	Dict dict = MakeDict(size);
+	bench::Dict proto;
+	if (!cps::StructToProto(&dict, sizeof(dict), proto)) {
+		printf("dict struct to proto failed.\n");
+		return;
+	}
+	size_t bytes = proto.ByteSizeLong();
+	count = Iterations(count, bytes);
+	printf("memory resource, %d items\n", size);
+
+	auto &plan = cps::CompilePlan(bench::Dict::descriptor());
+	Bench("dict proto to struct (heap)", count, bytes, [&] {
+		Dict out;
+		return cps::ProtoToStruct(plan, proto, &out, sizeof(out)) &&
+			Escape(out);
+	});
+	// the buffer is reused, nothing is allocated from heap.
+	std::vector<char> buffer(bytes * 16 + 4096);
+	Bench("dict proto to struct (monotonic)", count, bytes, [&] {
+		std::pmr::monotonic_buffer_resource resource(buffer.data(),
+			buffer.size());
+		PmrDict out;
+		return cps::ProtoToStruct(proto, out, &resource) && Escape(out);
+	});
+}
+#endif
+
+#ifdef CPS_STRING_VIEW
+// same as Record and Records, but the strings are std::string_view.
+struct ViewRecord
+{
+	int64_t id;
+	std::string_view name;
+	double score;
+	std::vector<int32_t> tags;
+};
+
+struct ViewRecords
+{
+	std::vector<ViewRecord> records;
+};
+
+// copy the strings to struct, or view them in message and wire buffer.
+static void BenchView(int size, int count)
+{
+	Records records = MakeRecords(size);
+	for (auto &record : records.records) {
+		record.name.append(64, '.'); // not inlined by std::string
+	}
+	bench::Records proto;
+	if (!cps::StructToProto(&records, sizeof(records), proto)) {
+		printf("records struct to proto failed.\n");
+		return;
+	}
+	std::string wire = proto.SerializeAsString();
+	size_t bytes = wire.size();
+	count = Iterations(count, bytes);
+	printf("view, %d records\n", size);
+
+	auto &plan = cps::CompilePlan(bench::Records::descriptor());
+	Bench("records proto to struct (copy)", count, bytes, [&] {
+		Records out;
+		return cps::ProtoToStruct(plan, proto, &out, sizeof(out)) &&
+			Escape(out);
+	});
+	Bench("records proto to struct (view)", count, bytes, [&] {
+		ViewRecords out;
+		return cps::ProtoToView(proto, out) && Escape(out);
+	});
+	Bench("records wire to struct (copy)", count, bytes, [&] {
+		Records out;
+		return cps::ProtoToStruct(plan, wire.data(), wire.size(), &out,
+			sizeof(out)) && Escape(out);
+	});
+	Bench("records wire to struct (view)", count, bytes, [&] {
+		ViewRecords out;
+		return cps::ProtoToView<bench::Records>(wire.data(), wire.size(),
+			out) && Escape(out);
+	});
+}
+#endif
+
+// usage: bench_cps [count] [size]...
+// count is the iterations of small payload, the sizes scale the payloads.
+int main(int argc, char *argv[])
+{
+	int count = argc > 1 ? atoi(argv[1]) : 10000;
+	std::vector<int> sizes;
+	for (int i = 2; i < argc; ++i) {
+		sizes.push_back(atoi(argv[i]));
+	}
+	if (sizes.empty()) {
+		sizes = { 16, 1024 };
+	}
+	BenchShape<Wide, bench::Wide>("wide", MakeWide(), count);
+	BenchSparse(count);
+	BenchBatch(count);
+	BenchCounters(100000, count);
+	BenchStream(10000, count);
+	BenchPipeline(10000, count);
+	for (int size : sizes) {
+		auto suffix = "/" + std::to_string(size);
+		// protobuf refuses to parse more than 100 levels.
+		int depth = size < 64 ? size : 64;
+		BenchShape<Deep, bench::Deep>("deep/" + std::to_string(depth),
+			MakeDeep(depth), count);
+		BenchShape<Samples, bench::Samples>("samples" + suffix,
+			MakeSamples(size), count);
+		BenchShape<Records, bench::Records>("records" + suffix,
+			MakeRecords(size), count);
+		BenchShape<Dict, bench::Dict>("dict" + suffix, MakeDict(size), count);
+		BenchParallel(size, count);
+		BenchColumns(size, count);
+		BenchDelta(size, count);
+		BenchMask(size, count);
+		printf("overwrite, size %d\n", size);
+		BenchOverwrite<Records, bench::Records>("records" + suffix,
+			MakeRecords(size), count);
+		BenchOverwrite<Dict, bench::Dict>("dict" + suffix, MakeDict(size),
+			count);
+		BenchArena(size, count);
+		BenchMapLayout(size, count);
+#ifdef CPS_MEMORY_RESOURCE
+		BenchMemoryResource(size, count);
+#endif
+#ifdef CPS_STRING_VIEW
+		BenchView(size, count);
+#endif
+	}
+	return 0;
+}
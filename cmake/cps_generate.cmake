@@ -0,0 +1,36 @@
+# cps_generate_cpp(<HDRS> STRUCT_HEADER <header> [STRUCT_NAMESPACE <ns>]
+#     <proto files>...)
+#
+# Generate type-specialized StructToProto/ProtoToStruct with protoc-gen-cps,
+# the header of <name>.proto is <name>.cps.h in the current binary dir.
+# Include it after convert_proto_struct.h to use the generated converter.
+
+include(CMakeParseArguments)
+
+function(cps_generate_cpp HDRS)
+    cmake_parse_arguments(cps "" "STRUCT_HEADER;STRUCT_NAMESPACE" "" ${ARGN})
+    set(parameter "struct_header=${cps_STRUCT_HEADER}")
+    if(cps_STRUCT_NAMESPACE)
+        set(parameter "${parameter},struct_namespace=${cps_STRUCT_NAMESPACE}")
+    endif()
+    set(${HDRS})
+    foreach(proto ${cps_UNPARSED_ARGUMENTS})
+        get_filename_component(abs_proto ${proto} ABSOLUTE)
+        get_filename_component(proto_dir ${abs_proto} DIRECTORY)
+        get_filename_component(proto_name ${proto} NAME_WE)
+        set(header "${CMAKE_CURRENT_BINARY_DIR}/${proto_name}.cps.h")
+        list(APPEND ${HDRS} ${header})
+        add_custom_command(
+            OUTPUT ${header}
+            COMMAND ${Protobuf_PROTOC_EXECUTABLE}
+                --plugin=protoc-gen-cps=$<TARGET_FILE:protoc-gen-cps>
+                --cps_out=${parameter}:${CMAKE_CURRENT_BINARY_DIR}
+                -I ${proto_dir} ${abs_proto}
+            DEPENDS ${abs_proto} protoc-gen-cps
+            COMMENT "Running cps protocol buffer compiler on ${proto}"
+            VERBATIM
+        )
+    endforeach()
+    set_source_files_properties(${${HDRS}} PROPERTIES GENERATED TRUE)
+    set(${HDRS} ${${HDRS}} PARENT_SCOPE)
+endfunction()
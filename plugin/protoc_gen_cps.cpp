@@ -0,0 +1,457 @@
+// Copyright 2021 genrwoody@163.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// protoc-gen-cps, generate type-specialized StructToProto/ProtoToStruct for
+// each message, which call the generated accessors directly.
+//
+// usage:
+//   protoc --plugin=protoc-gen-cps=path/to/protoc-gen-cps
+//       --cps_out=struct_header=message.h:out_dir message.proto
+//
+// parameters, separated by comma:
+//   struct_header=file: the header declare the structs, can be repeated.
+//   struct_namespace=ns: the namespace of the structs, default is global.
+//
+// The struct of message 'pkg.Outer.Inner' is 'ns::Outer::Inner', the member
+// has the same name as the field and is declared in the same order.
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+
+#include "cps_plugin.pb.h"
+
+using google::protobuf::Descriptor;
+using google::protobuf::DescriptorPool;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::FileDescriptor;
+
+namespace
+{
+
+// the generator options, parsed from plugin parameter.
+struct Options
+{
+	std::vector<std::string> struct_headers;
+	std::string struct_namespace;
+};
+
+// replace all 'from' in text with 'to'.
+std::string Replace(std::string text, const std::string &from,
+	const std::string &to)
+{
+	size_t pos = 0;
+	while ((pos = text.find(from, pos)) != std::string::npos) {
+		text.replace(pos, from.size(), to);
+		pos += to.size();
+	}
+	return text;
+}
+
+// split text by separator.
+std::vector<std::string> Split(const std::string &text, char separator)
+{
+	std::vector<std::string> result;
+	std::istringstream stream(text);
+	std::string item;
+	while (std::getline(stream, item, separator)) {
+		if (!item.empty()) {
+			result.push_back(item);
+		}
+	}
+	return result;
+}
+
+bool ParseOptions(const std::string &parameter, Options &options,
+	std::string &error)
+{
+	for (auto &item : Split(parameter, ',')) {
+		auto pos = item.find('=');
+		auto key = item.substr(0, pos);
+		auto value = pos == std::string::npos ? "" : item.substr(pos + 1);
+		if (key == "struct_header") {
+			options.struct_headers.push_back(value);
+		} else if (key == "struct_namespace") {
+			options.struct_namespace = value;
+		} else {
+			error = "unknown parameter: " + key;
+			return false;
+		}
+	}
+	return true;
+}
+
+// the name of type without package, such as 'Outer.Inner'.
+template<typename DESC>
+std::string RelativeName(const DESC *desc)
+{
+	auto &package = desc->file()->package();
+	if (package.empty()) {
+		return desc->full_name();
+	}
+	return desc->full_name().substr(package.size() + 1);
+}
+
+// the c++ class generated by protoc, such as '::pkg::Outer_Inner'.
+template<typename DESC>
+std::string ProtoName(const DESC *desc)
+{
+	auto package = Replace(desc->file()->package(), ".", "::");
+	auto name = Replace(RelativeName(desc), ".", "_");
+	return package.empty() ? "::" + name : "::" + package + "::" + name;
+}
+
+// the struct, such as '::ns::Outer::Inner'.
+std::string StructName(const Descriptor *desc, const Options &options)
+{
+	auto name = Replace(RelativeName(desc), ".", "::");
+	if (options.struct_namespace.empty()) {
+		return "::" + name;
+	}
+	return "::" + options.struct_namespace + "::" + name;
+}
+
+// the name of generated accessor.
+std::string Accessor(const FieldDescriptor *field)
+{
+	std::string name = field->name();
+	for (auto &c : name) {
+		if (c >= 'A' && c <= 'Z') {
+			c = c - 'A' + 'a';
+		}
+	}
+	return name;
+}
+
+// the c++ type with the same size as struct member of field.
+std::string MemberType(const FieldDescriptor *field, const Options &options)
+{
+	if (field->is_map()) {
+		return "std::map<uint8_t, uint8_t>";
+	}
+	if (field->is_repeated()) {
+		// std::vector<bool> is specialized, different from others.
+		if (field->cpp_type() == FieldDescriptor::CPPTYPE_BOOL) {
+			return "std::vector<bool>";
+		}
+		return "std::vector<uint8_t>";
+	}
+	switch (field->cpp_type()) {
+	case FieldDescriptor::CPPTYPE_INT32: return "int32_t";
+	case FieldDescriptor::CPPTYPE_INT64: return "int64_t";
+	case FieldDescriptor::CPPTYPE_UINT32: return "uint32_t";
+	case FieldDescriptor::CPPTYPE_UINT64: return "uint64_t";
+	case FieldDescriptor::CPPTYPE_DOUBLE: return "double";
+	case FieldDescriptor::CPPTYPE_FLOAT: return "float";
+	case FieldDescriptor::CPPTYPE_BOOL: return "bool";
+	case FieldDescriptor::CPPTYPE_ENUM: return "int";
+	case FieldDescriptor::CPPTYPE_STRING: return "std::string";
+	case FieldDescriptor::CPPTYPE_MESSAGE:
+		return StructName(field->message_type(), options);
+	}
+	return "void"; // never reached!
+}
+
+// convert a proto value expression to struct value.
+std::string ToStruct(const FieldDescriptor *field, const std::string &value,
+	const std::string &type)
+{
+	if (field->cpp_type() == FieldDescriptor::CPPTYPE_ENUM) {
+		return "static_cast<" + type + ">(" + value + ")";
+	}
+	return value;
+}
+
+// convert a struct value expression to proto value.
+std::string ToProto(const FieldDescriptor *field, const std::string &value)
+{
+	if (field->cpp_type() == FieldDescriptor::CPPTYPE_ENUM) {
+		return "static_cast<" + ProtoName(field->enum_type()) + ">(" +
+			value + ")";
+	}
+	return value;
+}
+
+bool IsMessage(const FieldDescriptor *field)
+{
+	return field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE;
+}
+
+// the value can be copied without conversion.
+bool IsPlain(const FieldDescriptor *field)
+{
+	return !IsMessage(field) &&
+		field->cpp_type() != FieldDescriptor::CPPTYPE_ENUM;
+}
+
+// collect all messages in file, nested first, map entry excluded.
+void CollectMessages(const Descriptor *desc,
+	std::vector<const Descriptor*> &messages)
+{
+	if (desc->options().map_entry()) {
+		return;
+	}
+	for (int i = 0; i < desc->nested_type_count(); ++i) {
+		CollectMessages(desc->nested_type(i), messages);
+	}
+	messages.push_back(desc);
+}
+
+class Generator
+{
+private:
+	const FileDescriptor *_file;
+	const Options &_options;
+	std::vector<const Descriptor*> _messages;
+	std::ostringstream _out;
+public:
+	Generator(const FileDescriptor *file, const Options &options)
+		: _file(file), _options(options)
+	{
+		for (int i = 0; i < file->message_type_count(); ++i) {
+			CollectMessages(file->message_type(i), _messages);
+		}
+	}
+
+	std::string generate(const std::set<std::string> &generated);
+
+private:
+	void layout_check(const Descriptor *desc);
+	void struct_to_proto(const Descriptor *desc);
+	void proto_to_struct(const Descriptor *desc);
+};
+
+// the static_asserts ensure the struct has the layout expected by the
+// reflection converter, so both converters can be used.
+void Generator::layout_check(const Descriptor *desc)
+{
+	auto name = StructName(desc, _options);
+	std::string prev;
+	for (int i = 0; i < desc->field_count(); ++i) {
+		auto field = desc->field(i);
+		auto member = name + "::" + field->name();
+		_out << "static_assert(sizeof(" << member << ") == sizeof("
+			<< MemberType(field, _options) << "),\n\t\"" << desc->full_name()
+			<< "." << field->name() << ": size mismatch\");\n";
+		if (!prev.empty()) {
+			_out << "static_assert(offsetof(" << name << ", " << prev
+				<< ") < offsetof(" << name << ", " << field->name()
+				<< "),\n\t\"" << desc->full_name() << "." << field->name()
+				<< ": declared out of order\");\n";
+		}
+		prev = field->name();
+	}
+	_out << "\n";
+}
+
+void Generator::struct_to_proto(const Descriptor *desc)
+{
+	_out << "// @brief Convert struct to " << desc->full_name() << ".\n"
+		<< "inline bool StructToProto(const " << StructName(desc, _options)
+		<< " &in, " << ProtoName(desc) << " &out)\n{\n";
+	for (int i = 0; i < desc->field_count(); ++i) {
+		auto field = desc->field(i);
+		auto in = "in." + field->name();
+		auto name = Accessor(field);
+		if (field->is_map()) {
+			auto value = field->message_type()->field(1);
+			auto target = "(*out.mutable_" + name + "())[pair.first]";
+			_out << "\tfor (const auto &pair : " << in << ") {\n";
+			if (IsMessage(value)) {
+				_out << "\t\tif (!StructToProto(pair.second, " << target
+					<< ")) {\n\t\t\treturn false;\n\t\t}\n";
+			} else {
+				_out << "\t\t" << target << " = "
+					<< ToProto(value, "pair.second") << ";\n";
+			}
+			_out << "\t}\n";
+		} else if (field->is_repeated() && IsPlain(field)) {
+			_out << "\tout.mutable_" << name << "()->Add(" << in
+				<< ".begin(), " << in << ".end());\n";
+		} else if (field->is_repeated()) {
+			_out << "\tfor (const auto &value : " << in << ") {\n";
+			if (IsMessage(field)) {
+				_out << "\t\tif (!StructToProto(value, *out.add_" << name
+					<< "())) {\n\t\t\treturn false;\n\t\t}\n";
+			} else {
+				_out << "\t\tout.add_" << name << "("
+					<< ToProto(field, "value") << ");\n";
+			}
+			_out << "\t}\n";
+		} else if (IsMessage(field)) {
+			_out << "\tif (!StructToProto(" << in << ", *out.mutable_" << name
+				<< "())) {\n\t\treturn false;\n\t}\n";
+		} else {
+			_out << "\tout.set_" << name << "(" << ToProto(field, in)
+				<< ");\n";
+		}
+	}
+	_out << "\treturn true;\n}\n\n";
+}
+
+void Generator::proto_to_struct(const Descriptor *desc)
+{
+	_out << "// @brief Convert " << desc->full_name() << " to struct.\n"
+		<< "inline bool ProtoToStruct(const " << ProtoName(desc)
+		<< " &in, " << StructName(desc, _options) << " &out)\n{\n";
+	for (int i = 0; i < desc->field_count(); ++i) {
+		auto field = desc->field(i);
+		auto out = "out." + field->name();
+		auto type = "decltype(" + out + ")";
+		auto name = Accessor(field);
+		if (field->is_map()) {
+			auto value = field->message_type()->field(1);
+			_out << "\tfor (auto &pair : in." << name << "()) {\n";
+			if (IsMessage(value)) {
+				_out << "\t\tauto result = " << out << ".emplace(pair.first, "
+					<< type << "::mapped_type());\n"
+					<< "\t\tif (!result.second ||\n"
+					<< "\t\t\t!ProtoToStruct(pair.second, "
+					<< "result.first->second)) {\n"
+					<< "\t\t\treturn false;\n\t\t}\n";
+			} else {
+				_out << "\t\tif (!" << out << ".emplace(pair.first, "
+					<< ToStruct(value, "pair.second", type + "::mapped_type")
+					<< ").second) {\n\t\t\treturn false;\n\t\t}\n";
+			}
+			_out << "\t}\n";
+		} else if (field->is_repeated() && IsPlain(field)) {
+			_out << "\t" << out << ".insert(" << out << ".end(), in." << name
+				<< "().begin(), in." << name << "().end());\n";
+		} else if (field->is_repeated()) {
+			_out << "\t" << out << ".reserve(" << out << ".size() + in."
+				<< name << "_size());\n"
+				<< "\tfor (auto &value : in." << name << "()) {\n";
+			if (IsMessage(field)) {
+				_out << "\t\t" << out << ".emplace_back();\n"
+					<< "\t\tif (!ProtoToStruct(value, " << out
+					<< ".back())) {\n\t\t\treturn false;\n\t\t}\n";
+			} else {
+				_out << "\t\t" << out << ".push_back("
+					<< ToStruct(field, "value", type + "::value_type")
+					<< ");\n";
+			}
+			_out << "\t}\n";
+		} else if (IsMessage(field)) {
+			_out << "\tif (!ProtoToStruct(in." << name << "(), " << out
+				<< ")) {\n\t\treturn false;\n\t}\n";
+		} else {
+			_out << "\t" << out << " = "
+				<< ToStruct(field, "in." + name + "()", type) << ";\n";
+		}
+	}
+	_out << "\treturn true;\n}\n\n";
+}
+
+std::string Generator::generate(const std::set<std::string> &generated)
+{
+	auto base = _file->name().substr(0, _file->name().rfind('.'));
+	_out << "// Generated by protoc-gen-cps from " << _file->name()
+		<< ", DO NOT EDIT!\n\n"
+		<< "#pragma once\n\n"
+		<< "#include <cstddef>\n"
+		<< "#include <cstdint>\n"
+		<< "#include <map>\n"
+		<< "#include <string>\n"
+		<< "#include <vector>\n\n"
+		<< "#include \"" << base << ".pb.h\"\n";
+	for (int i = 0; i < _file->dependency_count(); ++i) {
+		auto &name = _file->dependency(i)->name();
+		if (generated.count(name)) {
+			auto dep = name.substr(0, name.rfind('.'));
+			_out << "#include \"" << dep << ".cps.h\"\n";
+		}
+	}
+	for (auto &header : _options.struct_headers) {
+		_out << "#include \"" << header << "\"\n";
+	}
+	_out << "#include \"convert_proto_struct.h\"\n\n"
+		<< "#if defined(__GNUC__)\n"
+		<< "#pragma GCC diagnostic push\n"
+		<< "#pragma GCC diagnostic ignored \"-Winvalid-offsetof\"\n"
+		<< "#endif\n\n"
+		<< "namespace cps\n{\n\n";
+	for (auto desc : _messages) {
+		layout_check(desc);
+	}
+	// declare all, the message may be used before defined.
+	for (auto desc : _messages) {
+		_out << "inline bool StructToProto(const "
+			<< StructName(desc, _options) << " &in, " << ProtoName(desc)
+			<< " &out);\n"
+			<< "inline bool ProtoToStruct(const " << ProtoName(desc)
+			<< " &in, " << StructName(desc, _options) << " &out);\n";
+	}
+	_out << "\n";
+	for (auto desc : _messages) {
+		struct_to_proto(desc);
+		proto_to_struct(desc);
+	}
+	_out << "} // namespace cps\n\n"
+		<< "#if defined(__GNUC__)\n"
+		<< "#pragma GCC diagnostic pop\n"
+		<< "#endif\n";
+	return _out.str();
+}
+
+} // namespace
+
+int main()
+{
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	cps::plugin::CodeGeneratorRequest request;
+	cps::plugin::CodeGeneratorResponse response;
+	if (!request.ParseFromIstream(&std::cin)) {
+		std::cerr << "protoc-gen-cps: failed to parse request." << std::endl;
+		return 1;
+	}
+	response.set_supported_features(
+		cps::plugin::CodeGeneratorResponse::FEATURE_PROTO3_OPTIONAL);
+	Options options;
+	std::string error;
+	if (!ParseOptions(request.parameter(), options, error)) {
+		response.set_error(error);
+		return response.SerializeToOstream(&std::cout) ? 0 : 1;
+	}
+	DescriptorPool pool;
+	for (auto &proto : request.proto_file()) {
+		if (pool.BuildFile(proto) == nullptr) {
+			response.set_error("failed to build " + proto.name());
+			return response.SerializeToOstream(&std::cout) ? 0 : 1;
+		}
+	}
+	std::set<std::string> generated(request.file_to_generate().begin(),
+		request.file_to_generate().end());
+	for (auto &name : request.file_to_generate()) {
+		auto file = pool.FindFileByName(name);
+		Generator generator(file, options);
+		auto output = response.add_file();
+		output->set_name(name.substr(0, name.rfind('.')) + ".cps.h");
+		output->set_content(generator.generate(generated));
+	}
+	return response.SerializeToOstream(&std::cout) ? 0 : 1;
+}
@@ -0,0 +1,1025 @@
+// Copyright 2021 genrwoody@163.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _CONVERT_AGGREGATE_INC_
+#define _CONVERT_AGGREGATE_INC_
+
+// Convert between protobuf message and plain aggregate struct, the members of
+// struct are enumerated at compile time by structured binding, so the member
+// is accessed directly with its own type, without the layout inferred from
+// descriptor. Requires C++17. The members are matched to the fields of message
+// in order of declaration, and the supported member types are:
+//   int32_t, int64_t, uint32_t, uint64_t, float, double, bool, 32 bits enum,
+//   std::string, aggregate struct (without base class), std::vector of them
+//   and std::map, std::unordered_map or sorted std::vector<std::pair> with key
+//   of integer or std::string.
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+
+#define CPS_AGGREGATE_REFLECTION 1
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <google/protobuf/message.h>
+
+namespace cps
+{
+
+namespace aggregate
+{
+
+using google::protobuf::Descriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::Message;
+using google::protobuf::Reflection;
+
+// the max count of members of struct.
+const size_t kMaxMembers = 128;
+
+namespace detail
+{
+
+// convertible to any member type, only used in unevaluated context.
+struct AnyMember
+{
+	template<typename Ty>
+	operator Ty() const;
+};
+
+// Ty can be initialized by the count of Seq members.
+template<typename Ty, typename Seq, typename = void>
+struct Initializable : std::false_type {};
+
+template<typename Ty, size_t... I>
+struct Initializable<Ty, std::index_sequence<I...>,
+	std::void_t<decltype(Ty{ (void(I), AnyMember())... })>>
+	: std::true_type {};
+
+// count of members of aggregate Ty, the max count of initializers.
+template<typename Ty, size_t N = 0, bool = (N < kMaxMembers + 1) &&
+	Initializable<Ty, std::make_index_sequence<N + 1>>::value>
+struct MemberCount : std::integral_constant<size_t, N> {};
+
+template<typename Ty, size_t N>
+struct MemberCount<Ty, N, true> : MemberCount<Ty, N + 1> {};
+
+// call func(index, member) for each member in order, stop at the first
+// false returned.
+template<typename Func, typename... Members, size_t... I>
+inline bool Visit(Func &func, std::index_sequence<I...>, Members&... members)
+{
+	return (func(std::integral_constant<size_t, I>(), members) && ...);
+}
+
+// bind the N members of struct.
+template<size_t N>
+struct Tie
+{
+	static_assert(N <= kMaxMembers, "too many members of struct");
+};
+
+template<>
+struct Tie<0>
+{
+	template<typename Ty, typename Func>
+	static inline bool apply(Ty&, Func&) { return true; }
+};
+
+#define CPS_TIE(N, ...) \
+template<> \
+struct Tie<N> \
+{ \
+	template<typename Ty, typename Func> \
+	static inline bool apply(Ty &value, Func &func) \
+	{ \
+		auto &[__VA_ARGS__] = value; \
+		return Visit(func, std::make_index_sequence<N>(), __VA_ARGS__); \
+	} \
+};
+
+#define CPS_MEMBERS_1 m0
+#define CPS_MEMBERS_2 CPS_MEMBERS_1, m1
+#define CPS_MEMBERS_3 CPS_MEMBERS_2, m2
+#define CPS_MEMBERS_4 CPS_MEMBERS_3, m3
+#define CPS_MEMBERS_5 CPS_MEMBERS_4, m4
+#define CPS_MEMBERS_6 CPS_MEMBERS_5, m5
+#define CPS_MEMBERS_7 CPS_MEMBERS_6, m6
+#define CPS_MEMBERS_8 CPS_MEMBERS_7, m7
+#define CPS_MEMBERS_9 CPS_MEMBERS_8, m8
+#define CPS_MEMBERS_10 CPS_MEMBERS_9, m9
+#define CPS_MEMBERS_11 CPS_MEMBERS_10, m10
+#define CPS_MEMBERS_12 CPS_MEMBERS_11, m11
+#define CPS_MEMBERS_13 CPS_MEMBERS_12, m12
+#define CPS_MEMBERS_14 CPS_MEMBERS_13, m13
+#define CPS_MEMBERS_15 CPS_MEMBERS_14, m14
+#define CPS_MEMBERS_16 CPS_MEMBERS_15, m15
+#define CPS_MEMBERS_17 CPS_MEMBERS_16, m16
+#define CPS_MEMBERS_18 CPS_MEMBERS_17, m17
+#define CPS_MEMBERS_19 CPS_MEMBERS_18, m18
+#define CPS_MEMBERS_20 CPS_MEMBERS_19, m19
+#define CPS_MEMBERS_21 CPS_MEMBERS_20, m20
+#define CPS_MEMBERS_22 CPS_MEMBERS_21, m21
+#define CPS_MEMBERS_23 CPS_MEMBERS_22, m22
+#define CPS_MEMBERS_24 CPS_MEMBERS_23, m23
+#define CPS_MEMBERS_25 CPS_MEMBERS_24, m24
+#define CPS_MEMBERS_26 CPS_MEMBERS_25, m25
+#define CPS_MEMBERS_27 CPS_MEMBERS_26, m26
+#define CPS_MEMBERS_28 CPS_MEMBERS_27, m27
+#define CPS_MEMBERS_29 CPS_MEMBERS_28, m28
+#define CPS_MEMBERS_30 CPS_MEMBERS_29, m29
+#define CPS_MEMBERS_31 CPS_MEMBERS_30, m30
+#define CPS_MEMBERS_32 CPS_MEMBERS_31, m31
+#define CPS_MEMBERS_33 CPS_MEMBERS_32, m32
+#define CPS_MEMBERS_34 CPS_MEMBERS_33, m33
+#define CPS_MEMBERS_35 CPS_MEMBERS_34, m34
+#define CPS_MEMBERS_36 CPS_MEMBERS_35, m35
+#define CPS_MEMBERS_37 CPS_MEMBERS_36, m36
+#define CPS_MEMBERS_38 CPS_MEMBERS_37, m37
+#define CPS_MEMBERS_39 CPS_MEMBERS_38, m38
+#define CPS_MEMBERS_40 CPS_MEMBERS_39, m39
+#define CPS_MEMBERS_41 CPS_MEMBERS_40, m40
+#define CPS_MEMBERS_42 CPS_MEMBERS_41, m41
+#define CPS_MEMBERS_43 CPS_MEMBERS_42, m42
+#define CPS_MEMBERS_44 CPS_MEMBERS_43, m43
+#define CPS_MEMBERS_45 CPS_MEMBERS_44, m44
+#define CPS_MEMBERS_46 CPS_MEMBERS_45, m45
+#define CPS_MEMBERS_47 CPS_MEMBERS_46, m46
+#define CPS_MEMBERS_48 CPS_MEMBERS_47, m47
+#define CPS_MEMBERS_49 CPS_MEMBERS_48, m48
+#define CPS_MEMBERS_50 CPS_MEMBERS_49, m49
+#define CPS_MEMBERS_51 CPS_MEMBERS_50, m50
+#define CPS_MEMBERS_52 CPS_MEMBERS_51, m51
+#define CPS_MEMBERS_53 CPS_MEMBERS_52, m52
+#define CPS_MEMBERS_54 CPS_MEMBERS_53, m53
+#define CPS_MEMBERS_55 CPS_MEMBERS_54, m54
+#define CPS_MEMBERS_56 CPS_MEMBERS_55, m55
+#define CPS_MEMBERS_57 CPS_MEMBERS_56, m56
+#define CPS_MEMBERS_58 CPS_MEMBERS_57, m57
+#define CPS_MEMBERS_59 CPS_MEMBERS_58, m58
+#define CPS_MEMBERS_60 CPS_MEMBERS_59, m59
+#define CPS_MEMBERS_61 CPS_MEMBERS_60, m60
+#define CPS_MEMBERS_62 CPS_MEMBERS_61, m61
+#define CPS_MEMBERS_63 CPS_MEMBERS_62, m62
+#define CPS_MEMBERS_64 CPS_MEMBERS_63, m63
+#define CPS_MEMBERS_65 CPS_MEMBERS_64, m64
+#define CPS_MEMBERS_66 CPS_MEMBERS_65, m65
+#define CPS_MEMBERS_67 CPS_MEMBERS_66, m66
+#define CPS_MEMBERS_68 CPS_MEMBERS_67, m67
+#define CPS_MEMBERS_69 CPS_MEMBERS_68, m68
+#define CPS_MEMBERS_70 CPS_MEMBERS_69, m69
+#define CPS_MEMBERS_71 CPS_MEMBERS_70, m70
+#define CPS_MEMBERS_72 CPS_MEMBERS_71, m71
+#define CPS_MEMBERS_73 CPS_MEMBERS_72, m72
+#define CPS_MEMBERS_74 CPS_MEMBERS_73, m73
+#define CPS_MEMBERS_75 CPS_MEMBERS_74, m74
+#define CPS_MEMBERS_76 CPS_MEMBERS_75, m75
+#define CPS_MEMBERS_77 CPS_MEMBERS_76, m76
+#define CPS_MEMBERS_78 CPS_MEMBERS_77, m77
+#define CPS_MEMBERS_79 CPS_MEMBERS_78, m78
+#define CPS_MEMBERS_80 CPS_MEMBERS_79, m79
+#define CPS_MEMBERS_81 CPS_MEMBERS_80, m80
+#define CPS_MEMBERS_82 CPS_MEMBERS_81, m81
+#define CPS_MEMBERS_83 CPS_MEMBERS_82, m82
+#define CPS_MEMBERS_84 CPS_MEMBERS_83, m83
+#define CPS_MEMBERS_85 CPS_MEMBERS_84, m84
+#define CPS_MEMBERS_86 CPS_MEMBERS_85, m85
+#define CPS_MEMBERS_87 CPS_MEMBERS_86, m86
+#define CPS_MEMBERS_88 CPS_MEMBERS_87, m87
+#define CPS_MEMBERS_89 CPS_MEMBERS_88, m88
+#define CPS_MEMBERS_90 CPS_MEMBERS_89, m89
+#define CPS_MEMBERS_91 CPS_MEMBERS_90, m90
+#define CPS_MEMBERS_92 CPS_MEMBERS_91, m91
+#define CPS_MEMBERS_93 CPS_MEMBERS_92, m92
+#define CPS_MEMBERS_94 CPS_MEMBERS_93, m93
+#define CPS_MEMBERS_95 CPS_MEMBERS_94, m94
+#define CPS_MEMBERS_96 CPS_MEMBERS_95, m95
+#define CPS_MEMBERS_97 CPS_MEMBERS_96, m96
+#define CPS_MEMBERS_98 CPS_MEMBERS_97, m97
+#define CPS_MEMBERS_99 CPS_MEMBERS_98, m98
+#define CPS_MEMBERS_100 CPS_MEMBERS_99, m99
+#define CPS_MEMBERS_101 CPS_MEMBERS_100, m100
+#define CPS_MEMBERS_102 CPS_MEMBERS_101, m101
+#define CPS_MEMBERS_103 CPS_MEMBERS_102, m102
+#define CPS_MEMBERS_104 CPS_MEMBERS_103, m103
+#define CPS_MEMBERS_105 CPS_MEMBERS_104, m104
+#define CPS_MEMBERS_106 CPS_MEMBERS_105, m105
+#define CPS_MEMBERS_107 CPS_MEMBERS_106, m106
+#define CPS_MEMBERS_108 CPS_MEMBERS_107, m107
+#define CPS_MEMBERS_109 CPS_MEMBERS_108, m108
+#define CPS_MEMBERS_110 CPS_MEMBERS_109, m109
+#define CPS_MEMBERS_111 CPS_MEMBERS_110, m110
+#define CPS_MEMBERS_112 CPS_MEMBERS_111, m111
+#define CPS_MEMBERS_113 CPS_MEMBERS_112, m112
+#define CPS_MEMBERS_114 CPS_MEMBERS_113, m113
+#define CPS_MEMBERS_115 CPS_MEMBERS_114, m114
+#define CPS_MEMBERS_116 CPS_MEMBERS_115, m115
+#define CPS_MEMBERS_117 CPS_MEMBERS_116, m116
+#define CPS_MEMBERS_118 CPS_MEMBERS_117, m117
+#define CPS_MEMBERS_119 CPS_MEMBERS_118, m118
+#define CPS_MEMBERS_120 CPS_MEMBERS_119, m119
+#define CPS_MEMBERS_121 CPS_MEMBERS_120, m120
+#define CPS_MEMBERS_122 CPS_MEMBERS_121, m121
+#define CPS_MEMBERS_123 CPS_MEMBERS_122, m122
+#define CPS_MEMBERS_124 CPS_MEMBERS_123, m123
+#define CPS_MEMBERS_125 CPS_MEMBERS_124, m124
+#define CPS_MEMBERS_126 CPS_MEMBERS_125, m125
+#define CPS_MEMBERS_127 CPS_MEMBERS_126, m126
+#define CPS_MEMBERS_128 CPS_MEMBERS_127, m127
+
+CPS_TIE(1, CPS_MEMBERS_1)
+CPS_TIE(2, CPS_MEMBERS_2)
+CPS_TIE(3, CPS_MEMBERS_3)
+CPS_TIE(4, CPS_MEMBERS_4)
+CPS_TIE(5, CPS_MEMBERS_5)
+CPS_TIE(6, CPS_MEMBERS_6)
+CPS_TIE(7, CPS_MEMBERS_7)
+CPS_TIE(8, CPS_MEMBERS_8)
+CPS_TIE(9, CPS_MEMBERS_9)
+CPS_TIE(10, CPS_MEMBERS_10)
+CPS_TIE(11, CPS_MEMBERS_11)
+CPS_TIE(12, CPS_MEMBERS_12)
+CPS_TIE(13, CPS_MEMBERS_13)
+CPS_TIE(14, CPS_MEMBERS_14)
+CPS_TIE(15, CPS_MEMBERS_15)
+CPS_TIE(16, CPS_MEMBERS_16)
+CPS_TIE(17, CPS_MEMBERS_17)
+CPS_TIE(18, CPS_MEMBERS_18)
+CPS_TIE(19, CPS_MEMBERS_19)
+CPS_TIE(20, CPS_MEMBERS_20)
+CPS_TIE(21, CPS_MEMBERS_21)
+CPS_TIE(22, CPS_MEMBERS_22)
+CPS_TIE(23, CPS_MEMBERS_23)
+CPS_TIE(24, CPS_MEMBERS_24)
+CPS_TIE(25, CPS_MEMBERS_25)
+CPS_TIE(26, CPS_MEMBERS_26)
+CPS_TIE(27, CPS_MEMBERS_27)
+CPS_TIE(28, CPS_MEMBERS_28)
+CPS_TIE(29, CPS_MEMBERS_29)
+CPS_TIE(30, CPS_MEMBERS_30)
+CPS_TIE(31, CPS_MEMBERS_31)
+CPS_TIE(32, CPS_MEMBERS_32)
+CPS_TIE(33, CPS_MEMBERS_33)
+CPS_TIE(34, CPS_MEMBERS_34)
+CPS_TIE(35, CPS_MEMBERS_35)
+CPS_TIE(36, CPS_MEMBERS_36)
+CPS_TIE(37, CPS_MEMBERS_37)
+CPS_TIE(38, CPS_MEMBERS_38)
+CPS_TIE(39, CPS_MEMBERS_39)
+CPS_TIE(40, CPS_MEMBERS_40)
+CPS_TIE(41, CPS_MEMBERS_41)
+CPS_TIE(42, CPS_MEMBERS_42)
+CPS_TIE(43, CPS_MEMBERS_43)
+CPS_TIE(44, CPS_MEMBERS_44)
+CPS_TIE(45, CPS_MEMBERS_45)
+CPS_TIE(46, CPS_MEMBERS_46)
+CPS_TIE(47, CPS_MEMBERS_47)
+CPS_TIE(48, CPS_MEMBERS_48)
+CPS_TIE(49, CPS_MEMBERS_49)
+CPS_TIE(50, CPS_MEMBERS_50)
+CPS_TIE(51, CPS_MEMBERS_51)
+CPS_TIE(52, CPS_MEMBERS_52)
+CPS_TIE(53, CPS_MEMBERS_53)
+CPS_TIE(54, CPS_MEMBERS_54)
+CPS_TIE(55, CPS_MEMBERS_55)
+CPS_TIE(56, CPS_MEMBERS_56)
+CPS_TIE(57, CPS_MEMBERS_57)
+CPS_TIE(58, CPS_MEMBERS_58)
+CPS_TIE(59, CPS_MEMBERS_59)
+CPS_TIE(60, CPS_MEMBERS_60)
+CPS_TIE(61, CPS_MEMBERS_61)
+CPS_TIE(62, CPS_MEMBERS_62)
+CPS_TIE(63, CPS_MEMBERS_63)
+CPS_TIE(64, CPS_MEMBERS_64)
+CPS_TIE(65, CPS_MEMBERS_65)
+CPS_TIE(66, CPS_MEMBERS_66)
+CPS_TIE(67, CPS_MEMBERS_67)
+CPS_TIE(68, CPS_MEMBERS_68)
+CPS_TIE(69, CPS_MEMBERS_69)
+CPS_TIE(70, CPS_MEMBERS_70)
+CPS_TIE(71, CPS_MEMBERS_71)
+CPS_TIE(72, CPS_MEMBERS_72)
+CPS_TIE(73, CPS_MEMBERS_73)
+CPS_TIE(74, CPS_MEMBERS_74)
+CPS_TIE(75, CPS_MEMBERS_75)
+CPS_TIE(76, CPS_MEMBERS_76)
+CPS_TIE(77, CPS_MEMBERS_77)
+CPS_TIE(78, CPS_MEMBERS_78)
+CPS_TIE(79, CPS_MEMBERS_79)
+CPS_TIE(80, CPS_MEMBERS_80)
+CPS_TIE(81, CPS_MEMBERS_81)
+CPS_TIE(82, CPS_MEMBERS_82)
+CPS_TIE(83, CPS_MEMBERS_83)
+CPS_TIE(84, CPS_MEMBERS_84)
+CPS_TIE(85, CPS_MEMBERS_85)
+CPS_TIE(86, CPS_MEMBERS_86)
+CPS_TIE(87, CPS_MEMBERS_87)
+CPS_TIE(88, CPS_MEMBERS_88)
+CPS_TIE(89, CPS_MEMBERS_89)
+CPS_TIE(90, CPS_MEMBERS_90)
+CPS_TIE(91, CPS_MEMBERS_91)
+CPS_TIE(92, CPS_MEMBERS_92)
+CPS_TIE(93, CPS_MEMBERS_93)
+CPS_TIE(94, CPS_MEMBERS_94)
+CPS_TIE(95, CPS_MEMBERS_95)
+CPS_TIE(96, CPS_MEMBERS_96)
+CPS_TIE(97, CPS_MEMBERS_97)
+CPS_TIE(98, CPS_MEMBERS_98)
+CPS_TIE(99, CPS_MEMBERS_99)
+CPS_TIE(100, CPS_MEMBERS_100)
+CPS_TIE(101, CPS_MEMBERS_101)
+CPS_TIE(102, CPS_MEMBERS_102)
+CPS_TIE(103, CPS_MEMBERS_103)
+CPS_TIE(104, CPS_MEMBERS_104)
+CPS_TIE(105, CPS_MEMBERS_105)
+CPS_TIE(106, CPS_MEMBERS_106)
+CPS_TIE(107, CPS_MEMBERS_107)
+CPS_TIE(108, CPS_MEMBERS_108)
+CPS_TIE(109, CPS_MEMBERS_109)
+CPS_TIE(110, CPS_MEMBERS_110)
+CPS_TIE(111, CPS_MEMBERS_111)
+CPS_TIE(112, CPS_MEMBERS_112)
+CPS_TIE(113, CPS_MEMBERS_113)
+CPS_TIE(114, CPS_MEMBERS_114)
+CPS_TIE(115, CPS_MEMBERS_115)
+CPS_TIE(116, CPS_MEMBERS_116)
+CPS_TIE(117, CPS_MEMBERS_117)
+CPS_TIE(118, CPS_MEMBERS_118)
+CPS_TIE(119, CPS_MEMBERS_119)
+CPS_TIE(120, CPS_MEMBERS_120)
+CPS_TIE(121, CPS_MEMBERS_121)
+CPS_TIE(122, CPS_MEMBERS_122)
+CPS_TIE(123, CPS_MEMBERS_123)
+CPS_TIE(124, CPS_MEMBERS_124)
+CPS_TIE(125, CPS_MEMBERS_125)
+CPS_TIE(126, CPS_MEMBERS_126)
+CPS_TIE(127, CPS_MEMBERS_127)
+CPS_TIE(128, CPS_MEMBERS_128)
+
+#undef CPS_TIE
+#undef CPS_MEMBERS_1
+#undef CPS_MEMBERS_2
+#undef CPS_MEMBERS_3
+#undef CPS_MEMBERS_4
+#undef CPS_MEMBERS_5
+#undef CPS_MEMBERS_6
+#undef CPS_MEMBERS_7
+#undef CPS_MEMBERS_8
+#undef CPS_MEMBERS_9
+#undef CPS_MEMBERS_10
+#undef CPS_MEMBERS_11
+#undef CPS_MEMBERS_12
+#undef CPS_MEMBERS_13
+#undef CPS_MEMBERS_14
+#undef CPS_MEMBERS_15
+#undef CPS_MEMBERS_16
+#undef CPS_MEMBERS_17
+#undef CPS_MEMBERS_18
+#undef CPS_MEMBERS_19
+#undef CPS_MEMBERS_20
+#undef CPS_MEMBERS_21
+#undef CPS_MEMBERS_22
+#undef CPS_MEMBERS_23
+#undef CPS_MEMBERS_24
+#undef CPS_MEMBERS_25
+#undef CPS_MEMBERS_26
+#undef CPS_MEMBERS_27
+#undef CPS_MEMBERS_28
+#undef CPS_MEMBERS_29
+#undef CPS_MEMBERS_30
+#undef CPS_MEMBERS_31
+#undef CPS_MEMBERS_32
+#undef CPS_MEMBERS_33
+#undef CPS_MEMBERS_34
+#undef CPS_MEMBERS_35
+#undef CPS_MEMBERS_36
+#undef CPS_MEMBERS_37
+#undef CPS_MEMBERS_38
+#undef CPS_MEMBERS_39
+#undef CPS_MEMBERS_40
+#undef CPS_MEMBERS_41
+#undef CPS_MEMBERS_42
+#undef CPS_MEMBERS_43
+#undef CPS_MEMBERS_44
+#undef CPS_MEMBERS_45
+#undef CPS_MEMBERS_46
+#undef CPS_MEMBERS_47
+#undef CPS_MEMBERS_48
+#undef CPS_MEMBERS_49
+#undef CPS_MEMBERS_50
+#undef CPS_MEMBERS_51
+#undef CPS_MEMBERS_52
+#undef CPS_MEMBERS_53
+#undef CPS_MEMBERS_54
+#undef CPS_MEMBERS_55
+#undef CPS_MEMBERS_56
+#undef CPS_MEMBERS_57
+#undef CPS_MEMBERS_58
+#undef CPS_MEMBERS_59
+#undef CPS_MEMBERS_60
+#undef CPS_MEMBERS_61
+#undef CPS_MEMBERS_62
+#undef CPS_MEMBERS_63
+#undef CPS_MEMBERS_64
+#undef CPS_MEMBERS_65
+#undef CPS_MEMBERS_66
+#undef CPS_MEMBERS_67
+#undef CPS_MEMBERS_68
+#undef CPS_MEMBERS_69
+#undef CPS_MEMBERS_70
+#undef CPS_MEMBERS_71
+#undef CPS_MEMBERS_72
+#undef CPS_MEMBERS_73
+#undef CPS_MEMBERS_74
+#undef CPS_MEMBERS_75
+#undef CPS_MEMBERS_76
+#undef CPS_MEMBERS_77
+#undef CPS_MEMBERS_78
+#undef CPS_MEMBERS_79
+#undef CPS_MEMBERS_80
+#undef CPS_MEMBERS_81
+#undef CPS_MEMBERS_82
+#undef CPS_MEMBERS_83
+#undef CPS_MEMBERS_84
+#undef CPS_MEMBERS_85
+#undef CPS_MEMBERS_86
+#undef CPS_MEMBERS_87
+#undef CPS_MEMBERS_88
+#undef CPS_MEMBERS_89
+#undef CPS_MEMBERS_90
+#undef CPS_MEMBERS_91
+#undef CPS_MEMBERS_92
+#undef CPS_MEMBERS_93
+#undef CPS_MEMBERS_94
+#undef CPS_MEMBERS_95
+#undef CPS_MEMBERS_96
+#undef CPS_MEMBERS_97
+#undef CPS_MEMBERS_98
+#undef CPS_MEMBERS_99
+#undef CPS_MEMBERS_100
+#undef CPS_MEMBERS_101
+#undef CPS_MEMBERS_102
+#undef CPS_MEMBERS_103
+#undef CPS_MEMBERS_104
+#undef CPS_MEMBERS_105
+#undef CPS_MEMBERS_106
+#undef CPS_MEMBERS_107
+#undef CPS_MEMBERS_108
+#undef CPS_MEMBERS_109
+#undef CPS_MEMBERS_110
+#undef CPS_MEMBERS_111
+#undef CPS_MEMBERS_112
+#undef CPS_MEMBERS_113
+#undef CPS_MEMBERS_114
+#undef CPS_MEMBERS_115
+#undef CPS_MEMBERS_116
+#undef CPS_MEMBERS_117
+#undef CPS_MEMBERS_118
+#undef CPS_MEMBERS_119
+#undef CPS_MEMBERS_120
+#undef CPS_MEMBERS_121
+#undef CPS_MEMBERS_122
+#undef CPS_MEMBERS_123
+#undef CPS_MEMBERS_124
+#undef CPS_MEMBERS_125
+#undef CPS_MEMBERS_126
+#undef CPS_MEMBERS_127
+#undef CPS_MEMBERS_128
+
+// the member is a nested struct.
+template<typename Ty>
+struct IsStruct : std::integral_constant<bool, std::is_class<Ty>::value &&
+	std::is_aggregate<Ty>::value> {};
+
+template<typename Ty>
+struct IsStruct<std::vector<Ty>> : std::false_type {};
+
+template<typename Key, typename Value>
+struct IsStruct<std::map<Key, Value>> : std::false_type {};
+
+template<typename Key, typename Value>
+struct IsStruct<std::unordered_map<Key, Value>> : std::false_type {};
+
+} // namespace detail
+
+template<typename Ty, typename = void>
+struct Member;
+
+// @brief Call func(index, member) for each member of aggregate struct.
+// @return false if func returns false.
+template<typename STRUCT, typename Func>
+inline bool ForEachMember(STRUCT &value, Func &&func)
+{
+	typedef typename std::remove_const<STRUCT>::type Type;
+	return detail::Tie<detail::MemberCount<Type>::value>::apply(value, func);
+}
+
+// @brief Check the members of struct are matched to the fields of message.
+// @param[in] desc: protobuf message descriptor
+// @param[in,out] visiting: the structs being checked, for recursive types
+template<typename STRUCT>
+bool CheckStruct(const Descriptor *desc,
+	std::vector<const Descriptor*> &visiting)
+{
+	for (auto checking : visiting) {
+		if (checking == desc) {
+			return true; // checked by the caller
+		}
+	}
+	constexpr size_t count = detail::MemberCount<STRUCT>::value;
+	if (desc->field_count() != static_cast<int>(count)) {
+		return false;
+	}
+	visiting.push_back(desc);
+	// only the types of members are used.
+	STRUCT value{};
+	bool result = ForEachMember(value,
+		[&](auto index, auto &member) {
+			typedef typename std::decay<decltype(member)>::type Type;
+			return Member<Type>::check(desc->field(index), visiting);
+		});
+	visiting.pop_back();
+	return result;
+}
+
+// @brief Convert members of struct to fields of protobuf message.
+template<typename STRUCT>
+inline void ToProto(const STRUCT &in, Message &msg)
+{
+	auto desc = msg.GetDescriptor();
+	auto refl = msg.GetReflection();
+	ForEachMember(in, [&](auto index, auto &member) {
+		typedef typename std::decay<decltype(member)>::type Type;
+		Member<Type>::set(msg, refl, desc->field(index), member);
+		return true;
+	});
+}
+
+// @brief Convert fields of protobuf message to members of struct.
+template<typename STRUCT>
+inline void FromProto(const Message &msg, STRUCT &out)
+{
+	auto desc = msg.GetDescriptor();
+	auto refl = msg.GetReflection();
+	ForEachMember(out, [&](auto index, auto &member) {
+		typedef typename std::decay<decltype(member)>::type Type;
+		Member<Type>::get(msg, refl, desc->field(index), member);
+		return true;
+	});
+}
+
+// the converter of member type, the primary template is unsupported.
+template<typename Ty, typename>
+struct Member
+{
+	static_assert(sizeof(Ty) == 0, "unsupported member type of struct");
+};
+
+// fundamental member, and element of repeated field.
+#define CPS_MEMBER(TYPE, CPPTYPE, Function) \
+template<> \
+struct Member<TYPE> \
+{ \
+	static bool check(const FieldDescriptor *field, \
+		std::vector<const Descriptor*> &visiting) \
+	{ \
+		return !field->is_repeated() && check_element(field, visiting); \
+	} \
+	static bool check_element(const FieldDescriptor *field, \
+		std::vector<const Descriptor*>&) \
+	{ \
+		return field->cpp_type() == FieldDescriptor::CPPTYPE_ ## CPPTYPE; \
+	} \
+	static void set(Message &msg, const Reflection *refl, \
+		const FieldDescriptor *field, TYPE value) \
+	{ \
+		refl->Set ## Function(&msg, field, value); \
+	} \
+	static void get(const Message &msg, const Reflection *refl, \
+		const FieldDescriptor *field, TYPE &value) \
+	{ \
+		value = refl->Get ## Function(msg, field); \
+	} \
+	static void add(Message &msg, const Reflection *refl, \
+		const FieldDescriptor *field, TYPE value) \
+	{ \
+		refl->Add ## Function(&msg, field, value); \
+	} \
+	static void get(const Message &msg, const Reflection *refl, \
+		const FieldDescriptor *field, int index, TYPE &value) \
+	{ \
+		value = refl->GetRepeated ## Function(msg, field, index); \
+	} \
+};
+
+CPS_MEMBER(int32_t, INT32, Int32)
+CPS_MEMBER(int64_t, INT64, Int64)
+CPS_MEMBER(uint32_t, UINT32, UInt32)
+CPS_MEMBER(uint64_t, UINT64, UInt64)
+CPS_MEMBER(float, FLOAT, Float)
+CPS_MEMBER(double, DOUBLE, Double)
+CPS_MEMBER(bool, BOOL, Bool)
+
+#undef CPS_MEMBER
+
+template<>
+struct Member<std::string>
+{
+	static bool check(const FieldDescriptor *field,
+		std::vector<const Descriptor*> &visiting)
+	{
+		return !field->is_repeated() && check_element(field, visiting);
+	}
+	static bool check_element(const FieldDescriptor *field,
+		std::vector<const Descriptor*>&)
+	{
+		return field->cpp_type() == FieldDescriptor::CPPTYPE_STRING;
+	}
+	static void set(Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, const std::string &value)
+	{
+		refl->SetString(&msg, field, value);
+	}
+	static void get(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, std::string &value)
+	{
+		value = refl->GetString(msg, field);
+	}
+	static void add(Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, const std::string &value)
+	{
+		refl->AddString(&msg, field, value);
+	}
+	static void get(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, int index, std::string &value)
+	{
+		value = refl->GetRepeatedString(msg, field, index);
+	}
+};
+
+// enum member, the underlying type is 32 bits.
+template<typename Ty>
+struct Member<Ty, typename std::enable_if<std::is_enum<Ty>::value>::type>
+{
+	static_assert(sizeof(Ty) == sizeof(int), "enum should be 32 bits");
+	static bool check(const FieldDescriptor *field,
+		std::vector<const Descriptor*> &visiting)
+	{
+		return !field->is_repeated() && check_element(field, visiting);
+	}
+	static bool check_element(const FieldDescriptor *field,
+		std::vector<const Descriptor*>&)
+	{
+		return field->cpp_type() == FieldDescriptor::CPPTYPE_ENUM;
+	}
+	static void set(Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, Ty value)
+	{
+		refl->SetEnumValue(&msg, field, static_cast<int>(value));
+	}
+	static void get(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, Ty &value)
+	{
+		value = static_cast<Ty>(refl->GetEnumValue(msg, field));
+	}
+	static void add(Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, Ty value)
+	{
+		refl->AddEnumValue(&msg, field, static_cast<int>(value));
+	}
+	static void get(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, int index, Ty &value)
+	{
+		value = static_cast<Ty>(refl->GetRepeatedEnumValue(msg, field, index));
+	}
+};
+
+// nested struct member.
+template<typename Ty>
+struct Member<Ty, typename std::enable_if<detail::IsStruct<Ty>::value>::type>
+{
+	static bool check(const FieldDescriptor *field,
+		std::vector<const Descriptor*> &visiting)
+	{
+		return !field->is_repeated() && check_element(field, visiting);
+	}
+	static bool check_element(const FieldDescriptor *field,
+		std::vector<const Descriptor*> &visiting)
+	{
+		return field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE &&
+			CheckStruct<Ty>(field->message_type(), visiting);
+	}
+	static void set(Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, const Ty &value)
+	{
+		ToProto(value, *refl->MutableMessage(&msg, field));
+	}
+	static void get(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, Ty &value)
+	{
+		FromProto(refl->GetMessage(msg, field), value);
+	}
+	static void add(Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, const Ty &value)
+	{
+		ToProto(value, *refl->AddMessage(&msg, field));
+	}
+	static void get(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, int index, Ty &value)
+	{
+		FromProto(refl->GetRepeatedMessage(msg, field, index), value);
+	}
+};
+
+// get RepeatedField of arithmetic field, to copy elements in bulk.
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable: 4996)
+#else
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+
+// repeated field.
+template<typename Ty>
+struct Member<std::vector<Ty>>
+{
+	static bool check(const FieldDescriptor *field,
+		std::vector<const Descriptor*> &visiting)
+	{
+		return field->is_repeated() && !field->is_map() &&
+			Member<Ty>::check_element(field, visiting);
+	}
+	static void set(Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, const std::vector<Ty> &values)
+	{
+		set(msg, refl, field, values, std::is_arithmetic<Ty>());
+	}
+	static void get(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, std::vector<Ty> &values)
+	{
+		get(msg, refl, field, values, std::is_arithmetic<Ty>());
+	}
+private:
+	// the arithmetic elements are copied in bulk.
+	static void set(Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, const std::vector<Ty> &values,
+		std::true_type)
+	{
+		refl->MutableRepeatedField<Ty>(&msg, field)->Add(values.begin(),
+			values.end());
+	}
+	static void set(Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, const std::vector<Ty> &values,
+		std::false_type)
+	{
+		for (auto &value : values) {
+			Member<Ty>::add(msg, refl, field, value);
+		}
+	}
+	static void get(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, std::vector<Ty> &values, std::true_type)
+	{
+		auto &repeated = refl->GetRepeatedField<Ty>(msg, field);
+		values.insert(values.end(), repeated.begin(), repeated.end());
+	}
+	static void get(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, std::vector<Ty> &values, std::false_type)
+	{
+		int count = refl->FieldSize(msg, field);
+		size_t base = values.size();
+		values.resize(base + count);
+		for (int i = 0; i < count; ++i) {
+			Member<Ty>::get(msg, refl, field, i, values[base + i]);
+		}
+	}
+};
+
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#else
+#pragma GCC diagnostic pop
+#endif
+
+// repeated bool, std::vector<bool> is specialized.
+template<>
+struct Member<std::vector<bool>>
+{
+	static bool check(const FieldDescriptor *field,
+		std::vector<const Descriptor*> &visiting)
+	{
+		return field->is_repeated() &&
+			Member<bool>::check_element(field, visiting);
+	}
+	static void set(Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, const std::vector<bool> &values)
+	{
+		for (bool value : values) {
+			refl->AddBool(&msg, field, value);
+		}
+	}
+	static void get(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, std::vector<bool> &values)
+	{
+		int count = refl->FieldSize(msg, field);
+		values.reserve(values.size() + count);
+		for (int i = 0; i < count; ++i) {
+			values.push_back(refl->GetRepeatedBool(msg, field, i));
+		}
+	}
+};
+
+// map field, a repeated entry message with key and value. the container of
+// pairs is Map.
+template<typename Map, typename Key, typename Value>
+struct MapMember
+{
+	static bool check(const FieldDescriptor *field,
+		std::vector<const Descriptor*> &visiting)
+	{
+		if (!field->is_map()) {
+			return false;
+		}
+		auto entry = field->message_type();
+		return Member<Key>::check(entry->map_key(), visiting) &&
+			Member<Value>::check(entry->map_value(), visiting);
+	}
+	static void set(Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, const Map &values)
+	{
+		auto entry = field->message_type();
+		auto key = entry->map_key();
+		auto value = entry->map_value();
+		for (auto &pair : values) {
+			auto submsg = refl->AddMessage(&msg, field);
+			auto subrefl = submsg->GetReflection();
+			Member<Key>::set(*submsg, subrefl, key, pair.first);
+			Member<Value>::set(*submsg, subrefl, value, pair.second);
+		}
+	}
+	// call func(key, value) for each entry of map field.
+	template<typename Func>
+	static void get(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, Func &&func)
+	{
+		auto entry = field->message_type();
+		auto key_field = entry->map_key();
+		auto value_field = entry->map_value();
+		int count = refl->FieldSize(msg, field);
+		for (int i = 0; i < count; ++i) {
+			auto &submsg = refl->GetRepeatedMessage(msg, field, i);
+			auto subrefl = submsg.GetReflection();
+			Key key;
+			Member<Key>::get(submsg, subrefl, key_field, key);
+			auto &value = func(std::move(key));
+			Member<Value>::get(submsg, subrefl, value_field, value);
+		}
+	}
+};
+
+template<typename Key, typename Value>
+struct Member<std::map<Key, Value>>
+	: MapMember<std::map<Key, Value>, Key, Value>
+{
+	static void get(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, std::map<Key, Value> &values)
+	{
+		MapMember<std::map<Key, Value>, Key, Value>::get(msg, refl, field,
+			[&](Key &&key) -> Value& {
+				// the last value wins for duplicate keys, same as protobuf.
+				auto &value = values[std::move(key)];
+				value = Value();
+				return value;
+			});
+	}
+};
+
+// map field as hash map, the buckets are reserved for all entries.
+template<typename Key, typename Value>
+struct Member<std::unordered_map<Key, Value>>
+	: MapMember<std::unordered_map<Key, Value>, Key, Value>
+{
+	static void get(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, std::unordered_map<Key, Value> &values)
+	{
+		values.reserve(values.size() + refl->FieldSize(msg, field));
+		MapMember<std::unordered_map<Key, Value>, Key, Value>::get(msg, refl,
+			field, [&](Key &&key) -> Value& {
+				// the last value wins for duplicate keys, same as protobuf.
+				auto &value = values[std::move(key)];
+				value = Value();
+				return value;
+			});
+	}
+};
+
+// map field as vector of pairs sorted by key, the entries are appended in one
+// pass and sorted once.
+template<typename Key, typename Value>
+struct Member<std::vector<std::pair<Key, Value>>>
+	: MapMember<std::vector<std::pair<Key, Value>>, Key, Value>
+{
+	typedef std::vector<std::pair<Key, Value>> Pairs;
+	static void get(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field, Pairs &values)
+	{
+		values.reserve(values.size() + refl->FieldSize(msg, field));
+		MapMember<Pairs, Key, Value>::get(msg, refl, field,
+			[&](Key &&key) -> Value& {
+				values.emplace_back(std::move(key), Value());
+				return values.back().second;
+			});
+		std::stable_sort(values.begin(), values.end(),
+			[](const std::pair<Key, Value> &a, const std::pair<Key, Value> &b) {
+				return a.first < b.first;
+			});
+		// the last value wins for duplicate keys, same as protobuf.
+		auto last = values.begin();
+		for (auto iter = values.begin(); iter != values.end(); ++iter) {
+			auto next = iter + 1;
+			if (next != values.end() && !(iter->first < next->first)) {
+				continue;
+			}
+			if (last != iter) {
+				*last = std::move(*iter);
+			}
+			++last;
+		}
+		values.erase(last, values.end());
+	}
+};
+
+// @brief Check the members of STRUCT are matched to the fields of PROTO, the
+// result is cached.
+template<typename STRUCT, typename PROTO>
+inline bool Matched()
+{
+	static const bool matched = [] {
+		std::vector<const Descriptor*> visiting;
+		return CheckStruct<STRUCT>(PROTO::descriptor(), visiting);
+	}();
+	return matched;
+}
+
+// @brief Convert aggregate struct to protobuf message, the members are
+// enumerated at compile time.
+// @return false if the members are not matched to the fields of message.
+template<typename STRUCT, typename PROTO>
+bool StructToProto(const STRUCT &in, PROTO &out)
+{
+	static_assert(std::is_base_of<Message, PROTO>::value,
+		"PROTO should be protobuf message");
+	static_assert(detail::IsStruct<STRUCT>::value,
+		"STRUCT should be aggregate struct");
+	static_assert(detail::MemberCount<STRUCT>::value <= kMaxMembers,
+		"too many members of struct");
+	if (!Matched<STRUCT, PROTO>()) {
+		return false;
+	}
+	ToProto(in, out);
+	return true;
+}
+
+// @brief Convert protobuf message to aggregate struct, the members are
+// enumerated at compile time. The struct should be newly constructed.
+// @return false if the members are not matched to the fields of message.
+template<typename PROTO, typename STRUCT>
+bool ProtoToStruct(const PROTO &in, STRUCT &out)
+{
+	static_assert(std::is_base_of<Message, PROTO>::value,
+		"PROTO should be protobuf message");
+	static_assert(detail::IsStruct<STRUCT>::value,
+		"STRUCT should be aggregate struct");
+	static_assert(detail::MemberCount<STRUCT>::value <= kMaxMembers,
+		"too many members of struct");
+	if (!Matched<STRUCT, PROTO>()) {
+		return false;
+	}
+	FromProto(in, out);
+	return true;
+}
+
+} // namespace aggregate
+
+} // namespace cps
+
+#endif // C++17
+
+#endif // _CONVERT_AGGREGATE_INC_
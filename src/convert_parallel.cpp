@@ -0,0 +1,139 @@
+#include "convert_parallel.h"
+
+#include <algorithm>
+
+namespace cps
+{
+
+// ==================== work stealing thread pool ====================
+
+// a running parallel_for, the range is split to a part per thread.
+struct ThreadPool::Job
+{
+	// the part of range owned by a thread, aligned to avoid false sharing.
+	struct alignas(64) Part
+	{
+		std::atomic<size_t> next; // the first element not taken
+		size_t end; // end of the part
+	};
+	const Task &task;
+	size_t grain;
+	size_t count; // count of parts
+	// new is not aligned for Part before c++17, the parts are aligned in
+	// the storage by hand.
+	std::unique_ptr<uint8_t[]> storage;
+	Part *parts;
+	size_t pending; // workers not finished, guarded by pool mutex
+
+	Job(size_t elements, size_t grain, size_t count, const Task &task)
+		: task(task), grain(grain), count(count)
+		, storage(new uint8_t[(count + 1) * sizeof(Part)]), pending(0)
+	{
+		auto address = reinterpret_cast<uintptr_t>(storage.get());
+		address = (address + alignof(Part) - 1) / alignof(Part) *
+			alignof(Part);
+		parts = reinterpret_cast<Part*>(address);
+		for (size_t i = 0; i < count; ++i) {
+			new(parts + i) Part;
+			parts[i].next = elements * i / count;
+			parts[i].end = elements * (i + 1) / count;
+		}
+	}
+
+	// take chunks from own part, then steal from others.
+	void run(size_t index)
+	{
+		for (size_t i = 0; i < count; ++i) {
+			auto &part = parts[(index + i) % count];
+			while (true) {
+				size_t begin = part.next.fetch_add(grain);
+				if (begin >= part.end) {
+					break;
+				}
+				task(begin, std::min(begin + grain, part.end));
+			}
+		}
+	}
+};
+
+ThreadPool::ThreadPool(size_t threads)
+	: _job(nullptr), _generation(0), _stop(false)
+{
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	// the caller runs a part too.
+	for (size_t i = 1; i < threads; ++i) {
+		_threads.emplace_back(&ThreadPool::work, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+	for (auto &thread : _threads) {
+		thread.join();
+	}
+}
+
+void ThreadPool::work(size_t index)
+{
+	uint64_t generation = 0;
+	while (true) {
+		Job *job = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [&] {
+				return _stop || _generation != generation;
+			});
+			if (_stop) {
+				return;
+			}
+			generation = _generation;
+			job = _job;
+		}
+		job->run(index);
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (--job->pending == 0) {
+			_done.notify_all();
+		}
+	}
+}
+
+void ThreadPool::parallel_for(size_t count, size_t grain, const Task &task)
+{
+	if (grain == 0) {
+		grain = 1;
+	}
+	if (_threads.empty() || count <= grain) {
+		if (count != 0) {
+			task(0, count);
+		}
+		return;
+	}
+	std::lock_guard<std::mutex> run(_run);
+	Job job(count, grain, concurrency(), task);
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		job.pending = _threads.size();
+		_job = &job;
+		++_generation;
+	}
+	_wake.notify_all();
+	job.run(0);
+	std::unique_lock<std::mutex> lock(_mutex);
+	_done.wait(lock, [&] { return job.pending == 0; });
+	_job = nullptr;
+}
+
+ThreadPool &ThreadPool::Default()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+} // namespace cps
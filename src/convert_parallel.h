@@ -0,0 +1,136 @@
+// Copyright 2021 genrwoody@163.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _CONVERT_PARALLEL_INC_
+#define _CONVERT_PARALLEL_INC_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "convert_proto_struct.h"
+
+namespace cps
+{
+
+// a pool runs the chunks of a range concurrently.
+class TaskPool
+{
+public:
+	// convert elements in [begin, end).
+	typedef std::function<void(size_t begin, size_t end)> Task;
+
+	virtual ~TaskPool() {}
+
+	// @brief Run task on [0, count) split by chunks of grain elements, and
+	// wait for all chunks done. The calling thread runs chunks too.
+	// @param[in] count: count of elements
+	// @param[in] grain: count of elements in a chunk
+	// @param[in] task: the task, called concurrently with disjoint ranges
+	virtual void parallel_for(size_t count, size_t grain, const Task &task) = 0;
+};
+
+// the built-in work stealing thread pool. every thread owns a part of the
+// range, and steals chunks from others when its own part is done.
+class ThreadPool : public TaskPool
+{
+private:
+	struct Job;
+	std::vector<std::thread> _threads; // worker threads
+	std::mutex _run; // only one parallel_for runs at a time
+	std::mutex _mutex; // guards the fields below
+	std::condition_variable _wake; // a job is posted or stopped
+	std::condition_variable _done; // all workers finish the job
+	Job *_job; // the running job
+	uint64_t _generation; // increased for every job
+	bool _stop;
+public:
+	// @param[in] threads: count of threads include the caller, 0 for the
+	// count of hardware threads.
+	explicit ThreadPool(size_t threads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool &operator=(const ThreadPool&) = delete;
+
+	void parallel_for(size_t count, size_t grain, const Task &task) override;
+
+	// count of threads include the caller.
+	inline size_t concurrency() const { return _threads.size() + 1; }
+
+	// the shared pool with a thread per hardware thread, created at the
+	// first time.
+	static ThreadPool &Default();
+private:
+	void work(size_t index);
+};
+
+// options of parallel conversion. the repeated message field with not less
+// than threshold elements is converted in chunks concurrently.
+struct Parallel
+{
+	TaskPool *pool; // the pool, or null for ThreadPool::Default()
+	size_t threshold; // min count of elements to convert concurrently
+	size_t grain; // count of elements in a chunk
+	explicit Parallel(TaskPool *pool = nullptr, size_t threshold = 4096,
+		size_t grain = 256)
+		: pool(pool), threshold(threshold), grain(grain) {}
+};
+
+// @brief Convert struct to protobuf message, the large repeated message
+// fields are converted concurrently.
+// @param[in] plan: plan compiled from descriptor of msg
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[out] msg: protobuf message
+// @param[in] parallel: options of parallel conversion
+// @return true for success, or false for failed.
+bool StructToProto(const Plan &plan, const void *bytes, size_t size,
+	Message &msg, const Parallel &parallel);
+
+// @brief Convert protobuf message to struct, the large repeated message
+// fields are converted concurrently.
+// @param[in] plan: plan compiled from descriptor of msg
+// @param[in] msg: protobuf message
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[in] parallel: options of parallel conversion
+// @return true for success, or false for failed.
+bool ProtoToStruct(const Plan &plan, const Message &msg,
+	void *bytes, size_t size, const Parallel &parallel);
+
+// @brief Convert struct to protobuf message concurrently.
+template<typename STRUCT, typename PROTO>
+bool StructToProto(const STRUCT &in, PROTO &out, const Parallel &parallel)
+{
+	return StructToProto(CompilePlan(PROTO::descriptor()), &in,
+		sizeof(STRUCT), out, parallel);
+}
+
+// @brief Convert protobuf message to struct concurrently.
+template<typename PROTO, typename STRUCT>
+bool ProtoToStruct(const PROTO &in, STRUCT &out, const Parallel &parallel)
+{
+	return ProtoToStruct(CompilePlan(PROTO::descriptor()), in, &out,
+		sizeof(STRUCT), parallel);
+}
+
+} // namespace cps
+
+#endif // _CONVERT_PARALLEL_INC_
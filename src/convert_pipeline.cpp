@@ -0,0 +1,68 @@
+#include "convert_pipeline.h"
+
+#include <algorithm>
+
+namespace cps
+{
+
+// ==================== workers of pipeline ====================
+
+void PipelineBase::start(size_t threads)
+{
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (size_t i = 0; i < threads; ++i) {
+		_threads.emplace_back(&PipelineBase::run, this);
+	}
+}
+
+void PipelineBase::finish()
+{
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+	for (auto &thread : _threads) {
+		thread.join();
+	}
+	_threads.clear();
+}
+
+void PipelineBase::run()
+{
+	while (true) {
+		if (work()) {
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(_mutex);
+		// counted before checked, so the pushing one either sees the
+		// sleeping worker, or is seen by it.
+		_sleeping.fetch_add(1);
+		_wake.wait(lock, [this]() { return _stop || pending(); });
+		_sleeping.fetch_sub(1);
+		if (_stop && !pending()) {
+			return;
+		}
+	}
+}
+
+void PipelineBase::wait_space()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_blocked.fetch_add(1);
+	_space.wait(lock, [this]() { return !full(); });
+	_blocked.fetch_sub(1);
+}
+
+void PipelineBase::wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_blocked.fetch_add(1);
+	_space.wait(lock, [this]() { return idle(); });
+	_blocked.fetch_sub(1);
+}
+
+} // namespace cps
@@ -0,0 +1,344 @@
+// Copyright 2021 genrwoody@163.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _CONVERT_PIPELINE_INC_
+#define _CONVERT_PIPELINE_INC_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "convert_proto_struct.h"
+
+namespace cps
+{
+
+// options of pipeline.
+struct PipelineOptions
+{
+	size_t threads; // count of worker threads, 0 for the hardware threads
+	size_t capacity; // max count of items not delivered, a power of 2
+	size_t batch; // max count of items taken by a worker at a time
+	explicit PipelineOptions(size_t threads = 0, size_t capacity = 1024,
+		size_t batch = 16)
+		: threads(threads), capacity(capacity), batch(batch) {}
+};
+
+// the worker threads of pipeline, and the waiting of workers and producers.
+// the queue is implemented by the derived class.
+class PipelineBase
+{
+private:
+	std::vector<std::thread> _threads;
+	std::mutex _mutex; // guards the waiting only, never the queue
+	std::condition_variable _wake; // an item is pushed, or stopped
+	std::condition_variable _space; // items are delivered
+	std::atomic<size_t> _sleeping; // count of workers waiting for items
+	std::atomic<size_t> _blocked; // count of threads waiting for delivery
+	bool _stop;
+protected:
+	PipelineBase() : _sleeping(0), _blocked(0), _stop(false) {}
+	virtual ~PipelineBase() {}
+
+	// start the workers, called by the constructor of derived class.
+	void start(size_t threads);
+
+	// wait for all items delivered, and stop the workers. called by the
+	// destructor of derived class.
+	void finish();
+
+	// convert a batch of items and deliver the finished ones.
+	// @return false if no item to convert.
+	virtual bool work() = 0;
+
+	// there is item to convert.
+	virtual bool pending() const = 0;
+
+	// the queue is full.
+	virtual bool full() const = 0;
+
+	// all items pushed are delivered.
+	virtual bool idle() const = 0;
+
+	// wake a worker after an item is pushed.
+	inline void notify_pushed()
+	{
+		if (_sleeping.load() != 0) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			_wake.notify_one();
+		}
+	}
+
+	// wake the producers and waiters after items are delivered.
+	inline void notify_delivered()
+	{
+		if (_blocked.load() != 0) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			_space.notify_all();
+		}
+	}
+
+	// block the producer until the queue is not full.
+	void wait_space();
+public:
+	// @brief Block until all items pushed are delivered.
+	void wait();
+private:
+	void run();
+};
+
+// @brief Pipeline converts the items pushed on the worker threads, and
+// delivers the results in order of push. The items are kept in a bounded
+// lock-free ring, the producers never wait for a lock, and get back-pressure
+// when the ring is full: try_push() fails, and push() blocks.
+template<typename IN, typename OUT>
+class Pipeline : public PipelineBase
+{
+public:
+	// convert in to out, called by the workers concurrently, out is newly
+	// constructed.
+	typedef std::function<bool(IN &in, OUT &out)> Convert;
+	// receive the result in order of push, called by one worker at a time.
+	// in and out can be moved away.
+	typedef std::function<void(IN &in, OUT &out, bool result)> Complete;
+private:
+	// the state of cell is its sequence, for the position pos:
+	// pos: empty, pos + 1: pushed, pos + 2: converted,
+	// pos + capacity: delivered, empty for the next round.
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		IN in;
+		OUT out;
+		bool result;
+	};
+	Convert _convert;
+	Complete _complete;
+	size_t _batch;
+	size_t _mask; // capacity - 1
+	std::unique_ptr<Cell[]> _cells;
+	alignas(64) std::atomic<size_t> _tail; // next position to push
+	alignas(64) std::atomic<size_t> _head; // next position to convert
+	alignas(64) std::atomic<size_t> _next; // next position to deliver
+	std::atomic<bool> _delivering; // a worker is delivering
+public:
+	// @param[in] convert: the converter
+	// @param[in] complete: the receiver of results
+	// @param[in] options: options of pipeline
+	Pipeline(Convert convert, Complete complete,
+		const PipelineOptions &options = PipelineOptions())
+		: _convert(std::move(convert)), _complete(std::move(complete))
+		, _batch(options.batch != 0 ? options.batch : 1)
+		, _tail(0), _head(0), _next(0), _delivering(false)
+	{
+		// the states of cell are different only with 4 cells at least.
+		size_t capacity = 4;
+		while (capacity < options.capacity) {
+			capacity *= 2;
+		}
+		_mask = capacity - 1;
+		_cells.reset(new Cell[capacity]);
+		for (size_t i = 0; i < capacity; ++i) {
+			_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		start(options.threads);
+	}
+
+	~Pipeline() { finish(); }
+
+	Pipeline(const Pipeline&) = delete;
+	Pipeline &operator=(const Pipeline&) = delete;
+
+	// @brief Push an item without blocking.
+	// @param[in,out] in: the item, moved only if pushed
+	// @return true for pushed, or false if the pipeline is full.
+	bool try_push(IN &in)
+	{
+		size_t pos = _tail.load(std::memory_order_relaxed);
+		while (true) {
+			auto &cell = _cells[pos & _mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			auto diff = static_cast<intptr_t>(sequence - pos);
+			if (diff == 0) {
+				if (_tail.compare_exchange_weak(pos, pos + 1,
+					std::memory_order_relaxed)) {
+					cell.in = std::move(in);
+					cell.sequence.store(pos + 1);
+					notify_pushed();
+					return true;
+				}
+			} else if (diff < 0) {
+				return false; // the cell of last round is not delivered
+			} else {
+				pos = _tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// @brief Push an item, block while the pipeline is full.
+	// @param[in,out] in: the item, moved
+	void push(IN &in)
+	{
+		while (!try_push(in)) {
+			wait_space();
+		}
+	}
+
+	// @brief Push an item, block while the pipeline is full.
+	void push(IN &&in)
+	{
+		push(in);
+	}
+protected:
+	bool work() override
+	{
+		// take the adjacent pushed items.
+		size_t pos = _head.load(std::memory_order_relaxed);
+		size_t count = 0;
+		while (true) {
+			count = 0;
+			while (count < _batch && _cells[(pos + count) & _mask].sequence
+				.load(std::memory_order_acquire) == pos + count + 1) {
+				++count;
+			}
+			if (count == 0) {
+				size_t head = _head.load(std::memory_order_relaxed);
+				if (head == pos) {
+					return false;
+				}
+				pos = head;
+			} else if (_head.compare_exchange_weak(pos, pos + count,
+				std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		for (size_t i = 0; i < count; ++i) {
+			auto &cell = _cells[(pos + i) & _mask];
+			cell.result = _convert(cell.in, cell.out);
+			cell.sequence.store(pos + i + 2);
+		}
+		deliver();
+		return true;
+	}
+
+	bool pending() const override
+	{
+		size_t pos = _head.load();
+		return _cells[pos & _mask].sequence.load() == pos + 1;
+	}
+
+	bool full() const override
+	{
+		size_t pos = _tail.load();
+		return static_cast<intptr_t>(
+			_cells[pos & _mask].sequence.load() - pos) < 0;
+	}
+
+	bool idle() const override
+	{
+		return _next.load() == _tail.load();
+	}
+private:
+	// deliver the converted items in order, by one worker at a time.
+	void deliver()
+	{
+		while (true) {
+			bool expected = false;
+			if (!_delivering.compare_exchange_strong(expected, true)) {
+				return; // the delivering one checks again after
+			}
+			size_t next = _next.load(std::memory_order_relaxed);
+			size_t count = 0;
+			while (true) {
+				auto &cell = _cells[next & _mask];
+				if (cell.sequence.load(std::memory_order_acquire) !=
+					next + 2) {
+					break;
+				}
+				_complete(cell.in, cell.out, cell.result);
+				cell.in = IN();
+				cell.out = OUT();
+				cell.sequence.store(next + _mask + 1);
+				++next;
+				++count;
+			}
+			_next.store(next);
+			_delivering.store(false);
+			if (count != 0) {
+				notify_delivered();
+			}
+			// the item converted after checked is delivered by this one.
+			if (_cells[next & _mask].sequence.load() != next + 2) {
+				return;
+			}
+		}
+	}
+};
+
+// @brief Pipeline converts protobuf messages to structs.
+template<typename PROTO, typename STRUCT>
+class ProtoToStructPipeline : public Pipeline<PROTO, STRUCT>
+{
+public:
+	// @param[in] complete: the receiver of structs in order of push
+	// @param[in] options: options of pipeline
+	explicit ProtoToStructPipeline(
+		typename Pipeline<PROTO, STRUCT>::Complete complete,
+		const PipelineOptions &options = PipelineOptions())
+		: Pipeline<PROTO, STRUCT>(Converter(), std::move(complete), options)
+	{
+	}
+private:
+	static typename Pipeline<PROTO, STRUCT>::Convert Converter()
+	{
+		auto &plan = CompilePlan(PROTO::descriptor());
+		return [&plan](PROTO &in, STRUCT &out) {
+			return ProtoToStruct(plan, in, &out, sizeof(STRUCT));
+		};
+	}
+};
+
+// @brief Pipeline converts structs to protobuf messages.
+template<typename STRUCT, typename PROTO>
+class StructToProtoPipeline : public Pipeline<STRUCT, PROTO>
+{
+public:
+	// @param[in] complete: the receiver of messages in order of push
+	// @param[in] options: options of pipeline
+	explicit StructToProtoPipeline(
+		typename Pipeline<STRUCT, PROTO>::Complete complete,
+		const PipelineOptions &options = PipelineOptions())
+		: Pipeline<STRUCT, PROTO>(Converter(), std::move(complete), options)
+	{
+	}
+private:
+	static typename Pipeline<STRUCT, PROTO>::Convert Converter()
+	{
+		auto &plan = CompilePlan(PROTO::descriptor());
+		return [&plan](STRUCT &in, PROTO &out) {
+			return StructToProto(plan, &in, sizeof(STRUCT), out);
+		};
+	}
+};
+
+} // namespace cps
+
+#endif // _CONVERT_PIPELINE_INC_
@@ -0,0 +1,695 @@
+// Copyright 2021 genrwoody@163.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal header, the struct layout and compiled conversion plan.
+
+#ifndef _CONVERT_PLAN_INC_
+#define _CONVERT_PLAN_INC_
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <google/protobuf/field_mask.pb.h>
+#include <google/protobuf/message.h>
+
+#include "convert_proto_struct.h"
+#include "convert_stats.h"
+
+namespace cps
+{
+
+using google::protobuf::Descriptor;
+using google::protobuf::FieldMask;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::Reflection;
+
+typedef std::vector<uint8_t> Vector;
+typedef std::map<uint8_t, uint8_t> Map;
+
+#ifdef CPS_MEMORY_RESOURCE
+typedef std::pmr::memory_resource MemoryResource;
+#else
+class MemoryResource; // never used before c++17
+#endif
+
+// the containers of struct, which decide the layout of members.
+enum Containers
+{
+	CONTAINERS_STD,  // std::vector, std::map and std::string
+	CONTAINERS_PMR,  // std::pmr::vector, std::pmr::map and std::pmr::string
+	CONTAINERS_VIEW, // std::vector, std::map and std::string_view
+	CONTAINERS_COUNT,
+};
+
+// the containers of struct declared with std.
+struct StdContainers
+{
+	typedef std::string String;
+	template<typename Ty>
+	using Vector = std::vector<Ty>;
+	template<typename Key, typename Value>
+	using Map = std::map<Key, Value>;
+	template<typename Key, typename Value, typename Hash = std::hash<Key>>
+	using HashMap = std::unordered_map<Key, Value, Hash>;
+	// the strings can be moved from or to protobuf message.
+	static const bool movable = true;
+	// construct the empty container in place, resource is not used.
+	template<typename Ty>
+	static inline Ty *New(void *data, MemoryResource*)
+	{
+		return new(data) Ty;
+	}
+	// copy string of protobuf to struct.
+	static inline void Assign(String &value, const std::string &source)
+	{
+		value = source;
+	}
+};
+
+#ifdef CPS_MEMORY_RESOURCE
+// the containers of struct declared with std::pmr.
+struct PmrContainers
+{
+	typedef std::pmr::string String;
+	template<typename Ty>
+	using Vector = std::pmr::vector<Ty>;
+	template<typename Key, typename Value>
+	using Map = std::pmr::map<Key, Value>;
+	template<typename Key, typename Value, typename Hash = std::hash<Key>>
+	using HashMap = std::pmr::unordered_map<Key, Value, Hash>;
+	// the allocator is different from protobuf, the strings are copied.
+	static const bool movable = false;
+	// construct the empty container in place, allocated from resource, or
+	// the default resource if null.
+	template<typename Ty>
+	static inline Ty *New(void *data, MemoryResource *resource)
+	{
+		return new(data) Ty(resource != nullptr ? resource
+			: std::pmr::get_default_resource());
+	}
+	// copy string of protobuf to struct, allocated from its resource.
+	static inline void Assign(String &value, const std::string &source)
+	{
+		value.assign(source.data(), source.size());
+	}
+};
+#else
+// never used before c++17, the plan is always compiled for std.
+typedef StdContainers PmrContainers;
+#endif
+
+#ifdef CPS_STRING_VIEW
+// the containers of struct declared with std::string_view, which views the
+// strings of source, and never copy them.
+struct ViewContainers
+{
+	typedef std::string_view String;
+	template<typename Ty>
+	using Vector = std::vector<Ty>;
+	template<typename Key, typename Value>
+	using Map = std::map<Key, Value>;
+	template<typename Key, typename Value, typename Hash = std::hash<Key>>
+	using HashMap = std::unordered_map<Key, Value, Hash>;
+	// the strings are viewed, never moved.
+	static const bool movable = false;
+	// construct the empty container in place, resource is not used.
+	template<typename Ty>
+	static inline Ty *New(void *data, MemoryResource*)
+	{
+		return new(data) Ty;
+	}
+	// view string of protobuf, source should outlive the struct.
+	static inline void Assign(String &value, const std::string &source)
+	{
+		value = source;
+	}
+};
+#else
+// never used before c++17, the plan is always compiled for std.
+typedef StdContainers ViewContainers;
+#endif
+
+// for protobuf enum, different from int
+struct Enum
+{
+	int value;
+	Enum() : value(0) {}
+	Enum(int v) : value(v) {}
+	operator int() const { return value; }
+};
+
+// calculate and storage the struct size and alignment.
+class StructInfo
+{
+protected:
+	int _size;  // sizeof(struct)
+	int _align; // alignof(struct)
+public:
+	StructInfo(int size = 0, int align = 0)
+		: _size(size), _align(align) {}
+	// get size;
+	inline int size() const { return _size; }
+	// get alignment
+	inline int align() const { return _align; }
+protected:
+	// append member, for calculate struct size and align.
+	// @return offset of the member.
+	inline int append(const StructInfo &info)
+	{
+		if (_align < info._align) {
+			_align = info._align;
+		}
+		int offset = (_size + info._align - 1) / info._align * info._align;
+		_size = offset + info._size;
+		return offset;
+	}
+	// append member, for calculate struct size and align.
+	template<typename Ty>
+	inline int append()
+	{
+		return append(StructInfo{ sizeof(Ty), alignof(Ty) });
+	}
+};
+
+class StructReader;
+class StructWriter;
+
+// an operation of plan, convert one struct member from or to protobuf field.
+struct Op
+{
+	// how the member is converted.
+	enum Kind
+	{
+		KIND_VALUE,            // fundamental type or string
+		KIND_REPEATED,         // std::vector of fundamental type or string
+		KIND_MESSAGE,          // struct
+		KIND_REPEATED_MESSAGE, // std::vector of struct
+		KIND_MAP,              // map container, by layout of maps
+	};
+	const FieldDescriptor *field; // protobuf field
+	FieldDescriptor::Type type; // cached field->type()
+	FieldDescriptor::CppType cpp_type; // cached field->cpp_type()
+	int number; // cached field->number()
+	bool presence; // cached field->has_presence()
+	bool packed; // cached field->is_packed()
+	const Plan *plan; // plan of message or map entry, or null
+	int offset; // offset of member in struct
+	int size;   // sizeof member
+	int align;  // alignof member
+	Kind kind;  // converter kind
+	Containers containers; // containers of struct
+	MapLayout maps; // container of map member
+	// convert struct member to protobuf field.
+	bool (StructReader::*to_proto)(const Op &op);
+	// convert protobuf field to struct member.
+	bool (StructWriter::*from_proto)(const Op &op);
+	// map only, find or insert key (pointer to Key) into std::map or
+	// std::unordered_map, the value of inserted pair is zero filled but not
+	// constructed. the key is moved into map. null if the value is too
+	// large, the node is allocated with the size of the pair of op by
+	// CPS_MAP_NODES, any size of value is supported then.
+	// @param[in] op: the map member
+	// @return pointer to std::pair<const Key, Value>.
+	uint8_t *(*emplace)(const Op &op, void *map, void *key, bool &inserted);
+	// map only, erase key (pointer to Key) from std::map or
+	// std::unordered_map, the value of pair should be destroyed before.
+	void (*erase)(const Op &op, void *map, const void *key);
+	// map only, destroy std::map or std::unordered_map, the values should be
+	// destroyed before.
+	void (*destroy)(const Op &op, void *map);
+	// std::unordered_map only, find key (pointer to Key).
+	// @return pointer to std::pair<const Key, Value>, or null if not found.
+	const uint8_t *(*find)(const void *map, const void *key);
+	// std::unordered_map only, reserve buckets for count pairs.
+	void (*reserve)(void *map, size_t count);
+	// sorted vector only, sort the keys of count pairs in data, the values
+	// are not moved. order[i] is the original index of the i-th key.
+	// @return false if the keys are duplicated.
+	bool (*sort)(uint8_t *data, size_t count, size_t step,
+		std::vector<size_t> &order);
+};
+
+// the compiled conversion plan of struct, calculated from protobuf message
+// descriptor once, and cached for the whole process.
+class Plan : public StructInfo
+{
+public:
+	// a range of adjacent fundamental members, include the padding between.
+	struct Run
+	{
+		int offset; // offset of the first member
+		int size;   // size to the end of the last member
+	};
+private:
+	const Descriptor *_desc; // protobuf message descriptor
+	Containers _containers; // containers of struct
+	MapLayout _maps; // container of map members
+	std::vector<Op> _ops; // one op per field, in order of declaration
+	std::vector<const Op*> _numbers; // ops sorted by field number
+	std::vector<const Op*> _index; // ops indexed by field number, if dense
+	std::vector<uint8_t> _defaults; // default fundamental members, by layout
+	std::vector<Run> _runs; // ranges of fundamental members in _defaults
+	std::vector<const Op*> _composites; // string and struct members
+public:
+	// get the cached plan of message, compile it at first time.
+	// thread safe.
+	// @param[in] containers: the containers of struct
+	// @param[in] maps: the container of map members
+	static const Plan &Get(const Descriptor *desc,
+		Containers containers = CONTAINERS_STD, MapLayout maps = MAP_TREE);
+	// get protobuf message descriptor.
+	inline const Descriptor *descriptor() const { return _desc; }
+	// get containers of struct.
+	inline Containers containers() const { return _containers; }
+	// get container of map members.
+	inline MapLayout maps() const { return _maps; }
+	// get all operations, in order of declaration.
+	inline const std::vector<Op> &ops() const { return _ops; }
+	// get all operations, in order of field number.
+	inline const std::vector<const Op*> &numbers() const { return _numbers; }
+	// get default values of fundamental members, in layout of struct.
+	inline const uint8_t *defaults() const { return _defaults.data(); }
+	// get ranges of fundamental members, copied from defaults() in bulk.
+	inline const std::vector<Run> &runs() const { return _runs; }
+	// get string and struct members, which are defaulted one by one.
+	inline const std::vector<const Op*> &composites() const
+	{
+		return _composites;
+	}
+	// find operation by field number.
+	// @return the operation, or null if not found.
+	inline const Op *find(int number) const
+	{
+		if (!_index.empty()) {
+			return number >= 0 && number < static_cast<int>(_index.size())
+				? _index[number] : nullptr;
+		}
+		return find_sorted(number);
+	}
+private:
+	const Op *find_sorted(int number) const;
+	// build the indexes by field number.
+	void build_index();
+	// build the default values and ranges of fundamental members.
+	void build_defaults();
+	typedef std::unordered_map<const Descriptor*,
+		std::unique_ptr<Plan>> Cache;
+	// get or compile plan, the cache must be locked.
+	static const Plan &Get(const Descriptor *desc, Containers containers,
+		MapLayout maps, Cache &cache);
+	// calculate layout from protobuf message descriptor, with containers C.
+	template<typename C>
+	void build(const Descriptor *desc, Cache &cache);
+	// append member with layout.
+	template<typename Ty>
+	inline void append(const FieldDescriptor *field, Op::Kind kind)
+	{
+		append(field, kind, StructInfo{ sizeof(Ty), alignof(Ty) }, nullptr);
+	}
+	void append(const FieldDescriptor *field, Op::Kind kind,
+		const StructInfo &info, const Plan *plan);
+	// bind the converter function of op, with containers C.
+	template<typename C>
+	static void bind(Op &op);
+};
+
+// the fields of a plan selected by FieldMask, compiled once and owned by the
+// caller, it is immutable and can be shared between threads.
+class Selection
+{
+private:
+	const Plan &_plan; // plan of struct
+	std::vector<bool> _selected; // by index of op in plan
+	std::vector<const Op*> _ops; // the selected ops, in order of declaration
+	// selected fields of struct members by index of op, null for all fields.
+	std::vector<std::unique_ptr<Selection>> _children;
+public:
+	explicit Selection(const Plan &plan);
+	// compile the selection of mask, the paths are read in place.
+	// @return the selection, or null if a path is invalid.
+	static std::unique_ptr<Selection> Compile(const Descriptor *desc,
+		const FieldMask &mask);
+	// get plan of struct.
+	inline const Plan &plan() const { return _plan; }
+	// get the selected operations, in order of declaration.
+	inline const std::vector<const Op*> &ops() const { return _ops; }
+	// get the selected fields of struct member.
+	// @return the selection, or null if all fields of member are selected.
+	inline const Selection *child(const Op &op) const
+	{
+		return _children[&op - _plan.ops().data()].get();
+	}
+private:
+	// select the field path, the components are separated by '.'.
+	bool add(const std::string &path, size_t begin);
+	// collect the selected operations.
+	void build();
+};
+
+// construct all members of struct in place with default value, on zero
+// filled memory. the std::pmr containers are allocated from resource, or the
+// default resource if null.
+void ConstructStruct(const Plan &plan, uint8_t *bytes,
+	MemoryResource *resource = nullptr);
+
+// construct the member of op in place with default value, on zero filled
+// memory.
+void ConstructMember(const Op &op, uint8_t *bytes,
+	MemoryResource *resource = nullptr);
+
+// destroy all members of struct, include elements of containers.
+void DestroyStruct(const Plan &plan, uint8_t *bytes);
+
+// destroy the member of op, include elements of container.
+void DestroyMember(const Op &op, uint8_t *bytes);
+
+// move construct struct on zero filled memory, from another one which should
+// be destroyed after. the std::unordered_map members are rebuilt, allocated
+// from resource, or the default resource if null.
+void MoveStruct(const Plan &plan, uint8_t *from, uint8_t *to,
+	MemoryResource *resource = nullptr);
+
+// the unit of vector member, which has the alignment of elements.
+template<size_t A>
+struct alignas(A) Unit
+{
+	uint8_t bytes[A];
+};
+
+// the vector member of elements with alignment align, resized as bytes. it
+// is accessed as the vector of units, so the elements are allocated (and
+// deallocated) with their alignment, by the resource of std::pmr too.
+template<typename C>
+class UnitVector
+{
+private:
+	uint8_t *_data; // the vector member
+	size_t _align;
+	template<size_t A>
+	using Units = typename C::template Vector<Unit<A>>;
+	// call func(units), the alignment is never larger than 16.
+	template<typename Func>
+	auto visit(Func &&func) const -> decltype(func(*(Units<1>*)nullptr))
+	{
+		switch (_align) {
+		case 2: return func(*(Units<2>*)_data);
+		case 4: return func(*(Units<4>*)_data);
+		case 8: return func(*(Units<8>*)_data);
+		case 16: return func(*(Units<16>*)_data);
+		default: return func(*(Units<1>*)_data);
+		}
+	}
+	// the functions on units, templated operator() instead of the generic
+	// lambdas of c++14.
+	struct Data
+	{
+		template<typename Ty>
+		uint8_t *operator()(Ty &units) const
+		{
+			return (uint8_t*)units.data();
+		}
+	};
+	struct Size
+	{
+		template<typename Ty>
+		size_t operator()(Ty &units) const
+		{
+			return units.size() * sizeof(units[0]);
+		}
+	};
+	struct Capacity
+	{
+		template<typename Ty>
+		size_t operator()(Ty &units) const
+		{
+			return units.capacity() * sizeof(units[0]);
+		}
+	};
+	struct Resize
+	{
+		size_t size;
+		template<typename Ty>
+		void operator()(Ty &units) const
+		{
+			units.resize(size / sizeof(units[0]));
+		}
+	};
+	struct Clear
+	{
+		template<typename Ty>
+		void operator()(Ty &units) const
+		{
+			units.clear();
+		}
+	};
+	struct Destroy
+	{
+		template<typename Ty>
+		void operator()(Ty &units) const
+		{
+			units.~Ty();
+		}
+	};
+public:
+	UnitVector(uint8_t *data, size_t align) : _data(data), _align(align) {}
+	// get elements as bytes.
+	inline uint8_t *data() const
+	{
+		return visit(Data());
+	}
+	// get size in bytes.
+	inline size_t size() const
+	{
+		return visit(Size());
+	}
+	// get capacity in bytes.
+	inline size_t capacity() const
+	{
+		return visit(Capacity());
+	}
+	// resize to size bytes, a multiple of alignment. the elements are zero
+	// filled, and never moved unless the vector grows.
+	inline void resize(size_t size) const
+	{
+		visit(Resize{ size });
+	}
+	// remove all elements, the destructors are not called.
+	inline void clear() const
+	{
+		visit(Clear());
+	}
+	// call destructor of the vector, the elements are destroyed before.
+	inline void destroy() const
+	{
+		visit(Destroy());
+	}
+};
+
+// the elements of std::vector<uint8_t> member, as bytes.
+struct Bytes
+{
+	uint8_t *data;
+	size_t size;
+};
+
+template<typename C>
+inline Bytes VectorBytes(const uint8_t *data)
+{
+	auto &values = *(typename C::template Vector<uint8_t>*)data;
+	return Bytes{ values.data(), values.size() };
+}
+
+// call func(pair) for each std::pair<const Key, Value> of map member, by the
+// container of op. Ty has the same alignment as the pair.
+// @return false if func returns false.
+template<typename Ty, typename C, typename Func>
+bool ForEachPair(const Op &op, const uint8_t *data, Func &&func)
+{
+	switch (op.maps) {
+	case MAP_HASH:
+		for (auto &pair : *(const typename C::template HashMap<Ty, Ty>*)data) {
+			if (!func((uint8_t*)&pair)) {
+				return false;
+			}
+		}
+		return true;
+	case MAP_SORTED:
+	{
+		auto values = VectorBytes<C>(data);
+		for (size_t i = 0; i < values.size; i += op.plan->size()) {
+			if (!func(values.data + i)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	default:
+		for (auto &pair : *(const typename C::template Map<Ty, Ty>*)data) {
+			if (!func((uint8_t*)&pair)) {
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+
+// the scratch vector reused by the thread, one per level of recursion, so
+// the steady conversion does not allocate.
+template<typename Ty>
+class Scratch
+{
+private:
+	std::vector<Ty> &_values;
+	// the vectors of levels, deque keeps the outer ones valid when the
+	// deeper one is added.
+	static std::deque<std::vector<Ty>> &Stack()
+	{
+		static thread_local std::deque<std::vector<Ty>> stack;
+		return stack;
+	}
+	static size_t &Depth()
+	{
+		static thread_local size_t depth = 0;
+		return depth;
+	}
+	static std::vector<Ty> &Acquire()
+	{
+		auto &stack = Stack();
+		if (Depth() == stack.size()) {
+			stack.emplace_back();
+		}
+		auto &values = stack[Depth()++];
+		values.clear();
+		return values;
+	}
+public:
+	Scratch() : _values(Acquire()) {}
+	~Scratch() { --Depth(); }
+	Scratch(const Scratch&) = delete;
+	Scratch &operator=(const Scratch&) = delete;
+	// get the empty vector of this level.
+	inline std::vector<Ty> &values() { return _values; }
+};
+
+// the direction of conversion, index of the statistics.
+enum Direction
+{
+	DIRECTION_TO_PROTO,  // struct to message or wire format
+	DIRECTION_TO_STRUCT, // message or wire format to struct
+	DIRECTION_COUNT,
+};
+
+#ifdef CPS_STATS
+// the statistics of a public conversion call, which is the innermost one in
+// progress of the thread. the elements and bytes are counted on the stack,
+// and added to the counters of thread once when the call finished.
+class Probe
+{
+private:
+	const Descriptor *_desc; // the message type
+	Direction _direction;
+	Failure _failure; // reason of failure, FAILURE_COUNT if unknown
+	bool _succeeded;
+	uint64_t _elements;
+	uint64_t _bytes;
+	std::chrono::steady_clock::time_point _start;
+	Probe *_outer; // the outer call in progress, or null
+	static inline Probe *&Current()
+	{
+		static thread_local Probe *probe = nullptr;
+		return probe;
+	}
+public:
+	Probe(const Descriptor *desc, Direction direction);
+	~Probe();
+	Probe(const Probe&) = delete;
+	Probe &operator=(const Probe&) = delete;
+	// @brief Fail the call, the reason found deeper is kept.
+	// @return always false.
+	inline bool fail(Failure failure)
+	{
+		if (_failure == FAILURE_COUNT) {
+			_failure = failure;
+		}
+		return false;
+	}
+	// @brief Finish the call with the result of conversion.
+	// @param[in] failure: the reason if failed and no deeper one is found
+	// @return result.
+	inline bool done(bool result, Failure failure = FAILURE_FIELD)
+	{
+		_succeeded = result;
+		return result || fail(failure);
+	}
+	// count the elements of repeated field or pairs of map converted.
+	static inline void CountElements(size_t count)
+	{
+		auto probe = Current();
+		if (probe != nullptr) {
+			probe->_elements += count;
+		}
+	}
+	// count the bytes of string converted.
+	static inline void CountBytes(size_t size)
+	{
+		auto probe = Current();
+		if (probe != nullptr) {
+			probe->_bytes += size;
+		}
+	}
+	// record the reason of failure found deep in the conversion.
+	static inline void Fail(Failure failure)
+	{
+		auto probe = Current();
+		if (probe != nullptr) {
+			probe->fail(failure);
+		}
+	}
+};
+#else
+// compiled out without CPS_STATS, nothing is counted.
+class Probe
+{
+public:
+	Probe(const Descriptor*, Direction) {}
+	inline bool fail(Failure) { return false; }
+	inline bool done(bool result, Failure = FAILURE_FIELD)
+	{
+		return result;
+	}
+	static inline void CountElements(size_t) {}
+	static inline void CountBytes(size_t) {}
+	static inline void Fail(Failure) {}
+};
+#endif
+
+// set all fundamental and string members (include members of struct member)
+// to default value, the containers are not changed.
+void DefaultStruct(const Plan &plan, uint8_t *bytes);
+
+// compare all members of two structs, include elements of containers.
+bool EqualStruct(const Plan &plan, const uint8_t *a, const uint8_t *b);
+
+// compare the member of op of two structs.
+bool EqualMember(const Op &op, const uint8_t *a, const uint8_t *b);
+
+} // namespace cps
+
+#endif // _CONVERT_PLAN_INC_
@@ -1,73 +1,127 @@
 #include "convert_proto_struct.h"
+#include "convert_plan.h"
+#include "convert_parallel.h"
 
-#include <string>
-#include <vector>
-#include <map>
-#include <google/protobuf/message.h>
-
-using google::protobuf::Descriptor;
-using google::protobuf::FieldDescriptor;
-using google::protobuf::Reflection;
+#include <algorithm>
+#include <cstring>
+#include <mutex>
 
 namespace cps
 {
 
-typedef std::vector<uint8_t> Vector;
-typedef std::map<uint8_t, uint8_t> Map;
+// call function<C>(...) with the containers C, and return its result.
+#define DISPATCH_CONTAINERS(containers, function, ...) \
+switch (containers) { \
+case CONTAINERS_PMR: \
+	return function<PmrContainers>(__VA_ARGS__); \
+case CONTAINERS_VIEW: \
+	return function<ViewContainers>(__VA_ARGS__); \
+default: \
+	return function<StdContainers>(__VA_ARGS__); \
+}
+
+// ==================== compile conversion plan ====================
 
-// for protobuf enum, different from int
-struct Enum
+const Plan &Plan::Get(const Descriptor *desc, Containers containers,
+	MapLayout maps)
 {
-	int value;
-	Enum() : value(0) {}
-	Enum(int v) : value(v) {}
-	operator int() const { return value; }
-};
+	static std::mutex mutex;
+	static Cache caches[CONTAINERS_COUNT][MAP_SORTED + 1];
+	std::lock_guard<std::mutex> lock(mutex);
+	return Get(desc, containers, maps, caches[containers][maps]);
+}
 
-// calculate and storage the struct size and alignment.
-class StructInfo
+const Plan &Plan::Get(const Descriptor *desc, Containers containers,
+	MapLayout maps, Cache &cache)
 {
-protected:
-	int _size;  // sizeof(struct)
-	int _align; // alignof(struct)
-public:
-	StructInfo(int size = 0, int align = 0)
-		: _size(size), _align(align) {}
-	// construct with protobuf message descriptor.
-	StructInfo(const Descriptor *desc);
-	// get size;
-	inline int size() const { return _size; }
-	// get alignment
-	inline int align() const { return _align; }
-protected:
-	// append member, for calculate struct size and align.
-	inline void append(const StructInfo &info)
-	{
-		if (_align < info._align) {
-			_align = info._align;
-		}
-		int remain = _align - _size % _align;
-		_size += remain % info._align + info._size;
+	auto iter = cache.find(desc);
+	if (iter != cache.end()) {
+		return *iter->second;
 	}
-	// append member, for calculate struct size and align.
-	template<typename Ty>
-	inline void append()
-	{
-		append(StructInfo{ sizeof(Ty), alignof(Ty) });
+	// insert before build, so a message can contain itself by container.
+	auto &plan = cache[desc];
+	plan.reset(new Plan);
+	plan->_containers = containers;
+	plan->_maps = maps;
+	switch (containers) {
+	case CONTAINERS_PMR:
+		plan->build<PmrContainers>(desc, cache);
+		break;
+	case CONTAINERS_VIEW:
+		plan->build<ViewContainers>(desc, cache);
+		break;
+	default:
+		plan->build<StdContainers>(desc, cache);
+		break;
 	}
-};
+	return *plan;
+}
+
+void Plan::append(const FieldDescriptor *field, Op::Kind kind,
+	const StructInfo &info, const Plan *plan)
+{
+	Op op;
+	op.field = field;
+	op.type = field->type();
+	op.cpp_type = field->cpp_type();
+	op.number = field->number();
+	op.presence = field->has_presence();
+	op.packed = field->is_packed();
+	op.plan = plan;
+	op.offset = StructInfo::append(info);
+	op.size = info.size();
+	op.align = info.align();
+	op.kind = kind;
+	op.containers = _containers;
+	op.maps = _maps;
+	op.to_proto = nullptr;
+	op.from_proto = nullptr;
+	op.emplace = nullptr;
+	op.erase = nullptr;
+	op.destroy = nullptr;
+	op.find = nullptr;
+	op.reserve = nullptr;
+	op.sort = nullptr;
+	_ops.push_back(op);
+}
 
-StructInfo::StructInfo(const Descriptor *desc)
+template<typename C>
+void Plan::build(const Descriptor *desc, Cache &cache)
 {
+	typedef typename C::template Vector<uint8_t> Vector;
+	typedef typename C::template Map<uint8_t, uint8_t> Map;
+	typedef typename C::template HashMap<uint8_t, uint8_t> HashMap;
+	_desc = desc;
 	_size = _align = 0;
+	_ops.reserve(desc->field_count());
 	for (int i = 0; i < desc->field_count(); ++i) {
 		auto field = desc->field(i);
+		bool message = field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE;
 		if (field->is_map()) {
-			append<Map>();
+			switch (_maps) {
+			case MAP_HASH:
+				append<HashMap>(field, Op::KIND_MAP);
+				break;
+			case MAP_SORTED:
+				// std::vector<std::pair<Key, Value>>
+				append<Vector>(field, Op::KIND_MAP);
+				break;
+			default:
+				append<Map>(field, Op::KIND_MAP);
+				break;
+			}
+			continue;
+		}
+		if (field->cpp_type() == FieldDescriptor::CPPTYPE_BOOL &&
+			field->is_repeated()) {
+			// std::vector<bool> is specialized, different from others.
+			append<typename C::template Vector<bool>>(field,
+				Op::KIND_REPEATED);
 			continue;
 		}
 		if (field->is_repeated()) {
-			append<Vector>();
+			append<Vector>(field, message ? Op::KIND_REPEATED_MESSAGE
+				: Op::KIND_REPEATED);
 			continue;
 		}
 		switch (field->cpp_type()) {
@@ -75,612 +129,2925 @@ StructInfo::StructInfo(const Descriptor *desc)
 		case FieldDescriptor::CPPTYPE_UINT32:
 		case FieldDescriptor::CPPTYPE_FLOAT:
 		case FieldDescriptor::CPPTYPE_ENUM:
-			append<int32_t>();
+			append<int32_t>(field, Op::KIND_VALUE);
 			break;
 		case FieldDescriptor::CPPTYPE_INT64:
 		case FieldDescriptor::CPPTYPE_UINT64:
 		case FieldDescriptor::CPPTYPE_DOUBLE:
-			append<int64_t>();
+			append<int64_t>(field, Op::KIND_VALUE);
 			break;
 		case FieldDescriptor::CPPTYPE_BOOL:
-			append<bool>();
+			append<bool>(field, Op::KIND_VALUE);
 			break;
 		case FieldDescriptor::CPPTYPE_STRING:
-			append<std::string>();
+			append<typename C::String>(field, Op::KIND_VALUE);
 			break;
 		case FieldDescriptor::CPPTYPE_MESSAGE:
 		{
-			append(field->message_type());
+			auto &plan = Get(field->message_type(), _containers, _maps,
+				cache);
+			append(field, Op::KIND_MESSAGE, plan, &plan);
 			break;
 		}
 		default:
 			_size = _align = 0;
+			_ops.clear();
 			return; // never reached!
 		}
 	}
+	if (_align == 0) {
+		// an empty struct, same as c++.
+		_size = _align = 1;
+	}
 	if (_size % _align) {
 		_size += _align - _size % _align;
 	}
+	// the element of container does not affect the size of struct, resolve
+	// it after this layout is complete, the element may contain this struct.
+	for (auto &op : _ops) {
+		if (op.kind == Op::KIND_MAP || op.kind == Op::KIND_REPEATED_MESSAGE) {
+			op.plan = &Get(op.field->message_type(), _containers, _maps,
+				cache);
+		}
+		bind<C>(op);
+	}
+	build_index();
+	build_defaults();
 }
 
-// ==================== convert struct to protobuf message ====================
-
-// protobuf does not provide generic template function, so we wrap it.
-template<typename Ty>
-inline void ProtoSet(const Ty &value, Message &msg,
-	const Reflection *refl, const FieldDescriptor *field)
+void Plan::build_index()
 {
+	int max_number = 0;
+	for (auto &op : _ops) {
+		_numbers.push_back(&op);
+		if (max_number < op.number) {
+			max_number = op.number;
+		}
+	}
+	std::sort(_numbers.begin(), _numbers.end(),
+		[](const Op *a, const Op *b) {
+			return a->number < b->number;
+		});
+	// the field numbers are usually dense, index it directly.
+	if (max_number <= static_cast<int>(_ops.size()) * 2 + 64) {
+		_index.resize(max_number + 1, nullptr);
+		for (auto &op : _ops) {
+			_index[op.number] = &op;
+		}
+	}
 }
 
-#define SPECIAL_TEMPLATE_ProtoSet(type, Type) \
-template<> \
-inline void ProtoSet<type>(const type &value, Message &msg, \
-	const Reflection *refl, const FieldDescriptor *field) { \
-	return refl->Set ## Type(&msg, field, value); \
+const Op *Plan::find_sorted(int number) const
+{
+	auto iter = std::lower_bound(_numbers.begin(), _numbers.end(), number,
+		[](const Op *op, int number) {
+			return op->number < number;
+		});
+	if (iter == _numbers.end() || (*iter)->number != number) {
+		return nullptr;
+	}
+	return *iter;
 }
 
-SPECIAL_TEMPLATE_ProtoSet(int32_t, Int32)
-SPECIAL_TEMPLATE_ProtoSet(int64_t, Int64)
-SPECIAL_TEMPLATE_ProtoSet(uint32_t, UInt32)
-SPECIAL_TEMPLATE_ProtoSet(uint64_t, UInt64)
-SPECIAL_TEMPLATE_ProtoSet(float, Float)
-SPECIAL_TEMPLATE_ProtoSet(double, Double)
-SPECIAL_TEMPLATE_ProtoSet(bool, Bool)
-SPECIAL_TEMPLATE_ProtoSet(Enum, EnumValue)
-SPECIAL_TEMPLATE_ProtoSet(std::string, String)
+static void DefaultMember(const Op &op, uint8_t *bytes);
 
-template<typename Ty>
-inline void ProtoAdd(const Ty &value, Message &msg,
-	const Reflection *refl, const FieldDescriptor *field)
+// set string member to value.
+template<typename C>
+static inline void AssignString(uint8_t *data, const std::string &value)
 {
+	C::Assign(*(typename C::String*)data, value);
 }
 
-#define SPECIAL_TEMPLATE_ProtoAdd(type, Type) \
-template<> \
-inline void ProtoAdd<type>(const type &value, Message &msg, \
-	const Reflection *refl, const FieldDescriptor *field) { \
-	return refl->Add ## Type(&msg, field, value); \
+// the member is fundamental type, can be copied by memory.
+static inline bool IsFundamental(const Op &op)
+{
+	return op.kind == Op::KIND_VALUE &&
+		op.cpp_type != FieldDescriptor::CPPTYPE_STRING;
 }
 
-SPECIAL_TEMPLATE_ProtoAdd(int32_t, Int32)
-SPECIAL_TEMPLATE_ProtoAdd(int64_t, Int64)
-SPECIAL_TEMPLATE_ProtoAdd(uint32_t, UInt32)
-SPECIAL_TEMPLATE_ProtoAdd(uint64_t, UInt64)
-SPECIAL_TEMPLATE_ProtoAdd(float, Float)
-SPECIAL_TEMPLATE_ProtoAdd(double, Double)
-SPECIAL_TEMPLATE_ProtoAdd(bool, Bool)
-SPECIAL_TEMPLATE_ProtoAdd(Enum, EnumValue)
-SPECIAL_TEMPLATE_ProtoAdd(std::string, String)
-
-// end of wrap protobuf SetXxx function
-
-// read member value from struct and set to protobuf message.
-class  StructReader : public StructInfo
+void Plan::build_defaults()
 {
-private:
-	int _pos; // read position
-	const uint8_t *_bytes; // the memory of struct
-	Message &_msg; // protobuf message
-	const Reflection *_refl; // protobuf message reflection
-public:
-	StructReader(Message &msg, const uint8_t *bytes)
-		: StructInfo(msg.GetDescriptor())
-		, _pos(0)
-		, _bytes(bytes)
-		, _msg(msg)
-		, _refl(msg.GetReflection()) {}
-
-	// convert to protobuf message
-	bool to_proto();
-
-private:
-	// read a member from struct
-	template<typename Ty>
-	const Ty &read_member()
-	{
-		int remain = _align - _pos % _align;
-		_pos += remain % alignof(Ty);
-		auto &result = *(const Ty*)(_bytes + _pos);
-		_pos += sizeof(Ty);
-		return result;
-	}
-
-	// read a struct member from struct
-	StructReader child_reader(Message &msg)
-	{
-		StructReader reader(msg, nullptr);
-		int remain = _align - _pos % _align;
-		_pos += remain % reader._align;
-		reader._bytes = _bytes + _pos;
-		_pos += reader._size;
-		return reader;
-	}
-
-	// set value to protobuf message
-	template<typename Ty>
-	bool set_proto_value(const FieldDescriptor *field)
-	{
-		if (field->is_repeated()) {
-			auto &values = read_member<std::vector<Ty>>();
-			for (const Ty &value : values) {
-				ProtoAdd<Ty>(value, _msg, _refl, field);
-			}
-		} else {
-			ProtoSet<Ty>(read_member<Ty>(), _msg, _refl, field);
-		}
-		return true;
-	}
-
-	// set protobuf map message
-	template<typename Ty>
-	bool set_proto_map(const FieldDescriptor *field)
-	{
-		auto &values = read_member<std::map<Ty, Ty>>();
-		for (auto &pair : values) {
-			auto submsg = _refl->AddMessage(&_msg, field);
-			auto bytes = (const uint8_t*)&pair;
-			StructReader reader(*submsg, bytes);
-			if (!reader.to_proto()) {
-				return false;
-			}
+	_defaults.assign(_size, 0);
+	for (size_t i = 0; i < _ops.size(); ++i) {
+		auto &op = _ops[i];
+		if (op.kind != Op::KIND_VALUE && op.kind != Op::KIND_MESSAGE) {
+			continue; // the containers are not defaulted
 		}
-		return true;
-	}
-
-	// set protpbuf map message, forward to next function by alignment.
-	bool set_proto_map(const FieldDescriptor *field)
-	{
-		auto desc = field->message_type();
-		if (desc->field_count() != 2) {
-			// map should have 2 field.
-			return false; // should never reached!
+		if (!IsFundamental(op)) {
+			_composites.push_back(&op);
+			continue;
 		}
-		StructInfo info(desc);
-		switch (info.align()) {
-		case 4:
-			return set_proto_map<int32_t>(field);
-		case 8:
-			return set_proto_map<int64_t>(field);
-		default:
-			// protobuf support (u)int32/(u)int64/string as key,
-			// the key is align as 4 or 8 bytes.
-			return false; // should never reached!
+		DefaultMember(op, _defaults.data());
+		// the ops are in order of layout, only padding is between adjacent
+		// fundamental members, merge them.
+		if (i > 0 && IsFundamental(_ops[i - 1])) {
+			_runs.back().size = op.offset + op.size - _runs.back().offset;
+		} else {
+			_runs.push_back(Run{ op.offset, op.size });
 		}
 	}
-};
+}
 
-// set protobuf message value
-template<>
-bool StructReader::set_proto_value<Message>(const FieldDescriptor *field)
+// set member of op to default value.
+static void DefaultMember(const Op &op, uint8_t *bytes)
 {
-	if (!field->is_repeated()) {
-		auto submsg = _refl->MutableMessage(&_msg, field);
-		auto reader = child_reader(*submsg);
-		return reader.to_proto();
-	}
-	if (field->is_map()) {
-		return set_proto_map(field);
-	}
-	// set protobuf repeated message from vector
-	StructInfo info(field->message_type());
-	if (info.size() == 0) {
-		// an empty struct in vector?
-		return false; // should never reached!
+	uint8_t *data = bytes + op.offset;
+	auto field = op.field;
+	switch (op.cpp_type) {
+	case FieldDescriptor::CPPTYPE_INT32:
+		*(int32_t*)data = field->default_value_int32();
+		break;
+	case FieldDescriptor::CPPTYPE_INT64:
+		*(int64_t*)data = field->default_value_int64();
+		break;
+	case FieldDescriptor::CPPTYPE_UINT32:
+		*(uint32_t*)data = field->default_value_uint32();
+		break;
+	case FieldDescriptor::CPPTYPE_UINT64:
+		*(uint64_t*)data = field->default_value_uint64();
+		break;
+	case FieldDescriptor::CPPTYPE_DOUBLE:
+		*(double*)data = field->default_value_double();
+		break;
+	case FieldDescriptor::CPPTYPE_FLOAT:
+		*(float*)data = field->default_value_float();
+		break;
+	case FieldDescriptor::CPPTYPE_BOOL:
+		*(bool*)data = field->default_value_bool();
+		break;
+	case FieldDescriptor::CPPTYPE_ENUM:
+		*(int*)data = field->default_value_enum()->number();
+		break;
+	case FieldDescriptor::CPPTYPE_STRING:
+		// the default value is owned by descriptor, can be viewed.
+		DISPATCH_CONTAINERS(op.containers, AssignString, data,
+			field->default_value_string())
+	default:
+		break;
 	}
-	auto &values = read_member<Vector>();
-	const uint8_t *data = values.data();
-	if (values.size() % info.size()) {
-		// The element in vector has difference size?
-		return false; // should never reached!
+}
+
+void DefaultStruct(const Plan &plan, uint8_t *bytes)
+{
+	for (auto &run : plan.runs()) {
+		memcpy(bytes + run.offset, plan.defaults() + run.offset, run.size);
 	}
-	int count = static_cast<int>(values.size() / info.size());
-	for (int i = 0; i < count; ++i) {
-		auto submsg = _refl->AddMessage(&_msg, field);
-		StructReader reader(*submsg, data);
-		if (!reader.to_proto()) {
-			return false;
+	for (auto op : plan.composites()) {
+		if (op->kind == Op::KIND_VALUE) {
+			DefaultMember(*op, bytes);
+		} else {
+			DefaultStruct(*op->plan, bytes + op->offset);
 		}
-		data += info.size(); // point to next member
 	}
-	return true;
 }
 
-bool StructReader::to_proto()
+// get the elements of vector member, by containers of op.
+static inline Bytes VectorBytes(const Op &op, const uint8_t *data)
 {
-	auto desc = _msg.GetDescriptor();
-	for (int i = 0; i < desc->field_count(); ++i) {
-		auto field = desc->field(i);
-		switch (field->cpp_type()) {
-		case FieldDescriptor::CPPTYPE_INT32:
-			set_proto_value<int32_t>(field);
-			break;
-		case FieldDescriptor::CPPTYPE_INT64:
-			set_proto_value<int64_t>(field);
-			break;
-		case FieldDescriptor::CPPTYPE_UINT32:
-			set_proto_value<uint32_t>(field);
-			break;
-		case FieldDescriptor::CPPTYPE_UINT64:
-			set_proto_value<uint64_t>(field);
-			break;
-		case FieldDescriptor::CPPTYPE_DOUBLE:
-			set_proto_value<double>(field);
-			break;
-		case FieldDescriptor::CPPTYPE_FLOAT:
-			set_proto_value<float>(field);
-			break;
-		case FieldDescriptor::CPPTYPE_BOOL:
-			set_proto_value<bool>(field);
-			break;
-		case FieldDescriptor::CPPTYPE_ENUM:
-			set_proto_value<Enum>(field);
+	DISPATCH_CONTAINERS(op.containers, VectorBytes, data)
+}
+
+template<typename C>
+static void ConstructMember(const Op &op, uint8_t *bytes,
+	MemoryResource *resource)
+{
+	uint8_t *data = bytes + op.offset;
+	switch (op.kind) {
+	case Op::KIND_VALUE:
+		if (op.cpp_type == FieldDescriptor::CPPTYPE_STRING) {
+			C::template New<typename C::String>(data, resource);
+		}
+		DefaultMember(op, bytes);
+		break;
+	case Op::KIND_REPEATED:
+		if (op.cpp_type == FieldDescriptor::CPPTYPE_BOOL) {
+			C::template New<typename C::template Vector<bool>>(data, resource);
 			break;
-		case FieldDescriptor::CPPTYPE_STRING:
-			set_proto_value<std::string>(field);
+		}
+		C::template New<typename C::template Vector<uint8_t>>(data, resource);
+		break;
+	case Op::KIND_REPEATED_MESSAGE:
+		C::template New<typename C::template Vector<uint8_t>>(data, resource);
+		break;
+	case Op::KIND_MAP:
+		switch (op.maps) {
+		case MAP_HASH:
+			C::template New<typename C::template HashMap<uint8_t, uint8_t>>(
+				data, resource);
 			break;
-		case FieldDescriptor::CPPTYPE_MESSAGE:
-			if (!set_proto_value<Message>(field)) {
-				return false;
-			}
+		case MAP_SORTED:
+			C::template New<typename C::template Vector<uint8_t>>(data,
+				resource);
 			break;
 		default:
-			return false; // never reached!
+			C::template New<typename C::template Map<uint8_t, uint8_t>>(data,
+				resource);
+			break;
 		}
+		break;
+	case Op::KIND_MESSAGE:
+		ConstructStruct(*op.plan, data, resource);
+		break;
 	}
-	return true;
 }
 
-// @brief Convert struct to protobuf message.
-// @param[in] bytes: pointer to struct
-// @param[in] size: sizeof struct
-// @param[out] msg: protobuf message
-// @return true for success, or false for failed.
-bool StructToProto(const void *bytes, size_t size, Message &msg)
+void ConstructMember(const Op &op, uint8_t *bytes, MemoryResource *resource)
 {
-	StructReader reader(msg, static_cast<const uint8_t*>(bytes));
-	if (reader.size() != static_cast<int>(size)) {
-		return false; // protobuf message is not match struct
-	}
-	return reader.to_proto();
+	DISPATCH_CONTAINERS(op.containers, ConstructMember, op, bytes, resource)
 }
 
-// ==================== convert protobuf message to struct ====================
+void ConstructStruct(const Plan &plan, uint8_t *bytes,
+	MemoryResource *resource)
+{
+	for (auto &op : plan.ops()) {
+		ConstructMember(op, bytes, resource);
+	}
+}
 
-// protobuf does not provide generic template function, so we wrap it.
+// call destructor of Ty.
 template<typename Ty>
-inline Ty ProtoGet(const Message &msg,
-	const Reflection *refl, const FieldDescriptor *field)
+static inline void Destroy(uint8_t *data)
 {
+	reinterpret_cast<Ty*>(data)->~Ty();
 }
 
-#define SPECIAL_TEMPLATE_ProtoGet(type, Type) \
-template<> \
-inline type ProtoGet<type>(const Message &msg, \
-	const Reflection *refl, const FieldDescriptor *field) { \
-	return refl->Get ## Type(msg, field); \
+// get alignment of the elements of repeated fundamental member.
+static inline size_t ElementAlign(const Op &op)
+{
+	switch (op.cpp_type) {
+	case FieldDescriptor::CPPTYPE_INT64:
+	case FieldDescriptor::CPPTYPE_UINT64:
+		return alignof(int64_t);
+	case FieldDescriptor::CPPTYPE_DOUBLE:
+		return alignof(double);
+	default:
+		return alignof(int32_t); // float and enum too
+	}
 }
 
-SPECIAL_TEMPLATE_ProtoGet(int32_t, Int32)
-SPECIAL_TEMPLATE_ProtoGet(int64_t, Int64)
-SPECIAL_TEMPLATE_ProtoGet(uint32_t, UInt32)
-SPECIAL_TEMPLATE_ProtoGet(uint64_t, UInt64)
-SPECIAL_TEMPLATE_ProtoGet(float, Float)
-SPECIAL_TEMPLATE_ProtoGet(double, Double)
-SPECIAL_TEMPLATE_ProtoGet(bool, Bool)
-SPECIAL_TEMPLATE_ProtoGet(Enum, EnumValue)
-SPECIAL_TEMPLATE_ProtoGet(std::string, String)
+// destroy values of map member, Ty has the same alignment as the pair. the
+// keys of sorted vector are destroyed too, the others are destroyed by map.
+template<typename Ty, typename C>
+static void DestroyMapValues(const Op &op, uint8_t *data)
+{
+	auto &entry = *op.plan;
+	bool sorted = op.maps == MAP_SORTED;
+	ForEachPair<Ty, C>(op, data, [&](uint8_t *pair) {
+		if (sorted) {
+			DestroyStruct(entry, pair);
+		} else {
+			DestroyMember(entry.ops()[1], pair);
+		}
+		return true;
+	});
+}
 
-template<typename Ty>
-inline Ty ProtoGet(const Message &msg,
-	const Reflection *refl, const FieldDescriptor *field, int index)
+template<typename C>
+static void DestroyMember(const Op &op, uint8_t *bytes)
 {
+	typedef typename C::String String;
+	uint8_t *data = bytes + op.offset;
+	bool string = op.cpp_type == FieldDescriptor::CPPTYPE_STRING;
+	switch (op.kind) {
+	case Op::KIND_VALUE:
+		if (string) {
+			Destroy<String>(data);
+		}
+		break;
+	case Op::KIND_REPEATED:
+		if (string) {
+			Destroy<typename C::template Vector<String>>(data);
+		} else if (op.cpp_type == FieldDescriptor::CPPTYPE_BOOL) {
+			Destroy<typename C::template Vector<bool>>(data);
+		} else {
+			UnitVector<C>(data, ElementAlign(op)).destroy();
+		}
+		break;
+	case Op::KIND_REPEATED_MESSAGE:
+	{
+		auto values = VectorBytes(op, data);
+		for (size_t i = 0; i < values.size; i += op.plan->size()) {
+			DestroyStruct(*op.plan, values.data + i);
+		}
+		UnitVector<C>(data, op.plan->align()).destroy();
+		break;
+	}
+	case Op::KIND_MAP:
+		if (op.plan->align() == 4) {
+			DestroyMapValues<int32_t, C>(op, data);
+		} else {
+			DestroyMapValues<int64_t, C>(op, data);
+		}
+		if (op.maps == MAP_SORTED) {
+			UnitVector<C>(data, op.plan->align()).destroy();
+		} else {
+			op.destroy(op, data);
+		}
+		break;
+	case Op::KIND_MESSAGE:
+		DestroyStruct(*op.plan, data);
+		break;
+	}
 }
 
-#define SPECIAL_TEMPLATE_ProtoGetRepeated(type, Type) \
-template<> \
-inline type ProtoGet<type>(const Message &msg, \
-	const Reflection *refl, const FieldDescriptor *field, int index) { \
-	return refl->GetRepeated ## Type(msg, field, index); \
+void DestroyMember(const Op &op, uint8_t *bytes)
+{
+	DISPATCH_CONTAINERS(op.containers, DestroyMember, op, bytes)
 }
 
-SPECIAL_TEMPLATE_ProtoGetRepeated(int32_t, Int32)
-SPECIAL_TEMPLATE_ProtoGetRepeated(int64_t, Int64)
-SPECIAL_TEMPLATE_ProtoGetRepeated(uint32_t, UInt32)
-SPECIAL_TEMPLATE_ProtoGetRepeated(uint64_t, UInt64)
-SPECIAL_TEMPLATE_ProtoGetRepeated(float, Float)
-SPECIAL_TEMPLATE_ProtoGetRepeated(double, Double)
+void DestroyStruct(const Plan &plan, uint8_t *bytes)
+{
+	for (auto &op : plan.ops()) {
+		DestroyMember(op, bytes);
+	}
+}
+
+// move construct Ty from a member to the memory of another.
+template<typename Ty>
+static inline void Move(uint8_t *from, uint8_t *to)
+{
+	new(to) Ty(std::move(*reinterpret_cast<Ty*>(from)));
+}
+
+static void MoveMember(const Op &op, uint8_t *from, uint8_t *to,
+	MemoryResource *resource);
+
+// move std::unordered_map member, the pairs are inserted to the new map one
+// by one, the punned map can not move its buckets. Ty has the same alignment
+// as the pair.
+template<typename Ty, typename C>
+static void MoveHashMap(const Op &op, uint8_t *from, uint8_t *to,
+	MemoryResource *resource)
+{
+	auto &value = op.plan->ops()[1];
+	auto &values = *(typename C::template HashMap<Ty, Ty>*)(from + op.offset);
+	ConstructMember(op, to, resource);
+	auto map = to + op.offset;
+	op.reserve(map, values.size());
+	ForEachPair<Ty, C>(op, from + op.offset, [&](uint8_t *pair) {
+		bool inserted = false;
+		auto target = op.emplace(op, map, pair, inserted); // key is moved
+		MoveMember(value, pair, target, resource);
+		return true;
+	});
+}
+
+template<typename C>
+static void MoveMember(const Op &op, uint8_t *from, uint8_t *to,
+	MemoryResource *resource)
+{
+	typedef typename C::String String;
+	typedef typename C::template Vector<uint8_t> Vector;
+	bool string = op.cpp_type == FieldDescriptor::CPPTYPE_STRING;
+	switch (op.kind) {
+	case Op::KIND_VALUE:
+		if (string) {
+			Move<String>(from + op.offset, to + op.offset);
+		} else {
+			memcpy(to + op.offset, from + op.offset, op.size);
+		}
+		break;
+	case Op::KIND_REPEATED:
+		if (string) {
+			Move<typename C::template Vector<String>>(from + op.offset,
+				to + op.offset);
+		} else if (op.cpp_type == FieldDescriptor::CPPTYPE_BOOL) {
+			Move<typename C::template Vector<bool>>(from + op.offset,
+				to + op.offset);
+		} else {
+			Move<Vector>(from + op.offset, to + op.offset);
+		}
+		break;
+	case Op::KIND_REPEATED_MESSAGE:
+		Move<Vector>(from + op.offset, to + op.offset);
+		break;
+	case Op::KIND_MAP:
+		switch (op.maps) {
+		case MAP_HASH:
+			if (op.plan->align() == 4) {
+				MoveHashMap<int32_t, C>(op, from, to, resource);
+			} else {
+				MoveHashMap<int64_t, C>(op, from, to, resource);
+			}
+			break;
+		case MAP_SORTED:
+			Move<Vector>(from + op.offset, to + op.offset);
+			break;
+		default:
+			Move<typename C::template Map<uint8_t, uint8_t>>(
+				from + op.offset, to + op.offset);
+			break;
+		}
+		break;
+	case Op::KIND_MESSAGE:
+		MoveStruct(*op.plan, from + op.offset, to + op.offset, resource);
+		break;
+	}
+}
+
+static void MoveMember(const Op &op, uint8_t *from, uint8_t *to,
+	MemoryResource *resource)
+{
+	DISPATCH_CONTAINERS(op.containers, MoveMember, op, from, to, resource)
+}
+
+void MoveStruct(const Plan &plan, uint8_t *from, uint8_t *to,
+	MemoryResource *resource)
+{
+	for (auto &op : plan.ops()) {
+		MoveMember(op, from, to, resource);
+	}
+}
+
+// ==================== compare struct ====================
+
+// compare std::map<Key, Value>, Ty has the same alignment as the pair. the
+// pairs are in same order if the keys are same.
+template<typename Ty, typename C>
+static bool EqualMap(const Plan &entry, const uint8_t *a, const uint8_t *b)
+{
+	typedef typename C::template Map<Ty, Ty> Type;
+	auto &left = *(const Type*)a;
+	auto &right = *(const Type*)b;
+	if (left.size() != right.size()) {
+		return false;
+	}
+	auto iter = right.begin();
+	for (auto &pair : left) {
+		if (!EqualStruct(entry, (const uint8_t*)&pair,
+			(const uint8_t*)&*iter++)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// compare std::unordered_map<Key, Value>, Ty has the same alignment as the
+// pair. the pairs are in any order, found by key.
+template<typename Ty, typename C>
+static bool EqualHashMap(const Op &op, const uint8_t *a, const uint8_t *b)
+{
+	typedef typename C::template HashMap<Ty, Ty> Type;
+	auto &left = *(const Type*)a;
+	auto &right = *(const Type*)b;
+	if (left.size() != right.size()) {
+		return false;
+	}
+	if (op.find == nullptr) {
+		return left.empty(); // the map value is not supported
+	}
+	for (auto &pair : left) {
+		// key is at offset 0.
+		auto other = op.find(b, &pair);
+		if (other == nullptr ||
+			!EqualStruct(*op.plan, (const uint8_t*)&pair, other)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// compare std::vector<std::pair<Key, Value>>, same as vector of structs.
+template<typename C>
+static bool EqualSortedMap(const Plan &entry, const uint8_t *a,
+	const uint8_t *b)
+{
+	auto left = VectorBytes<C>(a);
+	auto right = VectorBytes<C>(b);
+	if (left.size != right.size) {
+		return false;
+	}
+	for (size_t i = 0; i < left.size; i += entry.size()) {
+		if (!EqualStruct(entry, left.data + i, right.data + i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// compare the member of type Ty.
+template<typename Ty>
+static inline bool Equal(const uint8_t *a, const uint8_t *b)
+{
+	return *(const Ty*)a == *(const Ty*)b;
+}
+
+template<typename C>
+static bool EqualMember(const Op &op, const uint8_t *a, const uint8_t *b)
+{
+	typedef typename C::String String;
+	a += op.offset;
+	b += op.offset;
+	bool string = op.cpp_type == FieldDescriptor::CPPTYPE_STRING;
+	switch (op.kind) {
+	case Op::KIND_VALUE:
+		if (string) {
+			return Equal<String>(a, b);
+		}
+		return memcmp(a, b, op.size) == 0;
+	case Op::KIND_REPEATED:
+		if (string) {
+			return Equal<typename C::template Vector<String>>(a, b);
+		}
+		if (op.cpp_type == FieldDescriptor::CPPTYPE_BOOL) {
+			return Equal<typename C::template Vector<bool>>(a, b);
+		}
+		return Equal<typename C::template Vector<uint8_t>>(a, b);
+	case Op::KIND_MESSAGE:
+		return EqualStruct(*op.plan, a, b);
+	case Op::KIND_REPEATED_MESSAGE:
+	{
+		auto left = VectorBytes(op, a);
+		auto right = VectorBytes(op, b);
+		if (left.size != right.size) {
+			return false;
+		}
+		size_t step = op.plan->size();
+		for (size_t i = 0; i < left.size; i += step) {
+			if (!EqualStruct(*op.plan, left.data + i, right.data + i)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	case Op::KIND_MAP:
+		if (op.maps == MAP_SORTED) {
+			return EqualSortedMap<C>(*op.plan, a, b);
+		}
+		switch (op.plan->align()) {
+		case 4:
+			return op.maps == MAP_HASH ? EqualHashMap<int32_t, C>(op, a, b)
+				: EqualMap<int32_t, C>(*op.plan, a, b);
+		case 8:
+			return op.maps == MAP_HASH ? EqualHashMap<int64_t, C>(op, a, b)
+				: EqualMap<int64_t, C>(*op.plan, a, b);
+		default:
+			return false; // should never reached!
+		}
+	default:
+		return false; // should never reached!
+	}
+}
+
+bool EqualMember(const Op &op, const uint8_t *a, const uint8_t *b)
+{
+	DISPATCH_CONTAINERS(op.containers, EqualMember, op, a, b)
+}
+
+bool EqualStruct(const Plan &plan, const uint8_t *a, const uint8_t *b)
+{
+	for (auto &op : plan.ops()) {
+		if (!EqualMember(op, a, b)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// ==================== map of struct ====================
+
+// CPS_MAP_NODES allocates the nodes of map with the exact size of the real
+// ones, by the node layout of libstdc++. it is ignored by the others.
+#if defined(CPS_MAP_NODES) && !defined(__GLIBCXX__)
+#undef CPS_MAP_NODES
+#endif
+
+#ifdef CPS_MAP_NODES
+
+// the size of std::pair<const Key, Value> of the map being converted by the
+// thread, and the hash code cached after it. the map of struct is punned as a
+// map of uint64_t value, whose nodes are allocated with the size of the real
+// nodes.
+class NodeScope
+{
+private:
+	size_t _saved;
+	static size_t &Current()
+	{
+		static thread_local size_t size = 0;
+		return size;
+	}
+public:
+	explicit NodeScope(size_t size) : _saved(Current()) { Current() = size; }
+	~NodeScope() { Current() = _saved; }
+	NodeScope(const NodeScope&) = delete;
+	NodeScope &operator=(const NodeScope&) = delete;
+	// get size of the pair in the node.
+	static inline size_t size() { return Current(); }
+};
+
+// a unit of the node memory, aligned as the node.
+template<size_t Align>
+struct alignas(Align) NodeUnit
+{
+	uint8_t bytes[Align];
+};
+
+// Ty is the node of map holding Pair, by the value accessor of the nodes of
+// libstdc++, which are the only types of map (not the buckets) holding Pair.
+template<typename Ty, typename Pair, typename = void>
+struct IsNode : std::false_type {};
+
+template<typename Ty, typename Pair>
+struct IsNode<Ty, Pair, typename std::enable_if<std::is_same<
+	decltype(std::declval<Ty&>()._M_valptr()), Pair*>::value>::type>
+	: std::true_type {};
+
+static_assert(IsNode<std::_Rb_tree_node<std::pair<const int, uint64_t>>,
+	std::pair<const int, uint64_t>>::value && IsNode<std::__detail::_Hash_node<
+	std::pair<const int, uint64_t>, false>, std::pair<const int, uint64_t>>::
+	value, "the nodes of map should be found by the allocator");
+
+// the allocator of map punned with value of uint64_t. a node is allocated with
+// the size of the real node, by the size of pair in NodeScope, and zero
+// filled. the others (e.g. buckets) are allocated as is. it has the same
+// layout as Base, the allocator of containers, so the nodes are freed by the
+// map of struct with the same size and alignment. the size of pair can not be
+// a member for the same reason, Base is empty for std::allocator.
+template<typename Ty, typename Pair, typename Base>
+class NodeAllocator : private Base
+{
+private:
+	template<typename, typename, typename>
+	friend class NodeAllocator;
+	typedef NodeUnit<alignof(Ty)> Unit;
+	template<typename U>
+	using Rebind = typename std::allocator_traits<Base>::template
+		rebind_alloc<U>;
+	// count of units of the real node.
+	static inline size_t Units()
+	{
+		size_t size = sizeof(Ty) - sizeof(Pair) + NodeScope::size();
+		return (size + sizeof(Unit) - 1) / sizeof(Unit);
+	}
+	inline const Base &base() const { return *this; }
+public:
+	typedef Ty value_type;
+	typedef Ty *pointer;
+	typedef const Ty *const_pointer;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	template<typename U>
+	struct rebind { typedef NodeAllocator<U, Pair, Base> other; };
+
+	NodeAllocator(const Base &base) : Base(base) {}
+	template<typename U>
+	NodeAllocator(const NodeAllocator<U, Pair, Base> &other)
+		: Base(other.base()) {}
+
+	Ty *allocate(size_t n)
+	{
+		if (!IsNode<Ty, Pair>::value) {
+			return Rebind<Ty>(base()).allocate(n);
+		}
+		size_t units = Units() * n;
+		void *node = Rebind<Unit>(base()).allocate(units);
+		memset(node, 0, units * sizeof(Unit));
+		return static_cast<Ty*>(node);
+	}
+	void deallocate(Ty *p, size_t n)
+	{
+		if (!IsNode<Ty, Pair>::value) {
+			return Rebind<Ty>(base()).deallocate(p, n);
+		}
+		Rebind<Unit>(base()).deallocate(reinterpret_cast<Unit*>(p),
+			Units() * n);
+	}
+	// construct by Base, e.g. std::pmr::string key with the resource.
+	template<typename U, typename... Args>
+	void construct(U *p, Args&&... args)
+	{
+		Base &base = *this;
+		std::allocator_traits<Base>::construct(base, p,
+			std::forward<Args>(args)...);
+	}
+	template<typename U>
+	void destroy(U *p)
+	{
+		Base &base = *this;
+		std::allocator_traits<Base>::destroy(base, p);
+	}
+	template<typename U>
+	bool operator==(const NodeAllocator<U, Pair, Base> &other) const
+	{
+		return base() == other.base();
+	}
+	template<typename U>
+	bool operator!=(const NodeAllocator<U, Pair, Base> &other) const
+	{
+		return !(base() == other.base());
+	}
+};
+
+// the punned maps of containers C, the Value is uint64_t, and the real value
+// is constructed in place by plan.
+template<typename C, typename Key, typename Value>
+struct NodeMaps
+{
+	typedef std::pair<const Key, Value> Pair;
+	typedef NodeAllocator<Pair, Pair, typename C::template
+		Vector<uint8_t>::allocator_type> Allocator;
+	typedef std::map<Key, Value, std::less<Key>, Allocator> Map;
+	template<typename Hash>
+	using HashMap = std::unordered_map<Key, Value, Hash,
+		std::equal_to<Key>, Allocator>;
+};
+
+#else
+
+// the nodes are allocated by the punned map itself, no size is needed.
+class NodeScope
+{
+public:
+	explicit NodeScope(size_t) {}
+};
+
+template<int ValueSize, int Alignment>
+struct ValueType {};
+
+template<int ValueSize>
+struct ValueType<ValueSize, 4>
+{
+	uint32_t member[ValueSize / 4];
+};
+
+template<int ValueSize>
+struct ValueType<ValueSize, 8>
+{
+	uint64_t member[ValueSize / 8];
+};
+
+// the punned maps of containers C, the Value is ValueType of the same
+// alignment as the real value, and not smaller than it.
+template<typename C, typename Key, typename Value>
+struct NodeMaps
+{
+	typedef typename C::template Map<Key, Value> Map;
+	template<typename Hash>
+	using HashMap = typename C::template HashMap<Key, Value, Hash>;
+};
+
+#endif // CPS_MAP_NODES
+
+// find or insert key into map of Type, the existing pair is found without
+// allocation.
+template<typename Type>
+static uint8_t *MapEmplace(const Op &op, void *map, void *key, bool &inserted)
+{
+	typedef typename Type::key_type Key;
+	typedef typename Type::mapped_type Value;
+	auto &values = *static_cast<Type*>(map);
+	auto &k = *static_cast<Key*>(key);
+	auto iter = values.lower_bound(k);
+	inserted = iter == values.end() || values.key_comp()(k, iter->first);
+	if (inserted) {
+		NodeScope scope(op.plan->size());
+		iter = values.emplace_hint(iter, std::move(k), Value{ 0 });
+	}
+	return (uint8_t*)&(iter->first);
+}
+
+#ifdef __GLIBCXX__
+
+// the std::unordered_map of struct is punned by the node layout of
+// libstdc++: the next pointer, the pair, then the hash code if cached.
+static_assert(sizeof(std::__detail::_Hash_node<
+	std::pair<const std::string, uint64_t>, true>) == sizeof(void*) +
+	sizeof(std::pair<const std::string, uint64_t>) + sizeof(size_t),
+	"the hash code should be cached after the pair");
+
+// the hash of key for std::unordered_map, which is never cached in the node
+// by libstdc++, so the nodes of any value type have the same layout before
+// the value.
+template<typename Key>
+struct NodeHash : std::hash<Key> {};
+
+// libstdc++ caches the hash code of some key types (e.g. std::string) after
+// the value in the node of std::unordered_map.
+template<typename Key>
+static inline bool HashCached()
+{
+	static_assert(!std::__cache_default<Key, NodeHash<Key>>::value,
+		"the hash code of node should not be cached");
+	return std::__cache_default<Key, std::hash<Key>>::value;
+}
+
+#else
+
+// the other standard libraries cache the hash code before the value or never,
+// the punned map uses the same hash as the map of struct.
+template<typename Key>
+using NodeHash = std::hash<Key>;
+
+template<typename Key>
+static inline bool HashCached()
+{
+	return false;
+}
+
+#endif // __GLIBCXX__
+
+// the offset of hash code cached after the pair of entry.
+static inline size_t HashOffset(const Plan &entry)
+{
+	return (entry.size() + alignof(size_t) - 1) / alignof(size_t) *
+		alignof(size_t);
+}
+
+// the size of pair in node of std::unordered_map of Key, include the hash
+// code cached after it.
+template<typename Key>
+static inline size_t HashPairSize(const Op &op)
+{
+	return HashCached<Key>() ? HashOffset(*op.plan) + sizeof(size_t)
+		: op.plan->size();
+}
+
+// find or insert key into std::unordered_map of Type, the existing pair is
+// found without allocation. the hash code cached by the node of struct is
+// written after the pair.
+template<typename Type>
+static uint8_t *HashEmplace(const Op &op, void *map, void *key, bool &inserted)
+{
+	typedef typename Type::key_type Key;
+	typedef typename Type::mapped_type Value;
+	auto &values = *static_cast<Type*>(map);
+	auto &k = *static_cast<Key*>(key);
+	auto iter = values.find(k);
+	inserted = iter == values.end();
+	if (inserted) {
+		NodeScope scope(HashPairSize<Key>(op));
+		iter = values.emplace(std::move(k), Value{ 0 }).first;
+		if (HashCached<Key>()) {
+			*(size_t*)((uint8_t*)&(iter->first) + HashOffset(*op.plan)) =
+				std::hash<Key>()(iter->first);
+		}
+	}
+	return (uint8_t*)&(iter->first);
+}
+
+// find key in std::unordered_map of Type.
+template<typename Type>
+static const uint8_t *MapFind(const void *map, const void *key)
+{
+	typedef typename Type::key_type Key;
+	auto &values = *static_cast<const Type*>(map);
+	auto iter = values.find(*static_cast<const Key*>(key));
+	return iter != values.end() ? (const uint8_t*)&(iter->first) : nullptr;
+}
+
+// reserve buckets of std::unordered_map of Type.
+template<typename Type>
+static void MapReserve(void *map, size_t count)
+{
+	static_cast<Type*>(map)->reserve(count);
+}
+
+// erase key from map of Type, the node is freed with the size of pair of op
+// by CPS_MAP_NODES.
+template<typename Type, bool Hash>
+static void MapErase(const Op &op, void *map, const void *key)
+{
+	typedef typename Type::key_type Key;
+	auto &values = *static_cast<Type*>(map);
+	NodeScope scope(Hash ? HashPairSize<Key>(op) : op.plan->size());
+	values.erase(*static_cast<const Key*>(key));
+}
+
+// destroy map of Type, the nodes are freed with the size of pair of op by
+// CPS_MAP_NODES.
+template<typename Type, bool Hash>
+static void MapDestroy(const Op &op, void *map)
+{
+	typedef typename Type::key_type Key;
+	NodeScope scope(Hash ? HashPairSize<Key>(op) : op.plan->size());
+	static_cast<Type*>(map)->~Type();
+}
+
+// sort the keys of std::vector<std::pair<Key, Value>>, the keys are moved to
+// their sorted positions, and the values are not moved.
+template<typename Key>
+static bool SortKeys(uint8_t *data, size_t count, size_t step,
+	std::vector<size_t> &order)
+{
+	auto key = [=](size_t i) -> Key& {
+		return *reinterpret_cast<Key*>(data + i * step);
+	};
+	order.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return key(a) < key(b);
+	});
+	for (size_t i = 1; i < count; ++i) {
+		if (!(key(order[i - 1]) < key(order[i]))) {
+			Probe::Fail(FAILURE_DUPLICATED_KEY);
+			return false;
+		}
+	}
+	std::vector<Key> keys;
+	keys.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		keys.push_back(std::move(key(order[i])));
+	}
+	for (size_t i = 0; i < count; ++i) {
+		key(i) = std::move(keys[i]);
+	}
+	return true;
+}
+
+// bind the map functions of op for std::map<Key, Value> or
+// std::unordered_map<Key, Value> of containers C.
+template<typename C, typename Key, typename Value>
+static void BindMapOf(Op &op)
+{
+	typedef NodeMaps<C, Key, Value> Maps;
+	if (op.maps == MAP_HASH) {
+		typedef typename Maps::template HashMap<NodeHash<Key>> Type;
+		op.emplace = &HashEmplace<Type>;
+		op.erase = &MapErase<Type, true>;
+		op.destroy = &MapDestroy<Type, true>;
+		op.find = &MapFind<Type>;
+		op.reserve = &MapReserve<Type>;
+		return;
+	}
+	typedef typename Maps::Map Type;
+	op.emplace = &MapEmplace<Type>;
+	op.erase = &MapErase<Type, false>;
+	op.destroy = &MapDestroy<Type, false>;
+}
+
+// bind the sort function of op for the sorted vector, by key type.
+template<typename C>
+static void BindSortedMap(const FieldDescriptor *key, Op &op)
+{
+	switch (key->cpp_type()) {
+	case FieldDescriptor::CPPTYPE_INT32:
+		op.sort = &SortKeys<int32_t>;
+		break;
+	case FieldDescriptor::CPPTYPE_INT64:
+		op.sort = &SortKeys<int64_t>;
+		break;
+	case FieldDescriptor::CPPTYPE_UINT32:
+		op.sort = &SortKeys<uint32_t>;
+		break;
+	case FieldDescriptor::CPPTYPE_UINT64:
+		op.sort = &SortKeys<uint64_t>;
+		break;
+	case FieldDescriptor::CPPTYPE_STRING:
+		op.sort = &SortKeys<typename C::String>;
+		break;
+	default:
+		break; // should never reached!
+	}
+}
+
+template<typename C, typename Value>
+static void BindMapOf(const FieldDescriptor *key, Op &op)
+{
+	switch (key->cpp_type()) {
+	case FieldDescriptor::CPPTYPE_INT32:
+		return BindMapOf<C, int32_t, Value>(op);
+	case FieldDescriptor::CPPTYPE_INT64:
+		return BindMapOf<C, int64_t, Value>(op);
+	case FieldDescriptor::CPPTYPE_UINT32:
+		return BindMapOf<C, uint32_t, Value>(op);
+	case FieldDescriptor::CPPTYPE_UINT64:
+		return BindMapOf<C, uint64_t, Value>(op);
+	case FieldDescriptor::CPPTYPE_STRING:
+		return BindMapOf<C, typename C::String, Value>(op);
+	default:
+		// protobuf support (u)int32/(u)int64/string as key,
+		// the key is align as 4 or 8 bytes.
+		return; // should never reached!
+	}
+}
+
+#define IF_MAP_EMPLACE(Size, Align) \
+if (size <= Size) \
+	return BindMapOf<C, ValueType<Size, Align>>(key, op);
+
+// bind the map functions of op, by key type and sizeof value.
+template<typename C>
+static void BindMap(Op &op)
+{
+	// entry is std::pair<key, value>
+	auto &entry = *op.plan;
+	if (entry.ops().size() != 2) {
+		// map should have 2 field.
+		return; // should never reached!
+	}
+	auto key = entry.ops()[0].field;
+	if (op.maps == MAP_SORTED) {
+		// the pairs are in vector, any size of value is supported.
+		return BindSortedMap<C>(key, op);
+	}
+#ifdef CPS_MAP_NODES
+	// the nodes have the size of the real ones, any size of value is
+	// supported.
+	return BindMapOf<C, uint64_t>(key, op);
+#else
+	int size = entry.size() - entry.ops()[1].offset;
+	if (op.maps == MAP_HASH &&
+		key->cpp_type() == FieldDescriptor::CPPTYPE_STRING &&
+		HashCached<typename C::String>()) {
+		size += sizeof(size_t); // the hash code cached after value
+	}
+	switch (entry.align()) {
+	case 4:
+		IF_MAP_EMPLACE(0x008, 4)
+		IF_MAP_EMPLACE(0x010, 4)
+		IF_MAP_EMPLACE(0x020, 4)
+		IF_MAP_EMPLACE(0x040, 4)
+		IF_MAP_EMPLACE(0x080, 4)
+		IF_MAP_EMPLACE(0x100, 4)
+		IF_MAP_EMPLACE(0x200, 4)
+		IF_MAP_EMPLACE(0x400, 4)
+		IF_MAP_EMPLACE(0x800, 4)
+		break;
+	case 8:
+		IF_MAP_EMPLACE(0x008, 8)
+		IF_MAP_EMPLACE(0x010, 8)
+		IF_MAP_EMPLACE(0x020, 8)
+		IF_MAP_EMPLACE(0x040, 8)
+		IF_MAP_EMPLACE(0x080, 8)
+		IF_MAP_EMPLACE(0x100, 8)
+		IF_MAP_EMPLACE(0x200, 8)
+		IF_MAP_EMPLACE(0x400, 8)
+		IF_MAP_EMPLACE(0x800, 8)
+		break;
+	default:
+		// the alignof map pair is 4 or 8 bytes.
+		return; // should never reached!
+	}
+	// The struct is too big, max sizeof struct is 0x800;
+#endif
+}
+
+#undef IF_MAP_EMPLACE
+
+// ==================== convert struct to protobuf message ====================
+
+// protobuf does not provide generic template function, so we wrap it.
+template<typename Ty>
+inline void ProtoSet(const Ty &value, Message &msg,
+	const Reflection *refl, const FieldDescriptor *field)
+{
+}
+
+#define SPECIAL_TEMPLATE_ProtoSet(type, Type) \
+template<> \
+inline void ProtoSet<type>(const type &value, Message &msg, \
+	const Reflection *refl, const FieldDescriptor *field) { \
+	return refl->Set ## Type(&msg, field, value); \
+}
+
+SPECIAL_TEMPLATE_ProtoSet(int32_t, Int32)
+SPECIAL_TEMPLATE_ProtoSet(int64_t, Int64)
+SPECIAL_TEMPLATE_ProtoSet(uint32_t, UInt32)
+SPECIAL_TEMPLATE_ProtoSet(uint64_t, UInt64)
+SPECIAL_TEMPLATE_ProtoSet(float, Float)
+SPECIAL_TEMPLATE_ProtoSet(double, Double)
+SPECIAL_TEMPLATE_ProtoSet(bool, Bool)
+SPECIAL_TEMPLATE_ProtoSet(Enum, EnumValue)
+SPECIAL_TEMPLATE_ProtoSet(std::string, String)
+
+template<typename Ty>
+inline void ProtoAdd(const Ty &value, Message &msg,
+	const Reflection *refl, const FieldDescriptor *field)
+{
+}
+
+#define SPECIAL_TEMPLATE_ProtoAdd(type, Type) \
+template<> \
+inline void ProtoAdd<type>(const type &value, Message &msg, \
+	const Reflection *refl, const FieldDescriptor *field) { \
+	return refl->Add ## Type(&msg, field, value); \
+}
+
+SPECIAL_TEMPLATE_ProtoAdd(int32_t, Int32)
+SPECIAL_TEMPLATE_ProtoAdd(int64_t, Int64)
+SPECIAL_TEMPLATE_ProtoAdd(uint32_t, UInt32)
+SPECIAL_TEMPLATE_ProtoAdd(uint64_t, UInt64)
+SPECIAL_TEMPLATE_ProtoAdd(float, Float)
+SPECIAL_TEMPLATE_ProtoAdd(double, Double)
+SPECIAL_TEMPLATE_ProtoAdd(bool, Bool)
+SPECIAL_TEMPLATE_ProtoAdd(Enum, EnumValue)
+SPECIAL_TEMPLATE_ProtoAdd(std::string, String)
+
+// get RepeatedField of arithmetic field, to copy elements in bulk. enum is
+// accessed as int32. the RepeatedFieldRef is recommended by protobuf, but it
+// does not expose the contiguous data.
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable: 4996)
+#else
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+
+template<typename Ty>
+inline google::protobuf::RepeatedField<Ty> *ProtoMutableRepeated(Message &msg,
+	const Reflection *refl, const FieldDescriptor *field)
+{
+	return refl->MutableRepeatedField<Ty>(&msg, field);
+}
+
+template<typename Ty>
+inline const google::protobuf::RepeatedField<Ty> &ProtoRepeated(
+	const Message &msg, const Reflection *refl, const FieldDescriptor *field)
+{
+	return refl->GetRepeatedField<Ty>(msg, field);
+}
+
+template<typename Ty>
+inline const google::protobuf::RepeatedPtrField<Ty> &ProtoRepeatedPtr(
+	const Message &msg, const Reflection *refl, const FieldDescriptor *field)
+{
+	return refl->GetRepeatedPtrField<Ty>(msg, field);
+}
+
+template<typename Ty>
+inline google::protobuf::RepeatedPtrField<Ty> *ProtoMutableRepeatedPtr(
+	Message &msg, const Reflection *refl, const FieldDescriptor *field)
+{
+	return refl->MutableRepeatedPtrField<Ty>(&msg, field);
+}
+
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#else
+#pragma GCC diagnostic pop
+#endif
+
+// end of wrap protobuf SetXxx function
+
+// get string of struct for protobuf message, moved if move.
+inline std::string TakeString(const std::string &value, bool move)
+{
+	if (move) {
+		return std::move(const_cast<std::string&>(value));
+	}
+	return value;
+}
+
+#ifdef CPS_MEMORY_RESOURCE
+// the allocator is different from protobuf, std::pmr::string is copied.
+inline std::string TakeString(const std::pmr::string &value, bool)
+{
+	return std::string(value.data(), value.size());
+}
+#endif
+
+#ifdef CPS_STRING_VIEW
+// the viewed string is not owned, copied.
+inline std::string TakeString(std::string_view value, bool)
+{
+	return std::string(value);
+}
+#endif
+
+// options of conversion, shared by the readers or writers of nested messages.
+struct Options
+{
+	bool move; // the source is rvalue, move strings
+	bool sparse; // convert only the present fields of message
+	bool overwrite; // overwrite the struct, reuse the existing members
+	const Parallel *parallel; // options of parallel conversion, or null
+	MemoryResource *resource; // resource of std::pmr containers, or null
+	Options() : move(false), sparse(false), overwrite(false),
+		parallel(nullptr), resource(nullptr) {}
+	// the same options, but never convert concurrently.
+	Options serial() const
+	{
+		Options options = *this;
+		options.parallel = nullptr;
+		return options;
+	}
+	static const Options &Default()
+	{
+		static const Options options;
+		return options;
+	}
+};
+
+// read member value from struct and set to protobuf message.
+class  StructReader
+{
+private:
+	friend class Plan;
+	typedef bool (StructReader::*Converter)(const Op &op);
+	const Plan &_plan; // plan of struct
+	const uint8_t *_bytes; // the memory of struct
+	Message &_msg; // protobuf message
+	const Reflection *_refl; // protobuf message reflection
+	const Options &_options; // options of conversion
+	const Selection *_selection; // the selected fields, or null for all
+public:
+	StructReader(const Plan &plan, Message &msg, const uint8_t *bytes,
+		const Options &options = Options::Default(),
+		const Selection *selection = nullptr)
+		: _plan(plan)
+		, _bytes(bytes)
+		, _msg(msg)
+		, _refl(msg.GetReflection())
+		, _options(options)
+		, _selection(selection) {}
+
+	// convert to protobuf message, run all operations of plan.
+	inline bool to_proto()
+	{
+		if (_selection != nullptr) {
+			return to_proto_selected();
+		}
+		for (auto &op : _plan.ops()) {
+			if (!(this->*op.to_proto)(op)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// convert the members different from prev, the message is converted
+	// from prev before.
+	// @param[in] prev: the struct converted to message before
+	// @param[in,out] path: path of this message, the changed paths are
+	// added to mask.
+	// @param[out] mask: the changed fields, or null
+	bool to_proto_delta(const uint8_t *prev, std::string &path,
+		FieldMask *mask);
+
+private:
+	// get converter of op, with containers C.
+	template<typename C>
+	static Converter converter(const Op &op);
+
+	// convert the selected members only.
+	inline bool to_proto_selected()
+	{
+		for (auto op : _selection->ops()) {
+			if (!(this->*op->to_proto)(*op)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// the selected fields of struct member, or null for all.
+	inline const Selection *select(const Op &op) const
+	{
+		return _selection != nullptr ? _selection->child(op) : nullptr;
+	}
+
+	// read a member from struct
+	template<typename Ty>
+	const Ty &read_member(const Op &op)
+	{
+		return *(const Ty*)(_bytes + op.offset);
+	}
+
+	// the field can not be converted.
+	bool unsupported(const Op&)
+	{
+		return false;
+	}
+
+	// set value to protobuf message
+	template<typename Ty>
+	bool set_proto_value(const Op &op)
+	{
+		ProtoSet<Ty>(read_member<Ty>(op), _msg, _refl, op.field);
+		return true;
+	}
+
+	// add values in vector to protobuf repeated field
+	template<typename Ty>
+	bool add_proto_values(const Op &op)
+	{
+		auto &values = read_member<std::vector<Ty>>(op);
+		Probe::CountElements(values.size());
+		for (const Ty &value : values) {
+			ProtoAdd<Ty>(value, _msg, _refl, op.field);
+		}
+		return true;
+	}
+
+	// set string to protobuf message, moved if the struct is rvalue.
+	template<typename C>
+	bool set_proto_string(const Op &op)
+	{
+		auto &value = read_member<typename C::String>(op);
+		Probe::CountBytes(value.size());
+		_refl->SetString(&_msg, op.field, TakeString(value, _options.move));
+		return true;
+	}
+
+	// add strings in vector to protobuf repeated field, moved if the
+	// struct is rvalue.
+	template<typename C>
+	bool add_proto_strings(const Op &op)
+	{
+		typedef typename C::template Vector<typename C::String> Strings;
+		auto &values = read_member<Strings>(op);
+		Probe::CountElements(values.size());
+		for (auto &value : values) {
+			Probe::CountBytes(value.size());
+			_refl->AddString(&_msg, op.field,
+				TakeString(value, _options.move));
+		}
+		return true;
+	}
+
+	// set protobuf repeated field from vector in bulk, the arithmetic
+	// elements are reserved once and copied by memory.
+	template<typename Ty, typename C>
+	bool copy_proto_values(const Op &op)
+	{
+		auto &values = read_member<typename C::template Vector<Ty>>(op);
+		auto repeated = ProtoMutableRepeated<Ty>(_msg, _refl, op.field);
+		Probe::CountElements(values.size());
+		repeated->Add(values.begin(), values.end());
+		return true;
+	}
+
+	// set protobuf message value
+	bool set_proto_message(const Op &op)
+	{
+		auto submsg = _refl->MutableMessage(&_msg, op.field);
+		StructReader reader(*op.plan, *submsg, _bytes + op.offset, _options,
+			select(op));
+		return reader.to_proto();
+	}
+
+	// set protobuf repeated message from vector
+	bool add_proto_messages(const Op &op);
+
+	// update the changed elements of repeated message, the count of
+	// elements is not changed.
+	bool delta_proto_messages(const Op &op, const Bytes &before,
+		const Bytes &after);
+
+	// set protobuf repeated message from vector concurrently
+	bool add_proto_messages(const Op &op, const uint8_t *data, int count);
+
+	// set protobuf map message, Ty has the same alignment as the pair.
+	template<typename Ty, typename C>
+	bool set_proto_map(const Op &op)
+	{
+		return ForEachPair<Ty, C>(op, _bytes + op.offset, [&](uint8_t *pair) {
+			Probe::CountElements(1);
+			auto submsg = _refl->AddMessage(&_msg, op.field);
+			// the key of map is moved too, the map should be destroyed.
+			StructReader reader(*op.plan, *submsg, pair, _options);
+			return reader.to_proto();
+		});
+	}
+};
+
+bool StructReader::to_proto_delta(const uint8_t *prev, std::string &path,
+	FieldMask *mask)
+{
+	for (auto &op : _plan.ops()) {
+		if (EqualMember(op, prev, _bytes)) {
+			continue;
+		}
+		size_t length = path.size();
+		path += op.field->name();
+		if (op.kind == Op::KIND_MESSAGE) {
+			// only the changed members of struct are added to mask.
+			path += '.';
+			auto submsg = _refl->MutableMessage(&_msg, op.field);
+			StructReader reader(*op.plan, *submsg, _bytes + op.offset,
+				_options);
+			if (!reader.to_proto_delta(prev + op.offset, path, mask)) {
+				return false;
+			}
+			path.resize(length);
+			continue;
+		}
+		if (mask != nullptr) {
+			mask->add_paths(path);
+		}
+		path.resize(length);
+		if (op.kind == Op::KIND_REPEATED_MESSAGE) {
+			auto before = VectorBytes(op, prev + op.offset);
+			auto after = VectorBytes(op, _bytes + op.offset);
+			if (before.size == after.size) {
+				// the field is in mask, the elements are updated one by one.
+				if (!delta_proto_messages(op, before, after)) {
+					return false;
+				}
+				continue;
+			}
+		}
+		// the containers are converted again, the values are set.
+		if (op.kind != Op::KIND_VALUE) {
+			_refl->ClearField(&_msg, op.field);
+		}
+		if (!(this->*op.to_proto)(op)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool StructReader::delta_proto_messages(const Op &op, const Bytes &before,
+	const Bytes &after)
+{
+	auto repeated = ProtoMutableRepeatedPtr<Message>(_msg, _refl, op.field);
+	std::string path;
+	size_t step = op.plan->size();
+	for (size_t i = 0; i < after.size; i += step) {
+		if (EqualStruct(*op.plan, before.data + i, after.data + i)) {
+			continue;
+		}
+		auto submsg = repeated->Mutable(static_cast<int>(i / step));
+		StructReader reader(*op.plan, *submsg, after.data + i, _options);
+		if (!reader.to_proto_delta(before.data + i, path, nullptr)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool StructReader::add_proto_messages(const Op &op)
+{
+	auto &info = *op.plan;
+	auto values = VectorBytes(op, _bytes + op.offset);
+	const uint8_t *data = values.data;
+	if (values.size % info.size()) {
+		// The element in vector has difference size?
+		return false; // should never reached!
+	}
+	int count = static_cast<int>(values.size / info.size());
+	Probe::CountElements(count);
+	if (_options.parallel != nullptr &&
+		static_cast<size_t>(count) >= _options.parallel->threshold) {
+		return add_proto_messages(op, data, count);
+	}
+	for (int i = 0; i < count; ++i) {
+		auto submsg = _refl->AddMessage(&_msg, op.field);
+		StructReader reader(info, *submsg, data, _options, select(op));
+		if (!reader.to_proto()) {
+			return false;
+		}
+		data += info.size(); // point to next member
+	}
+	return true;
+}
+
+bool StructReader::add_proto_messages(const Op &op, const uint8_t *data,
+	int count)
+{
+	// add all messages first, then convert the elements concurrently.
+	auto &info = *op.plan;
+	auto repeated = ProtoMutableRepeatedPtr<Message>(_msg, _refl, op.field);
+	int base = repeated->size();
+	repeated->Reserve(base + count);
+	for (int i = 0; i < count; ++i) {
+		_refl->AddMessage(&_msg, op.field);
+	}
+	std::atomic<bool> failed(false);
+	auto &parallel = *_options.parallel;
+	auto pool = parallel.pool ? parallel.pool : &ThreadPool::Default();
+	Options serial = _options.serial();
+	pool->parallel_for(count, parallel.grain, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end && !failed; ++i) {
+			auto submsg = repeated->Mutable(base + static_cast<int>(i));
+			StructReader reader(info, *submsg, data + i * info.size(), serial,
+				select(op));
+			if (!reader.to_proto()) {
+				failed = true;
+			}
+		}
+	});
+	return !failed;
+}
+
+#define CASE_CONVERTER(TYPE, type, function) \
+case FieldDescriptor::CPPTYPE_ ## TYPE: \
+	return &StructReader::function<type>;
+
+#define CASE_CONTAINER_CONVERTER(TYPE, type, function) \
+case FieldDescriptor::CPPTYPE_ ## TYPE: \
+	return &StructReader::function<type, C>;
+
+template<typename C>
+StructReader::Converter StructReader::converter(const Op &op)
+{
+	switch (op.kind) {
+	case Op::KIND_VALUE:
+		switch (op.cpp_type) {
+		CASE_CONVERTER(INT32, int32_t, set_proto_value)
+		CASE_CONVERTER(INT64, int64_t, set_proto_value)
+		CASE_CONVERTER(UINT32, uint32_t, set_proto_value)
+		CASE_CONVERTER(UINT64, uint64_t, set_proto_value)
+		CASE_CONVERTER(DOUBLE, double, set_proto_value)
+		CASE_CONVERTER(FLOAT, float, set_proto_value)
+		CASE_CONVERTER(BOOL, bool, set_proto_value)
+		CASE_CONVERTER(ENUM, Enum, set_proto_value)
+		case FieldDescriptor::CPPTYPE_STRING:
+			return &StructReader::set_proto_string<C>;
+		default:
+			return &StructReader::unsupported; // never reached!
+		}
+	case Op::KIND_REPEATED:
+		switch (op.cpp_type) {
+		CASE_CONTAINER_CONVERTER(INT32, int32_t, copy_proto_values)
+		CASE_CONTAINER_CONVERTER(INT64, int64_t, copy_proto_values)
+		CASE_CONTAINER_CONVERTER(UINT32, uint32_t, copy_proto_values)
+		CASE_CONTAINER_CONVERTER(UINT64, uint64_t, copy_proto_values)
+		CASE_CONTAINER_CONVERTER(DOUBLE, double, copy_proto_values)
+		CASE_CONTAINER_CONVERTER(FLOAT, float, copy_proto_values)
+		CASE_CONTAINER_CONVERTER(BOOL, bool, copy_proto_values)
+		// enum is same as int32 in memory.
+		CASE_CONTAINER_CONVERTER(ENUM, int32_t, copy_proto_values)
+		case FieldDescriptor::CPPTYPE_STRING:
+			return &StructReader::add_proto_strings<C>;
+		default:
+			return &StructReader::unsupported; // never reached!
+		}
+	case Op::KIND_MESSAGE:
+		return &StructReader::set_proto_message;
+	case Op::KIND_REPEATED_MESSAGE:
+		return &StructReader::add_proto_messages;
+	case Op::KIND_MAP:
+		if (op.plan->ops().size() != 2) {
+			// map should have 2 field.
+			return &StructReader::unsupported; // never reached!
+		}
+		// protobuf support (u)int32/(u)int64/string as key,
+		// the key is align as 4 or 8 bytes.
+		switch (op.plan->align()) {
+		case 4:
+			return &StructReader::set_proto_map<int32_t, C>;
+		case 8:
+			return &StructReader::set_proto_map<int64_t, C>;
+		default:
+			return &StructReader::unsupported; // never reached!
+		}
+	default:
+		return &StructReader::unsupported; // never reached!
+	}
+}
+
+#undef CASE_CONVERTER
+#undef CASE_CONTAINER_CONVERTER
+
+// @brief Convert struct to protobuf message with compiled plan.
+// @param[in] plan: plan compiled from descriptor of msg
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[out] msg: protobuf message
+// @return true for success, or false for failed.
+bool StructToProto(const Plan &plan, const void *bytes, size_t size,
+	Message &msg)
+{
+	Probe probe(plan.descriptor(), DIRECTION_TO_PROTO);
+	if (plan.descriptor() != msg.GetDescriptor()) {
+		// plan is not compiled for this message
+		return probe.fail(FAILURE_DESCRIPTOR);
+	}
+	if (plan.size() != static_cast<int>(size)) {
+		// protobuf message is not match struct
+		return probe.fail(FAILURE_SIZE);
+	}
+	StructReader reader(plan, msg, static_cast<const uint8_t*>(bytes));
+	return probe.done(reader.to_proto());
+}
+
+// @brief Convert struct to protobuf message.
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[out] msg: protobuf message
+// @return true for success, or false for failed.
+bool StructToProto(const void *bytes, size_t size, Message &msg)
+{
+	return StructToProto(Plan::Get(msg.GetDescriptor()), bytes, size, msg);
+}
+
+// @brief Convert the members changed from prev to protobuf message.
+// @param[in] plan: plan compiled from descriptor of msg
+// @param[in] prev: pointer to struct, converted to msg before
+// @param[in] cur: pointer to struct
+// @param[in] size: sizeof struct
+// @param[in,out] msg: protobuf message converted from prev
+// @param[out] mask: the changed fields, or null
+// @return true for success, or false for failed.
+bool StructDeltaToProto(const Plan &plan, const void *prev, const void *cur,
+	size_t size, Message &msg, FieldMask *mask)
+{
+	Probe probe(plan.descriptor(), DIRECTION_TO_PROTO);
+	if (plan.descriptor() != msg.GetDescriptor()) {
+		// plan is not compiled for this message
+		return probe.fail(FAILURE_DESCRIPTOR);
+	}
+	if (plan.size() != static_cast<int>(size)) {
+		// protobuf message is not match struct
+		return probe.fail(FAILURE_SIZE);
+	}
+	if (mask != nullptr) {
+		mask->Clear();
+	}
+	std::string path;
+	StructReader reader(plan, msg, static_cast<const uint8_t*>(cur));
+	return probe.done(reader.to_proto_delta(
+		static_cast<const uint8_t*>(prev), path, mask));
+}
+
+// @brief Convert the members changed from prev to protobuf message.
+// @param[in] prev: pointer to struct, converted to msg before
+// @param[in] cur: pointer to struct
+// @param[in] size: sizeof struct
+// @param[in,out] msg: protobuf message converted from prev
+// @param[out] mask: the changed fields, or null
+// @return true for success, or false for failed.
+bool StructDeltaToProto(const void *prev, const void *cur, size_t size,
+	Message &msg, FieldMask *mask)
+{
+	return StructDeltaToProto(Plan::Get(msg.GetDescriptor()), prev, cur, size,
+		msg, mask);
+}
+
+// @brief Convert struct to protobuf message, move strings of struct to msg.
+// @param[in,out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[out] msg: protobuf message
+// @return true for success, or false for failed.
+bool MoveStructToProto(void *bytes, size_t size, Message &msg)
+{
+	auto &plan = Plan::Get(msg.GetDescriptor());
+	Probe probe(plan.descriptor(), DIRECTION_TO_PROTO);
+	if (plan.size() != static_cast<int>(size)) {
+		// protobuf message is not match struct
+		return probe.fail(FAILURE_SIZE);
+	}
+	Options options;
+	options.move = true;
+	StructReader reader(plan, msg, static_cast<const uint8_t*>(bytes), options);
+	return probe.done(reader.to_proto());
+}
+
+// @brief Convert struct to a new protobuf message allocated on arena.
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[in] prototype: any message of the type, e.g. default instance
+// @param[in] arena: arena of the new message, or null for heap
+// @return the new message, or null for failed.
+Message *StructToProto(const void *bytes, size_t size,
+	const Message &prototype, google::protobuf::Arena *arena)
+{
+	Message *msg = prototype.New(arena);
+	if (!StructToProto(bytes, size, *msg)) {
+		if (arena == nullptr) {
+			delete msg; // the message on arena is freed with arena
+		}
+		return nullptr;
+	}
+	return msg;
+}
+
+// ==================== convert protobuf message to struct ====================
+
+// protobuf does not provide generic template function, so we wrap it.
+template<typename Ty>
+inline Ty ProtoGet(const Message &msg,
+	const Reflection *refl, const FieldDescriptor *field)
+{
+}
+
+#define SPECIAL_TEMPLATE_ProtoGet(type, Type) \
+template<> \
+inline type ProtoGet<type>(const Message &msg, \
+	const Reflection *refl, const FieldDescriptor *field) { \
+	return refl->Get ## Type(msg, field); \
+}
+
+SPECIAL_TEMPLATE_ProtoGet(int32_t, Int32)
+SPECIAL_TEMPLATE_ProtoGet(int64_t, Int64)
+SPECIAL_TEMPLATE_ProtoGet(uint32_t, UInt32)
+SPECIAL_TEMPLATE_ProtoGet(uint64_t, UInt64)
+SPECIAL_TEMPLATE_ProtoGet(float, Float)
+SPECIAL_TEMPLATE_ProtoGet(double, Double)
+SPECIAL_TEMPLATE_ProtoGet(bool, Bool)
+SPECIAL_TEMPLATE_ProtoGet(Enum, EnumValue)
+SPECIAL_TEMPLATE_ProtoGet(std::string, String)
+
+template<typename Ty>
+inline Ty ProtoGet(const Message &msg,
+	const Reflection *refl, const FieldDescriptor *field, int index)
+{
+}
+
+#define SPECIAL_TEMPLATE_ProtoGetRepeated(type, Type) \
+template<> \
+inline type ProtoGet<type>(const Message &msg, \
+	const Reflection *refl, const FieldDescriptor *field, int index) { \
+	return refl->GetRepeated ## Type(msg, field, index); \
+}
+
+SPECIAL_TEMPLATE_ProtoGetRepeated(int32_t, Int32)
+SPECIAL_TEMPLATE_ProtoGetRepeated(int64_t, Int64)
+SPECIAL_TEMPLATE_ProtoGetRepeated(uint32_t, UInt32)
+SPECIAL_TEMPLATE_ProtoGetRepeated(uint64_t, UInt64)
+SPECIAL_TEMPLATE_ProtoGetRepeated(float, Float)
+SPECIAL_TEMPLATE_ProtoGetRepeated(double, Double)
 SPECIAL_TEMPLATE_ProtoGetRepeated(bool, Bool)
 SPECIAL_TEMPLATE_ProtoGetRepeated(Enum, EnumValue)
 SPECIAL_TEMPLATE_ProtoGetRepeated(std::string, String)
 
 // end of wrap protobuf GetXxx function
 
+// the pairs of protobuf map field, read from the repeated entry messages,
+// whose strings are stable to be viewed.
+class EntryMessages
+{
+private:
+	const Message &_msg;
+	const Reflection *_refl;
+	const FieldDescriptor *_field;
+	int _size;
+	int _index;
+public:
+	// the entry message of pair, to be read after the others.
+	typedef const Message *Mark;
+
+	EntryMessages(const Message &msg, const Reflection *refl,
+		const FieldDescriptor *field)
+		: _msg(msg), _refl(refl), _field(field)
+		, _size(refl->FieldSize(msg, field)), _index(-1) {}
+
+	// get count of pairs.
+	inline int size() const { return _size; }
+	// move to the next pair, or the first one at first time.
+	// @return false if no more pair.
+	inline bool next() { return ++_index < _size; }
+	// get entry message of current pair.
+	inline Mark mark()
+	{
+		return &_refl->GetRepeatedMessage(_msg, _field, _index);
+	}
+};
+
 // get member value from protobuf message and write to struct.
-class StructWriter : public StructInfo
+class StructWriter
 {
 private:
+	friend class Plan;
+	typedef bool (StructWriter::*Converter)(const Op &op);
 	bool _placement; // need placement new
-	int _pos; // read position
+	const Plan &_plan; // plan of struct
 	uint8_t *_bytes; // the memory of struct
 	const Message &_msg; // protobuf message
 	const Reflection *_refl; // protobuf message reflection
+	const Options &_options; // options of conversion
+	const Selection *_selection; // the selected fields, or null for all
 public:
-	StructWriter(const Message &msg, uint8_t *bytes)
-		: StructInfo(msg.GetDescriptor())
-		, _placement(false)
-		, _pos(0)
+	StructWriter(const Plan &plan, const Message &msg, uint8_t *bytes,
+		bool placement = false, const Options &options = Options::Default(),
+		const Selection *selection = nullptr)
+		: _placement(placement)
+		, _plan(plan)
 		, _bytes(bytes)
 		, _msg(msg)
-		, _refl(msg.GetReflection()) {}
-	// convert from protobuf message
-	bool from_proto();
+		, _refl(msg.GetReflection())
+		, _options(options)
+		, _selection(selection) {}
+
+	// convert from protobuf message, run all operations of plan.
+	inline bool from_proto()
+	{
+		if (_selection != nullptr) {
+			return from_proto_selected();
+		}
+		if (_options.sparse) {
+			return from_proto_sparse();
+		}
+		for (auto &op : _plan.ops()) {
+			if (!(this->*op.from_proto)(op)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
 private:
-	// read a member from struct
-	template<typename Ty>
-	Ty &read_member()
+	// get converter of op, with containers C.
+	template<typename C>
+	static Converter converter(const Op &op);
+
+	// convert only the present fields, the other members are defaulted.
+	bool from_proto_sparse();
+
+	// convert the selected members only, the others are not changed, or
+	// constructed with default value if placement.
+	bool from_proto_selected();
+
+	// the selected fields of struct member, or null for all.
+	inline const Selection *select(const Op &op) const
+	{
+		return _selection != nullptr ? _selection->child(op) : nullptr;
+	}
+
+	// the existing members are overwritten and reused.
+	inline bool overwrite() const
+	{
+		return _options.overwrite && !_placement;
+	}
+
+	// read a member from struct, the container is constructed by C.
+	template<typename Ty, typename C = StdContainers>
+	Ty &read_member(const Op &op)
 	{
-		int remain = _align - _pos % _align;
-		_pos += remain % alignof(Ty);
-		uint8_t *data = _bytes + _pos;
-		_pos += sizeof(Ty);
-		Ty *result = _placement ? new(data)Ty : (Ty*)data;
+		uint8_t *data = _bytes + op.offset;
+		Ty *result = _placement
+			? C::template New<Ty>(data, _options.resource) : (Ty*)data;
 		return *result;
 	}
 
-	// read a struct member from struct
-	StructWriter child_writer(const Message &msg)
+	// read a vector member of structs from struct, resized with the
+	// alignment of struct.
+	template<typename C>
+	UnitVector<C> read_vector(const Op &op)
+	{
+		read_member<typename C::template Vector<uint8_t>, C>(op);
+		return UnitVector<C>(_bytes + op.offset, op.plan->align());
+	}
+
+	// the field can not be converted.
+	bool unsupported(const Op&)
 	{
-		StructWriter writer(msg, nullptr);
-		int remain = _align - _pos % _align;
-		_pos += remain % writer._align;
-		writer._bytes = _bytes + _pos;
-		_pos += writer._size;
-		writer._placement = _placement;
-		return writer;
+		return false;
 	}
 
 	// set member value from protobuf message
 	template<typename Ty>
-	bool set_struct_value(const FieldDescriptor *field)
+	bool set_struct_value(const Op &op)
 	{
-		if (field->is_repeated()) {
-			auto &values = read_member<std::vector<Ty>>();
-			int count = _refl->FieldSize(_msg, field);
-			for (int i = 0; i < count; ++i) {
-				Ty value = ProtoGet<Ty>(_msg, _refl, field, i);
-				values.push_back(value);
+		auto &value = read_member<Ty>(op);
+		value = ProtoGet<Ty>(_msg, _refl, op.field);
+		return true;
+	}
+
+	// set string member from protobuf message, stolen if the message is
+	// rvalue and owns the string.
+	template<typename C>
+	bool set_struct_string(const Op &op)
+	{
+		auto &value = read_member<typename C::String, C>(op);
+		if (!assign_string(op, value)) {
+			return false;
+		}
+		Probe::CountBytes(value.size());
+		return true;
+	}
+
+	// set std::string from protobuf message.
+	bool assign_string(const Op &op, std::string &value)
+	{
+		if (!_options.move) {
+			// copied to the existing buffer of value.
+			auto &source = _refl->GetStringReference(_msg, op.field, &value);
+			if (&source != &value) {
+				value = source;
+			}
+			return true;
+		}
+		auto &source = _refl->GetStringReference(_msg, op.field, &value);
+		if (&source == &value) {
+			return true; // not stored as std::string, copied to value
+		}
+		// the unset field may reference the default value, never steal it.
+		bool owned = op.presence ? _refl->HasField(_msg, op.field)
+			: !source.empty();
+		if (owned) {
+			value = std::move(const_cast<std::string&>(source));
+		} else {
+			value = source;
+		}
+		return true;
+	}
+
+#ifdef CPS_MEMORY_RESOURCE
+	// set std::pmr::string from protobuf message, always copied to the
+	// buffer allocated from its resource.
+	bool assign_string(const Op &op, std::pmr::string &value)
+	{
+		std::string scratch;
+		auto &source = _refl->GetStringReference(_msg, op.field, &scratch);
+		PmrContainers::Assign(value, source);
+		return true;
+	}
+#endif
+
+#ifdef CPS_STRING_VIEW
+	// view the string stored in protobuf message.
+	bool assign_string(const Op &op, std::string_view &value)
+	{
+		std::string scratch;
+		auto &source = _refl->GetStringReference(_msg, op.field, &scratch);
+		if (&source == &scratch) {
+			// not stored as std::string, can not be viewed
+			Probe::Fail(FAILURE_VIEW);
+			return false;
+		}
+		value = source;
+		return true;
+	}
+#endif
+
+	// add protobuf repeated strings to vector, stolen if the message is
+	// rvalue.
+	template<typename C>
+	bool add_struct_strings(const Op &op)
+	{
+		typedef typename C::template Vector<typename C::String> Strings;
+		auto &values = read_member<Strings, C>(op);
+		auto &repeated = ProtoRepeatedPtr<std::string>(_msg, _refl, op.field);
+		Probe::CountElements(repeated.size());
+		if (overwrite() && !_options.move) {
+			// the existing strings are reused.
+			values.resize(repeated.size());
+			for (int i = 0; i < repeated.size(); ++i) {
+				Probe::CountBytes(repeated.Get(i).size());
+				C::Assign(values[i], repeated.Get(i));
+			}
+			return true;
+		}
+		values.reserve(values.size() + repeated.size());
+		for (auto &value : repeated) {
+			Probe::CountBytes(value.size());
+			append_string(values, value);
+		}
+		return true;
+	}
+
+	// append string to vector, stolen if the message is rvalue.
+	void append_string(std::vector<std::string> &values,
+		const std::string &value)
+	{
+		if (_options.move) {
+			values.push_back(std::move(const_cast<std::string&>(value)));
+		} else {
+			values.push_back(value);
+		}
+	}
+
+#ifdef CPS_MEMORY_RESOURCE
+	// append string to std::pmr::vector, the element is allocated from the
+	// resource of vector.
+	void append_string(std::pmr::vector<std::pmr::string> &values,
+		const std::string &value)
+	{
+		values.emplace_back(value.data(), value.size());
+	}
+#endif
+
+#ifdef CPS_STRING_VIEW
+	// append the view of string stored in protobuf message.
+	void append_string(std::vector<std::string_view> &values,
+		const std::string &value)
+	{
+		values.push_back(value);
+	}
+#endif
+
+	// add protobuf repeated field values to vector in bulk, the arithmetic
+	// elements are reserved once and copied by memory.
+	template<typename Ty, typename C>
+	bool copy_struct_values(const Op &op)
+	{
+		auto &values = read_member<typename C::template Vector<Ty>, C>(op);
+		auto &repeated = ProtoRepeated<Ty>(_msg, _refl, op.field);
+		Probe::CountElements(repeated.size());
+		if (overwrite()) {
+			values.assign(repeated.begin(), repeated.end());
+		} else {
+			values.insert(values.end(), repeated.begin(), repeated.end());
+		}
+		return true;
+	}
+
+	// set struct member from protobuf message
+	bool set_struct_message(const Op &op)
+	{
+		auto &submsg = _refl->GetMessage(_msg, op.field);
+		StructWriter writer(*op.plan, submsg, _bytes + op.offset,
+			_placement, _options, select(op));
+		return writer.from_proto();
+	}
+
+	// deal repeated message as vector
+	template<typename C>
+	bool add_struct_messages(const Op &op);
+
+	// deal repeated message as vector concurrently, the vector is resized.
+	bool add_struct_messages(const Op &op, uint8_t *data, int count);
+
+	// set struct map member with protobuf map message.
+	template<typename C>
+	bool set_struct_map(const Op &op);
+
+	// overwrite the existing structs in vector, the elements are trimmed or
+	// appended, the vector is reallocated only if capacity is not enough.
+	template<typename C>
+	bool overwrite_struct_messages(const Op &op);
+
+	// overwrite the existing map, the values of existing keys are
+	// overwritten, and the keys not in message are erased.
+	template<typename C>
+	bool overwrite_struct_map(const Op &op);
+
+	// erase the pairs of map not in kept, Type is the map with the same
+	// node layout before value.
+	template<typename Type>
+	void trim_struct_map(const Op &op, std::vector<const uint8_t*> &kept);
+
+	// set struct sorted vector of pairs with protobuf map message, the
+	// existing pairs are replaced.
+	template<typename C>
+	bool set_sorted_map(const Op &op);
+
+	// convert key of current pair to data, constructed if placement.
+	template<typename C>
+	bool read_map_key(const Op &op, EntryMessages &entries, uint8_t *data,
+		bool placement);
+
+	// convert value of pair to pair in struct, constructed if placement.
+	template<typename C>
+	bool read_map_value(const Op &op, const Message *mark, uint8_t *pair,
+		bool placement);
+};
+
+bool StructWriter::from_proto_sparse()
+{
+	Scratch<const FieldDescriptor*> scratch;
+	auto &fields = scratch.values();
+	// a single pass over the layout, then the present fields are overwritten
+	// on the constructed members.
+	if (_placement) {
+		ConstructStruct(_plan, _bytes, _options.resource);
+	} else {
+		DefaultStruct(_plan, _bytes);
+	}
+	_refl->ListFields(_msg, &fields);
+	bool placement = _placement;
+	_placement = false;
+	bool result = true;
+	for (auto field : fields) {
+		auto op = _plan.find(field->number());
+		if (op == nullptr || !(this->*op->from_proto)(*op)) {
+			result = false;
+			break;
+		}
+	}
+	_placement = placement;
+	return result;
+}
+
+bool StructWriter::from_proto_selected()
+{
+	bool placement = _placement;
+	if (_placement) {
+		ConstructStruct(_plan, _bytes, _options.resource);
+		_placement = false;
+	}
+	bool result = true;
+	for (auto op : _selection->ops()) {
+		if (!(this->*op->from_proto)(*op)) {
+			result = false;
+			break;
+		}
+	}
+	_placement = placement;
+	return result;
+}
+
+template<typename C>
+bool StructWriter::add_struct_messages(const Op &op)
+{
+	if (overwrite()) {
+		return overwrite_struct_messages<C>(op);
+	}
+	auto &info = *op.plan;
+	auto values = read_vector<C>(op);
+	int count = _refl->FieldSize(_msg, op.field);
+	Probe::CountElements(count);
+	values.resize(static_cast<size_t>(count) * info.size());
+	auto data = values.data();
+	if (_options.parallel != nullptr &&
+		static_cast<size_t>(count) >= _options.parallel->threshold) {
+		return add_struct_messages(op, data, count);
+	}
+	for (int i = 0; i < count; ++i) {
+		auto &submsg = _refl->GetRepeatedMessage(_msg, op.field, i);
+		StructWriter writer(info, submsg, data, true, _options, select(op));
+		if (!writer.from_proto()) {
+			return false;
+		}
+		data += info.size(); // point to next member
+	}
+	return true;
+}
+
+bool StructWriter::add_struct_messages(const Op &op, uint8_t *data,
+	int count)
+{
+	auto &info = *op.plan;
+	auto &repeated = ProtoRepeatedPtr<Message>(_msg, _refl, op.field);
+	std::atomic<bool> failed(false);
+	auto &parallel = *_options.parallel;
+	auto pool = parallel.pool ? parallel.pool : &ThreadPool::Default();
+	Options serial = _options.serial();
+	pool->parallel_for(count, parallel.grain, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end && !failed; ++i) {
+			auto &submsg = repeated.Get(static_cast<int>(i));
+			StructWriter writer(info, submsg, data + i * info.size(), true,
+				serial, select(op));
+			if (!writer.from_proto()) {
+				failed = true;
 			}
+		}
+	});
+	return !failed;
+}
+
+template<typename C>
+bool StructWriter::overwrite_struct_messages(const Op &op)
+{
+	auto &info = *op.plan;
+	auto values = read_vector<C>(op);
+	size_t step = info.size();
+	size_t size = values.size() / step;
+	size_t count = static_cast<size_t>(_refl->FieldSize(_msg, op.field));
+	Probe::CountElements(count);
+	// the vector of bytes can not move structs, destroy them before grown.
+	size_t keep = count * step <= values.capacity() ? count : 0;
+	for (size_t i = keep; i < size; ++i) {
+		DestroyStruct(info, values.data() + i * step);
+	}
+	if (keep == 0) {
+		values.clear();
+	}
+	size_t reused = std::min(size, keep);
+	values.resize(count * step);
+	auto data = values.data();
+	for (size_t i = 0; i < count; ++i) {
+		auto &submsg = _refl->GetRepeatedMessage(_msg, op.field,
+			static_cast<int>(i));
+		StructWriter writer(info, submsg, data + i * step, i >= reused,
+			_options, select(op));
+		if (!writer.from_proto()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template<typename C>
+bool StructWriter::overwrite_struct_map(const Op &op)
+{
+	typedef typename C::String String;
+	auto map = _bytes + op.offset;
+	auto &key = op.plan->ops()[0];
+	Scratch<const uint8_t*> scratch;
+	auto &kept = scratch.values();
+	EntryMessages entries(_msg, _refl, op.field);
+	Probe::CountElements(entries.size());
+	if (op.reserve != nullptr) {
+		// rehashed only if grown.
+		auto &values = *(typename C::template HashMap<uint8_t, uint8_t>*)map;
+		if (values.size() < static_cast<size_t>(entries.size())) {
+			op.reserve(map, entries.size());
+		}
+	}
+	while (entries.next()) {
+		alignas(String) uint8_t temp[sizeof(String)];
+		if (!read_map_key<C>(op, entries, temp, true)) {
+			return false;
+		}
+		bool inserted = false;
+		auto pair = op.emplace(op, map, temp, inserted);
+		if (key.cpp_type == FieldDescriptor::CPPTYPE_STRING) {
+			Destroy<String>(temp);
+		}
+		// the value of existing key is overwritten.
+		if (!read_map_value<C>(op, entries.mark(), pair, inserted)) {
+			return false;
+		}
+		kept.push_back(pair);
+	}
+	bool hash = op.maps == MAP_HASH;
+	if (op.plan->align() == 4) {
+		if (hash) {
+			trim_struct_map<typename C::template HashMap<int32_t, int32_t>>(
+				op, kept);
 		} else {
-			auto &value = read_member<Ty>();
-			value = ProtoGet<Ty>(_msg, _refl, field);
+			trim_struct_map<typename C::template Map<int32_t, int32_t>>(op,
+				kept);
+		}
+	} else {
+		if (hash) {
+			trim_struct_map<typename C::template HashMap<int64_t, int64_t>>(
+				op, kept);
+		} else {
+			trim_struct_map<typename C::template Map<int64_t, int64_t>>(op,
+				kept);
 		}
-		return true;
 	}
+	return true;
+}
 
-	// set struct map member with protobuf message.
-	bool set_struct_map(const FieldDescriptor *field);
-
-	template<int ValueSize, int Alignment>
-	inline bool set_struct_map(const FieldDescriptor *field);
-
-	template<typename Key, typename Value>
-	bool set_struct_map(const FieldDescriptor *field);
-};
+template<typename Type>
+void StructWriter::trim_struct_map(const Op &op,
+	std::vector<const uint8_t*> &kept)
+{
+	auto &values = *(Type*)(_bytes + op.offset);
+	if (values.size() <= kept.size()) {
+		return; // all keys are in message
+	}
+	std::sort(kept.begin(), kept.end());
+	for (auto iter = values.begin(); iter != values.end();) {
+		auto pair = (uint8_t*)&*iter++;
+		if (!std::binary_search(kept.begin(), kept.end(), pair)) {
+			DestroyMember(op.plan->ops()[1], pair);
+			op.erase(op, _bytes + op.offset, pair); // key is at offset 0
+		}
+	}
+}
 
-template<typename Key, typename Value>
-bool StructWriter::set_struct_map(const FieldDescriptor *field)
+template<typename C>
+bool StructWriter::set_struct_map(const Op &op)
 {
-	auto &map = read_member<std::map<Key, Value>>();
-	int count = _refl->FieldSize(_msg, field);
-	for (int i = 0; i < count; ++i) {
-		auto &submsg = _refl->GetRepeatedMessage(_msg, field, i);
-		auto subrefl = submsg.GetReflection();
-		auto subdesc = submsg.GetDescriptor();
-		auto subfield = subdesc->field(0);
-		auto key = ProtoGet<Key>(submsg, subrefl, subfield);
-		auto pair = map.emplace(key, Value{ 0 });
-		if (!pair.second) {
+	typedef typename C::String String;
+	if (overwrite()) {
+		return overwrite_struct_map<C>(op);
+	}
+	EntryMessages entries(_msg, _refl, op.field);
+	Probe::CountElements(entries.size());
+	void *map = nullptr;
+	if (op.maps == MAP_HASH) {
+		auto &values =
+			read_member<typename C::template HashMap<uint8_t, uint8_t>, C>(op);
+		// rehashed once for all pairs.
+		op.reserve(&values, values.size() + entries.size());
+		map = &values;
+	} else {
+		map = &read_member<typename C::template Map<uint8_t, uint8_t>, C>(op);
+	}
+	auto &key = op.plan->ops()[0];
+	while (entries.next()) {
+		// read key to a temporary, then insert to map. key is at offset 0.
+		alignas(String) uint8_t temp[sizeof(String)];
+		if (!read_map_key<C>(op, entries, temp, true)) {
 			return false;
 		}
-		auto data = (uint8_t*)&(pair.first->first);
-		StructWriter writer(submsg, data);
-		writer._placement = true;
-		if (!writer.from_proto()) {
+		bool inserted = false;
+		auto pair = op.emplace(op, map, temp, inserted);
+		if (key.cpp_type == FieldDescriptor::CPPTYPE_STRING) {
+			Destroy<String>(temp);
+		}
+		if (!inserted ||
+			!read_map_value<C>(op, entries.mark(), pair, true)) {
 			return false;
 		}
 	}
 	return true;
 }
 
-template<int ValueSize, int Alignment>
-struct ValueType {};
+template<typename C>
+bool StructWriter::set_sorted_map(const Op &op)
+{
+	auto &entry = *op.plan;
+	auto values = read_vector<C>(op);
+	size_t step = entry.size();
+	// the vector of bytes can not move pairs, they are rebuilt.
+	auto data = values.data();
+	for (size_t i = 0; i < values.size(); i += step) {
+		DestroyStruct(entry, data + i);
+	}
+	values.clear();
+	EntryMessages entries(_msg, _refl, op.field);
+	size_t count = static_cast<size_t>(entries.size());
+	Probe::CountElements(count);
+	values.resize(count * step);
+	data = values.data();
+	for (size_t i = 0; i < count; ++i) {
+		ConstructStruct(entry, data + i * step, _options.resource);
+	}
+	// the keys are converted in order of message and sorted once, then the
+	// values are converted to the sorted positions, no pair is moved.
+	Scratch<EntryMessages::Mark> marks;
+	for (size_t i = 0; i < count && entries.next(); ++i) {
+		if (!read_map_key<C>(op, entries, data + i * step, false)) {
+			return false;
+		}
+		marks.values().push_back(entries.mark());
+	}
+	Scratch<size_t> scratch;
+	auto &order = scratch.values();
+	if (!op.sort(data, count, step, order)) {
+		return false;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		if (!read_map_value<C>(op, marks.values()[order[i]],
+			data + i * step, false)) {
+			return false;
+		}
+	}
+	return true;
+}
 
-template<int ValueSize>
-struct ValueType<ValueSize, 4>
+template<typename C>
+bool StructWriter::read_map_key(const Op &op, EntryMessages &entries,
+	uint8_t *data, bool placement)
 {
-	uint32_t member[ValueSize / 4];
-};
+	auto &key = op.plan->ops()[0];
+	StructWriter writer(*op.plan, *entries.mark(), data, placement, _options);
+	return (writer.*key.from_proto)(key);
+}
 
-template<int ValueSize>
-struct ValueType<ValueSize, 8>
+template<typename C>
+bool StructWriter::read_map_value(const Op &op, const Message *mark,
+	uint8_t *pair, bool placement)
 {
-	uint64_t member[ValueSize / 8];
-};
+	auto &value = op.plan->ops()[1];
+	StructWriter writer(*op.plan, *mark, pair, placement, _options);
+	return (writer.*value.from_proto)(value);
+}
 
-template<int ValueSize, int Alignment>
-bool StructWriter::set_struct_map(const FieldDescriptor *field)
+#define CASE_CONVERTER(TYPE, type, function) \
+case FieldDescriptor::CPPTYPE_ ## TYPE: \
+	return &StructWriter::function<type>;
+
+#define CASE_CONTAINER_CONVERTER(TYPE, type, function) \
+case FieldDescriptor::CPPTYPE_ ## TYPE: \
+	return &StructWriter::function<type, C>;
+
+template<typename C>
+StructWriter::Converter StructWriter::converter(const Op &op)
 {
-	typedef ValueType<ValueSize, Alignment> Value;
-	auto desc = field->message_type();
-	auto key = desc->field(0);
-	switch (key->cpp_type()) {
-	case FieldDescriptor::CPPTYPE_INT32:
-	case FieldDescriptor::CPPTYPE_ENUM:
-		return set_struct_map<int32_t, Value>(field);
-	case FieldDescriptor::CPPTYPE_INT64:
-		return set_struct_map<int64_t, Value>(field);
-	case FieldDescriptor::CPPTYPE_UINT32:
-		return set_struct_map<uint32_t, Value>(field);
-	case FieldDescriptor::CPPTYPE_UINT64:
-		return set_struct_map<uint64_t, Value>(field);
-	case FieldDescriptor::CPPTYPE_STRING:
-		return set_struct_map<std::string, Value>(field);
+	switch (op.kind) {
+	case Op::KIND_VALUE:
+		switch (op.cpp_type) {
+		CASE_CONVERTER(INT32, int32_t, set_struct_value)
+		CASE_CONVERTER(INT64, int64_t, set_struct_value)
+		CASE_CONVERTER(UINT32, uint32_t, set_struct_value)
+		CASE_CONVERTER(UINT64, uint64_t, set_struct_value)
+		CASE_CONVERTER(DOUBLE, double, set_struct_value)
+		CASE_CONVERTER(FLOAT, float, set_struct_value)
+		CASE_CONVERTER(BOOL, bool, set_struct_value)
+		CASE_CONVERTER(ENUM, Enum, set_struct_value)
+		case FieldDescriptor::CPPTYPE_STRING:
+			return &StructWriter::set_struct_string<C>;
+		default:
+			return &StructWriter::unsupported; // never reached!
+		}
+	case Op::KIND_REPEATED:
+		switch (op.cpp_type) {
+		CASE_CONTAINER_CONVERTER(INT32, int32_t, copy_struct_values)
+		CASE_CONTAINER_CONVERTER(INT64, int64_t, copy_struct_values)
+		CASE_CONTAINER_CONVERTER(UINT32, uint32_t, copy_struct_values)
+		CASE_CONTAINER_CONVERTER(UINT64, uint64_t, copy_struct_values)
+		CASE_CONTAINER_CONVERTER(DOUBLE, double, copy_struct_values)
+		CASE_CONTAINER_CONVERTER(FLOAT, float, copy_struct_values)
+		CASE_CONTAINER_CONVERTER(BOOL, bool, copy_struct_values)
+		// enum is same as int32 in memory.
+		CASE_CONTAINER_CONVERTER(ENUM, int32_t, copy_struct_values)
+		case FieldDescriptor::CPPTYPE_STRING:
+			return &StructWriter::add_struct_strings<C>;
+		default:
+			return &StructWriter::unsupported; // never reached!
+		}
+	case Op::KIND_MESSAGE:
+		return &StructWriter::set_struct_message;
+	case Op::KIND_REPEATED_MESSAGE:
+		return &StructWriter::add_struct_messages<C>;
+	case Op::KIND_MAP:
+	{
+		if (op.sort != nullptr) {
+			return &StructWriter::set_sorted_map<C>;
+		}
+		if (op.emplace == nullptr) {
+			return &StructWriter::unsupported;
+		}
+		return &StructWriter::set_struct_map<C>;
+	}
 	default:
-		// protobuf support (u)int32/(u)int64/string as key,
-		// the key is align as 4 or 8 bytes.
-		return false; // should never reached!
+		return &StructWriter::unsupported; // never reached!
 	}
 }
 
-bool StructWriter::set_struct_map(const FieldDescriptor *field)
+#undef CASE_CONVERTER
+#undef CASE_CONTAINER_CONVERTER
+
+// @brief Convert protobuf message to struct with compiled plan.
+// @param[in] plan: plan compiled from descriptor of msg
+// @param[in] msg: protobuf message
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool ProtoToStruct(const Plan &plan, const Message &msg,
+	void *bytes, size_t size)
 {
-	auto desc = field->message_type();
-	if (desc->field_count() != 2) {
-		// map should have 2 field.
-		return false; // should never reached!
+	Probe probe(plan.descriptor(), DIRECTION_TO_STRUCT);
+	if (plan.descriptor() != msg.GetDescriptor()) {
+		// plan is not compiled for this message
+		return probe.fail(FAILURE_DESCRIPTOR);
 	}
-	StructInfo info(desc); // info is std::pair<key, value>
-	auto key = desc->field(0);
-	int size = 0;
-	switch (key->cpp_type()) {
-	case FieldDescriptor::CPPTYPE_INT32:
-	case FieldDescriptor::CPPTYPE_ENUM:
-	case FieldDescriptor::CPPTYPE_UINT32:
-		size = info.size() - sizeof(int32_t);
-		break;
-	case FieldDescriptor::CPPTYPE_INT64:
-	case FieldDescriptor::CPPTYPE_UINT64:
-		size = info.size() - sizeof(int64_t);
-		break;
-	case FieldDescriptor::CPPTYPE_STRING:
-		size = info.size() - sizeof(std::string);
-		break;
-	default:
-		// protobuf support (u)int32/(u)int64/string as key,
-		return false; // should never reached!
+	if (plan.size() != static_cast<int>(size)) {
+		// protobuf message is not match struct
+		return probe.fail(FAILURE_SIZE);
 	}
-	switch (info.align()) {
-	case 4:
-		if (size <= 0x008) return set_struct_map<0x008, 4>(field);
-		if (size <= 0x010) return set_struct_map<0x010, 4>(field);
-		if (size <= 0x020) return set_struct_map<0x020, 4>(field);
-		if (size <= 0x040) return set_struct_map<0x040, 4>(field);
-		if (size <= 0x080) return set_struct_map<0x080, 4>(field);
-		if (size <= 0x100) return set_struct_map<0x100, 4>(field);
-		if (size <= 0x200) return set_struct_map<0x200, 4>(field);
-		if (size <= 0x400) return set_struct_map<0x400, 4>(field);
-		if (size <= 0x800) return set_struct_map<0x800, 4>(field);
-		break;
-	case 8:
-		if (size <= 0x008) return set_struct_map<0x008, 8>(field);
-		if (size <= 0x010) return set_struct_map<0x010, 8>(field);
-		if (size <= 0x020) return set_struct_map<0x020, 8>(field);
-		if (size <= 0x040) return set_struct_map<0x040, 8>(field);
-		if (size <= 0x080) return set_struct_map<0x080, 8>(field);
-		if (size <= 0x100) return set_struct_map<0x100, 8>(field);
-		if (size <= 0x200) return set_struct_map<0x200, 8>(field);
-		if (size <= 0x400) return set_struct_map<0x400, 8>(field);
-		if (size <= 0x800) return set_struct_map<0x800, 8>(field);
-		break;
-	default:
-		// the alignof map pair is 4 or 8 bytes.
-		return false; // should never reached!
+	StructWriter writer(plan, msg, static_cast<uint8_t*>(bytes));
+	return probe.done(writer.from_proto());
+}
+
+// @brief Convert protobuf message to struct.
+// @param[in] msg: protobuf message
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool ProtoToStruct(const Message &msg, void *bytes, size_t size)
+{
+	return ProtoToStruct(Plan::Get(msg.GetDescriptor()), msg, bytes, size);
+}
+
+// @brief Convert protobuf message to struct, steal strings from msg.
+// @param[in,out] msg: protobuf message
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool MoveProtoToStruct(Message &msg, void *bytes, size_t size)
+{
+	auto &plan = Plan::Get(msg.GetDescriptor());
+	Probe probe(plan.descriptor(), DIRECTION_TO_STRUCT);
+	if (plan.size() != static_cast<int>(size)) {
+		// protobuf message is not match struct
+		return probe.fail(FAILURE_SIZE);
 	}
-	// The struct is too big, max sizeof struct is 0x800;
-	return false;
+	Options options;
+	options.move = true;
+	StructWriter writer(plan, msg, static_cast<uint8_t*>(bytes), false,
+		options);
+	return probe.done(writer.from_proto());
 }
 
-template<>
-bool StructWriter::set_struct_value<Message>(const FieldDescriptor *field)
+// @brief Convert protobuf message to the existing struct, the members are
+// overwritten and the buffers of them are reused.
+// @param[in] plan: plan compiled from descriptor of msg
+// @param[in] msg: protobuf message
+// @param[in,out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool OverwriteProtoToStruct(const Plan &plan, const Message &msg,
+	void *bytes, size_t size)
 {
-	if (!field->is_repeated()) {
-		auto &submsg = _refl->GetMessage(_msg, field);
-		auto writer = child_writer(submsg);
-		return writer.from_proto();
+	Probe probe(plan.descriptor(), DIRECTION_TO_STRUCT);
+	if (plan.descriptor() != msg.GetDescriptor()) {
+		// plan is not compiled for this message
+		return probe.fail(FAILURE_DESCRIPTOR);
 	}
-	if (field->is_map()) {
-		return set_struct_map(field);
+	if (plan.size() != static_cast<int>(size)) {
+		// protobuf message is not match struct
+		return probe.fail(FAILURE_SIZE);
 	}
-	// deal repeated message as vector
-	StructInfo info(field->message_type());
-	if (info.size() == 0) {
-		// an empty struct in vector?
-		return false; // should never reached!
+	Options options;
+	options.overwrite = true;
+	StructWriter writer(plan, msg, static_cast<uint8_t*>(bytes), false,
+		options);
+	return probe.done(writer.from_proto());
+}
+
+// @brief Convert protobuf message to the existing struct, the members are
+// overwritten and the buffers of them are reused.
+// @param[in] msg: protobuf message
+// @param[in,out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool OverwriteProtoToStruct(const Message &msg, void *bytes, size_t size)
+{
+	return OverwriteProtoToStruct(Plan::Get(msg.GetDescriptor()), msg, bytes,
+		size);
+}
+
+// @brief Convert protobuf message to struct, only the present fields are
+// visited.
+// @param[in] plan: plan compiled from descriptor of msg
+// @param[in] msg: protobuf message
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool SparseProtoToStruct(const Plan &plan, const Message &msg,
+	void *bytes, size_t size)
+{
+	Probe probe(plan.descriptor(), DIRECTION_TO_STRUCT);
+	if (plan.descriptor() != msg.GetDescriptor()) {
+		// plan is not compiled for this message
+		return probe.fail(FAILURE_DESCRIPTOR);
 	}
-	auto &values = read_member<Vector>();
-	int count = _refl->FieldSize(_msg, field);
-	values.resize(static_cast<size_t>(count) * info.size());
-	auto data = values.data();
-	for (int i = 0; i < count; ++i) {
-		auto &submsg = _refl->GetRepeatedMessage(_msg, field, i);
-		StructWriter writer(submsg, data);
-		writer._placement = true;
-		if (!writer.from_proto()) {
-			return false;
+	if (plan.size() != static_cast<int>(size)) {
+		// protobuf message is not match struct
+		return probe.fail(FAILURE_SIZE);
+	}
+	Options options;
+	options.sparse = true;
+	StructWriter writer(plan, msg, static_cast<uint8_t*>(bytes), false,
+		options);
+	return probe.done(writer.from_proto());
+}
+
+// @brief Convert protobuf message to struct, only the present fields are
+// visited.
+// @param[in] msg: protobuf message
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool SparseProtoToStruct(const Message &msg, void *bytes, size_t size)
+{
+	return SparseProtoToStruct(Plan::Get(msg.GetDescriptor()), msg, bytes,
+		size);
+}
+
+// ==================== columns of repeated message ====================
+
+const Column *Columns::find(const std::string &name) const
+{
+	for (auto &column : columns) {
+		if (column.field->name() == name) {
+			return &column;
 		}
-		data += info.size(); // point to next member
 	}
-	return true;
+	return nullptr;
 }
 
-bool StructWriter::from_proto()
+// fill the column with the fundamental field of elements, the values are
+// written as struct members of type Ty.
+template<typename Ty>
+static void FillColumn(Column &column,
+	const google::protobuf::RepeatedPtrField<Message> &repeated)
 {
-	auto desc = _msg.GetDescriptor();
-	for (int i = 0; i < desc->field_count(); ++i) {
-		auto field = desc->field(i);
-		switch (field->cpp_type()) {
+	column.width = sizeof(Ty);
+	column.values.resize(repeated.size() * sizeof(Ty));
+	Ty *values = (Ty*)column.values.data();
+	for (auto &element : repeated) {
+		*values++ = ProtoGet<Ty>(element, element.GetReflection(),
+			column.field);
+	}
+}
+
+// fill the column with the string field of elements, concatenated.
+static void FillStringColumn(Column &column,
+	const google::protobuf::RepeatedPtrField<Message> &repeated)
+{
+	column.width = 0;
+	column.offsets.reserve(repeated.size() + 1);
+	column.offsets.push_back(0);
+	std::string scratch;
+	for (auto &element : repeated) {
+		auto &value = element.GetReflection()->GetStringReference(element,
+			column.field, &scratch);
+		Probe::CountBytes(value.size());
+		column.data.append(value);
+		column.offsets.push_back(column.data.size());
+	}
+}
+
+// @brief Convert repeated message field to columns, the layout of values is
+// the same as the struct members of element.
+// @param[in] msg: protobuf message
+// @param[in] field: repeated message field of msg
+// @param[in,out] columns: the columns of elements
+// @return true for success, or false if field is not repeated message of msg.
+bool ProtoToColumns(const Message &msg, const FieldDescriptor *field,
+	Columns &columns)
+{
+	Probe probe(msg.GetDescriptor(), DIRECTION_TO_STRUCT);
+	if (field == nullptr || field->containing_type() != msg.GetDescriptor() ||
+		!field->is_repeated() || field->is_map() ||
+		field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) {
+		return probe.fail(FAILURE_FIELD);
+	}
+	auto &plan = Plan::Get(field->message_type());
+	auto &repeated = ProtoRepeatedPtr<Message>(msg, msg.GetReflection(),
+		field);
+	Probe::CountElements(repeated.size());
+	columns.rows = static_cast<size_t>(repeated.size());
+	// the columns are filled one by one, so the writes are sequential.
+	size_t count = 0;
+	for (auto &op : plan.ops()) {
+		if (op.kind != Op::KIND_VALUE) {
+			continue;
+		}
+		if (count == columns.columns.size()) {
+			columns.columns.emplace_back();
+		}
+		// the buffers of existing column are reused.
+		auto &column = columns.columns[count++];
+		column.field = op.field;
+		column.values.clear();
+		column.offsets.clear();
+		column.data.clear();
+		switch (op.cpp_type) {
 		case FieldDescriptor::CPPTYPE_INT32:
-			set_struct_value<int32_t>(field);
+			FillColumn<int32_t>(column, repeated);
 			break;
 		case FieldDescriptor::CPPTYPE_INT64:
-			set_struct_value<int64_t>(field);
+			FillColumn<int64_t>(column, repeated);
 			break;
 		case FieldDescriptor::CPPTYPE_UINT32:
-			set_struct_value<uint32_t>(field);
+			FillColumn<uint32_t>(column, repeated);
 			break;
 		case FieldDescriptor::CPPTYPE_UINT64:
-			set_struct_value<uint64_t>(field);
+			FillColumn<uint64_t>(column, repeated);
 			break;
 		case FieldDescriptor::CPPTYPE_DOUBLE:
-			set_struct_value<double>(field);
+			FillColumn<double>(column, repeated);
 			break;
 		case FieldDescriptor::CPPTYPE_FLOAT:
-			set_struct_value<float>(field);
+			FillColumn<float>(column, repeated);
 			break;
 		case FieldDescriptor::CPPTYPE_BOOL:
-			set_struct_value<bool>(field);
+			FillColumn<bool>(column, repeated);
 			break;
 		case FieldDescriptor::CPPTYPE_ENUM:
-			set_struct_value<Enum>(field);
+			FillColumn<Enum>(column, repeated);
 			break;
 		case FieldDescriptor::CPPTYPE_STRING:
-			set_struct_value<std::string>(field);
-			break;
-		case FieldDescriptor::CPPTYPE_MESSAGE:
-			if (!set_struct_value<Message>(field)) {
-				return false;
-			}
+			FillStringColumn(column, repeated);
 			break;
 		default:
-			return false; // never reached!
+			return probe.fail(FAILURE_FIELD); // never reached!
 		}
 	}
-	return true;
+	columns.columns.resize(count);
+	return probe.done(true);
 }
 
-// @brief Convert protobuf message to struct.
+#ifdef CPS_MEMORY_RESOURCE
+
+// ==================== std::pmr containers ====================
+
+// @brief Convert protobuf message to struct with std::pmr containers, which
+// are allocated from resource.
+// @param[in] plan: plan compiled by CompilePmrPlan from descriptor of msg
 // @param[in] msg: protobuf message
 // @param[out] bytes: pointer to struct
 // @param[in] size: sizeof struct
+// @param[in] resource: the memory resource
 // @return true for success, or false for failed.
-bool ProtoToStruct(const Message &msg, void *bytes, size_t size)
+bool ProtoToStruct(const Plan &plan, const Message &msg, void *bytes,
+	size_t size, std::pmr::memory_resource *resource)
+{
+	Probe probe(plan.descriptor(), DIRECTION_TO_STRUCT);
+	if (plan.descriptor() != msg.GetDescriptor()) {
+		// plan is not compiled for this message
+		return probe.fail(FAILURE_DESCRIPTOR);
+	}
+	if (plan.size() != static_cast<int>(size)) {
+		// protobuf message is not match struct
+		return probe.fail(FAILURE_SIZE);
+	}
+	if (plan.containers() != CONTAINERS_PMR || resource == nullptr) {
+		// plan is not compiled for std::pmr containers
+		return probe.fail(FAILURE_CONTAINERS);
+	}
+	// the allocator of container is never changed by assignment, so the
+	// members are constructed again on resource.
+	auto data = static_cast<uint8_t*>(bytes);
+	DestroyStruct(plan, data);
+	ConstructStruct(plan, data, resource);
+	Options options;
+	options.resource = resource;
+	StructWriter writer(plan, msg, data, false, options);
+	return probe.done(writer.from_proto());
+}
+
+#endif
+
+// ==================== parallel conversion ====================
+
+// @brief Convert struct to protobuf message, the large repeated message
+// fields are converted concurrently.
+// @param[in] plan: plan compiled from descriptor of msg
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[out] msg: protobuf message
+// @param[in] parallel: options of parallel conversion
+// @return true for success, or false for failed.
+bool StructToProto(const Plan &plan, const void *bytes, size_t size,
+	Message &msg, const Parallel &parallel)
 {
-	StructWriter writer(msg, static_cast<uint8_t*>(bytes));
-	if (writer.size() != static_cast<int>(size)) {
-		return false; // protobuf message is not match struct
+	Probe probe(plan.descriptor(), DIRECTION_TO_PROTO);
+	if (plan.descriptor() != msg.GetDescriptor()) {
+		// plan is not compiled for this message
+		return probe.fail(FAILURE_DESCRIPTOR);
 	}
-	return writer.from_proto();
+	if (plan.size() != static_cast<int>(size)) {
+		// protobuf message is not match struct
+		return probe.fail(FAILURE_SIZE);
+	}
+	Options options;
+	options.parallel = &parallel;
+	StructReader reader(plan, msg, static_cast<const uint8_t*>(bytes), options);
+	return probe.done(reader.to_proto());
 }
 
-} // namespace cps
+// @brief Convert protobuf message to struct, the large repeated message
+// fields are converted concurrently.
+// @param[in] plan: plan compiled from descriptor of msg
+// @param[in] msg: protobuf message
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[in] parallel: options of parallel conversion
+// @return true for success, or false for failed.
+bool ProtoToStruct(const Plan &plan, const Message &msg,
+	void *bytes, size_t size, const Parallel &parallel)
+{
+	Probe probe(plan.descriptor(), DIRECTION_TO_STRUCT);
+	if (plan.descriptor() != msg.GetDescriptor()) {
+		// plan is not compiled for this message
+		return probe.fail(FAILURE_DESCRIPTOR);
+	}
+	if (plan.size() != static_cast<int>(size)) {
+		// protobuf message is not match struct
+		return probe.fail(FAILURE_SIZE);
+	}
+	Options options;
+	options.parallel = &parallel;
+	StructWriter writer(plan, msg, static_cast<uint8_t*>(bytes), false,
+		options);
+	return probe.done(writer.from_proto());
+}
+
+// ==================== field mask ====================
+
+Selection::Selection(const Plan &plan)
+	: _plan(plan)
+	, _selected(plan.ops().size(), false)
+	, _children(plan.ops().size()) {}
+
+std::unique_ptr<Selection> Selection::Compile(const Descriptor *desc,
+	const FieldMask &mask)
+{
+	// the paths are added in any order, a whole member drops its sub paths.
+	std::unique_ptr<Selection> selection(new Selection(Plan::Get(desc)));
+	for (auto &path : mask.paths()) {
+		if (!selection->add(path, 0)) {
+			return nullptr;
+		}
+	}
+	selection->build();
+	return selection;
+}
+
+bool Selection::add(const std::string &path, size_t begin)
+{
+	size_t end = path.find('.', begin);
+	bool last = end == std::string::npos;
+	auto name = path.substr(begin, last ? std::string::npos : end - begin);
+	auto field = _plan.descriptor()->FindFieldByName(name);
+	auto op = field != nullptr ? _plan.find(field->number()) : nullptr;
+	if (op == nullptr) {
+		return false; // no such field
+	}
+	size_t index = op - _plan.ops().data();
+	auto &child = _children[index];
+	if (last) {
+		// the whole member, the selected sub fields are dropped.
+		_selected[index] = true;
+		child.reset();
+		return true;
+	}
+	if (_selected[index] && !child) {
+		return true; // the whole member is selected already
+	}
+	if (op->kind != Op::KIND_MESSAGE &&
+		op->kind != Op::KIND_REPEATED_MESSAGE) {
+		return false; // only message has sub fields
+	}
+	_selected[index] = true;
+	if (!child) {
+		child.reset(new Selection(*op->plan));
+	}
+	return child->add(path, end + 1);
+}
+
+void Selection::build()
+{
+	for (size_t i = 0; i < _selected.size(); ++i) {
+		if (!_selected[i]) {
+			continue;
+		}
+		_ops.push_back(&_plan.ops()[i]);
+		if (_children[i]) {
+			_children[i]->build();
+		}
+	}
+}
+
+// @brief Compile the fields of message selected by mask.
+// @param[in] desc: protobuf message descriptor
+// @param[in] mask: paths of the selected fields
+// @return the compiled selection, or null if a path is invalid.
+std::shared_ptr<const Selection> CompileFieldMask(const Descriptor *desc,
+	const FieldMask &mask)
+{
+	return Selection::Compile(desc, mask);
+}
+
+// @brief Convert the selected fields of struct to protobuf message.
+// @param[in] selection: the fields compiled from mask
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[out] msg: protobuf message
+// @return true for success, or false for failed.
+bool StructToProto(const Selection &selection, const void *bytes,
+	size_t size, Message &msg)
+{
+	Probe probe(selection.plan().descriptor(), DIRECTION_TO_PROTO);
+	auto &plan = selection.plan();
+	if (plan.descriptor() != msg.GetDescriptor()) {
+		// selection is not compiled for this message
+		return probe.fail(FAILURE_DESCRIPTOR);
+	}
+	if (plan.size() != static_cast<int>(size)) {
+		// protobuf message is not match struct
+		return probe.fail(FAILURE_SIZE);
+	}
+	StructReader reader(plan, msg, static_cast<const uint8_t*>(bytes),
+		Options::Default(), &selection);
+	return probe.done(reader.to_proto());
+}
+
+// @brief Convert the selected fields of protobuf message to struct.
+// @param[in] selection: the fields compiled from mask
+// @param[in] msg: protobuf message
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool ProtoToStruct(const Selection &selection, const Message &msg,
+	void *bytes, size_t size)
+{
+	Probe probe(selection.plan().descriptor(), DIRECTION_TO_STRUCT);
+	auto &plan = selection.plan();
+	if (plan.descriptor() != msg.GetDescriptor()) {
+		// selection is not compiled for this message
+		return probe.fail(FAILURE_DESCRIPTOR);
+	}
+	if (plan.size() != static_cast<int>(size)) {
+		// protobuf message is not match struct
+		return probe.fail(FAILURE_SIZE);
+	}
+	StructWriter writer(plan, msg, static_cast<uint8_t*>(bytes), false,
+		Options::Default(), &selection);
+	return probe.done(writer.from_proto());
+}
 
+// ==================== public plan interface ====================
+
+template<typename C>
+void Plan::bind(Op &op)
+{
+	if (op.kind == Op::KIND_MAP) {
+		BindMap<C>(op);
+	}
+	op.to_proto = StructReader::converter<C>(op);
+	op.from_proto = StructWriter::converter<C>(op);
+}
+
+// @brief Compile the conversion plan of protobuf message type.
+// @param[in] desc: protobuf message descriptor
+// @param[in] maps: the container of map members
+// @return the conversion plan.
+const Plan &CompilePlan(const Descriptor *desc, MapLayout maps)
+{
+	return Plan::Get(desc, CONTAINERS_STD, maps);
+}
+
+#ifdef CPS_MEMORY_RESOURCE
+// @brief Compile the conversion plan of struct with std::pmr containers.
+// @param[in] desc: protobuf message descriptor
+// @param[in] maps: the container of map members
+// @return the conversion plan.
+const Plan &CompilePmrPlan(const Descriptor *desc, MapLayout maps)
+{
+	return Plan::Get(desc, CONTAINERS_PMR, maps);
+}
+#endif
+
+#ifdef CPS_STRING_VIEW
+// @brief Compile the conversion plan of struct with std::string_view.
+// @param[in] desc: protobuf message descriptor
+// @param[in] maps: the container of map members
+// @return the conversion plan.
+const Plan &CompileViewPlan(const Descriptor *desc, MapLayout maps)
+{
+	return Plan::Get(desc, CONTAINERS_VIEW, maps);
+}
+#endif
+
+#undef DISPATCH_CONTAINERS
+
+} // namespace cps
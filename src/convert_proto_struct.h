@@ -17,14 +17,45 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
 
-namespace google { namespace protobuf { class Message; } }
+// the std::pmr containers and std::string_view are supported since c++17.
+#if (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)) \
+	&& defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define CPS_MEMORY_RESOURCE 1
+#endif
+#if __has_include(<string_view>)
+#include <string_view>
+#define CPS_STRING_VIEW 1
+#endif
+#endif
+
+namespace google { namespace protobuf {
+class Message;
+class Descriptor;
+class FieldDescriptor;
+class Arena;
+class FieldMask;
+namespace io { class ZeroCopyOutputStream; }
+template<typename Element> class RepeatedPtrField;
+} }
 
 namespace cps
 {
 
 using google::protobuf::Message;
 
+// compiled conversion plan of a protobuf message type.
+class Plan;
+
+// compiled fields of a protobuf message type selected by FieldMask.
+class Selection;
+
 // @brief Convert struct to protobuf message.
 // @param[in] bytes: pointer to struct
 // @param[in] size: sizeof struct
@@ -32,6 +63,17 @@ using google::protobuf::Message;
 // @return true for success, or false for failed.
 bool StructToProto(const void *bytes, size_t size, Message &msg);
 
+// @brief Convert struct to a new protobuf message allocated on arena. The
+// sub-messages, strings and repeated fields are allocated on the arena of the
+// message too, so they are freed at once with the arena.
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[in] prototype: any message of the type, e.g. default instance
+// @param[in] arena: arena of the new message, or null for heap
+// @return the new message, or null for failed. owned by arena if not null.
+Message *StructToProto(const void *bytes, size_t size,
+	const Message &prototype, google::protobuf::Arena *arena);
+
 // @brief Convert protobuf message to struct.
 // @param[in] msg: protobuf message
 // @param[out] bytes: pointer to struct
@@ -39,6 +81,301 @@ bool StructToProto(const void *bytes, size_t size, Message &msg);
 // @return true for success, or false for failed.
 bool ProtoToStruct(const Message &msg, void *bytes, size_t size);
 
+// @brief Convert struct to protobuf message, the strings (include keys of
+// std::map) are moved to message, so the struct can only be destroyed after.
+// @param[in,out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[out] msg: protobuf message
+// @return true for success, or false for failed.
+bool MoveStructToProto(void *bytes, size_t size, Message &msg);
+
+// @brief Convert protobuf message to struct, the strings owned by message are
+// stolen, the message is valid but unspecified after, and should be cleared
+// before reuse.
+// @param[in,out] msg: protobuf message
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool MoveProtoToStruct(Message &msg, void *bytes, size_t size);
+
+// @brief Convert only the members of cur different from prev to protobuf
+// message, which is converted from prev before (by StructToProto, or by this
+// function of the previous snapshot). The nested structs are compared member
+// by member, the changed repeated message with same count is updated element
+// by element, the other changed containers are converted again.
+// @param[in] prev: pointer to struct, converted to msg before
+// @param[in] cur: pointer to struct
+// @param[in] size: sizeof struct
+// @param[in,out] msg: protobuf message converted from prev
+// @param[out] mask: the paths of changed fields, or null
+// @return true for success, or false for failed.
+bool StructDeltaToProto(const void *prev, const void *cur, size_t size,
+	Message &msg, google::protobuf::FieldMask *mask = nullptr);
+
+// @brief Convert protobuf message to the existing struct in place, which
+// may be converted before. The members are overwritten: the strings are
+// assigned in their buffers, the vectors are reassigned or trimmed in their
+// capacity, the values of existing map keys are overwritten and the other keys
+// are erased. So the steady conversion to a long-lived struct does not
+// allocate.
+// @param[in] msg: protobuf message
+// @param[in,out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool OverwriteProtoToStruct(const Message &msg, void *bytes, size_t size);
+
+// the container of map members of struct, the key and value are same.
+enum MapLayout
+{
+	MAP_TREE,   // std::map
+	MAP_HASH,   // std::unordered_map, reserved to the count of entries
+	MAP_SORTED, // std::vector<std::pair<Key, Value>>, sorted by key
+};
+
+// @brief Compile the conversion plan of protobuf message type. The plan is
+// compiled once and cached for the whole process, it is immutable and can be
+// shared between threads.
+// @param[in] desc: protobuf message descriptor
+// @param[in] maps: the container of all map members, include the ones of
+// nested structs. The sorted vector is filled in order of message and sorted
+// once, the duplicated keys are failed. The sorted vector can not be parsed
+// from wire format.
+// @return the conversion plan.
+const Plan &CompilePlan(const google::protobuf::Descriptor *desc,
+	MapLayout maps = MAP_TREE);
+
+#ifdef CPS_MEMORY_RESOURCE
+// @brief Compile the conversion plan of protobuf message type, for the struct
+// declared with std::pmr::vector, std::pmr::map and std::pmr::string instead
+// of the std ones (the other members are same). The plan is used same as the
+// one of CompilePlan, cached and shared too.
+// @param[in] desc: protobuf message descriptor
+// @param[in] maps: the container of map members, std::pmr ones too
+// @return the conversion plan.
+const Plan &CompilePmrPlan(const google::protobuf::Descriptor *desc,
+	MapLayout maps = MAP_TREE);
+
+// @brief Convert protobuf message to struct declared with std::pmr containers,
+// all containers and strings (include elements and nested structs) are
+// allocated from resource. The members of struct are reconstructed on
+// resource, so a std::pmr::monotonic_buffer_resource can free the whole
+// result at once. The struct should be destroyed before resource is released.
+// @param[in] plan: plan compiled by CompilePmrPlan from descriptor of msg
+// @param[in] msg: protobuf message
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[in] resource: the memory resource
+// @return true for success, or false for failed.
+bool ProtoToStruct(const Plan &plan, const Message &msg, void *bytes,
+	size_t size, std::pmr::memory_resource *resource);
+#endif
+
+// @brief Convert struct to protobuf message with compiled plan.
+// @param[in] plan: plan compiled from descriptor of msg
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[out] msg: protobuf message
+// @return true for success, or false for failed.
+bool StructToProto(const Plan &plan, const void *bytes, size_t size,
+	Message &msg);
+
+// @brief Convert protobuf message to struct with compiled plan.
+// @param[in] plan: plan compiled from descriptor of msg
+// @param[in] msg: protobuf message
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool ProtoToStruct(const Plan &plan, const Message &msg,
+	void *bytes, size_t size);
+
+// @brief Convert protobuf message to the existing struct with compiled plan.
+bool OverwriteProtoToStruct(const Plan &plan, const Message &msg,
+	void *bytes, size_t size);
+
+// @brief Convert protobuf message to struct, only the fields present in
+// message (listed by reflection) are visited, the other members are reset to
+// default in a single pass, so the cost grows with the populated fields but
+// not the width of schema. Faster for the wide and sparse message.
+// @param[in] plan: plan compiled from descriptor of msg
+// @param[in] msg: protobuf message
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool SparseProtoToStruct(const Plan &plan, const Message &msg,
+	void *bytes, size_t size);
+
+// @brief Convert sparse protobuf message to struct, see above.
+bool SparseProtoToStruct(const Message &msg, void *bytes, size_t size);
+
+// @brief Convert the members changed from prev with compiled plan.
+bool StructDeltaToProto(const Plan &plan, const void *prev, const void *cur,
+	size_t size, Message &msg, google::protobuf::FieldMask *mask = nullptr);
+
+// @brief Compile the fields of message type selected by mask. A path selects
+// the whole field, or the sub fields of (repeated) message field by dotted
+// names, such as "member5.member7". Nothing is cached, keep the selection and
+// reuse it for the same mask, it is immutable and can be shared between
+// threads.
+// @param[in] desc: protobuf message descriptor
+// @param[in] mask: paths of the selected fields
+// @return the compiled selection, or null if a path is invalid.
+std::shared_ptr<const Selection> CompileFieldMask(
+	const google::protobuf::Descriptor *desc,
+	const google::protobuf::FieldMask &mask);
+
+// @brief Convert only the selected fields of struct to protobuf message, the
+// other fields are not changed.
+// @param[in] selection: the fields compiled from mask
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[out] msg: protobuf message
+// @return true for success, or false for failed.
+bool StructToProto(const Selection &selection, const void *bytes,
+	size_t size, Message &msg);
+
+// @brief Convert only the selected fields of protobuf message to struct, the
+// other members are not changed. The struct should be newly constructed.
+// @param[in] selection: the fields compiled from mask
+// @param[in] msg: protobuf message
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool ProtoToStruct(const Selection &selection, const Message &msg,
+	void *bytes, size_t size);
+
+// @brief Parse protobuf wire format to struct directly, without message.
+// The struct should be newly constructed, same as ProtoToStruct. The messages
+// nested deeper than 100 levels are failed, same as protobuf.
+// @param[in] wire: serialized protobuf message
+// @param[in] len: length of wire
+// @param[in] desc: protobuf message descriptor of wire
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool ProtoToStruct(const void *wire, size_t len,
+	const google::protobuf::Descriptor *desc, void *bytes, size_t size);
+
+// @brief Parse protobuf wire format to struct directly with compiled plan.
+// The plan of std::pmr containers is not supported.
+// @param[in] plan: plan compiled from descriptor of wire
+// @param[in] wire: serialized protobuf message
+// @param[in] len: length of wire
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool ProtoToStruct(const Plan &plan, const void *wire, size_t len,
+	void *bytes, size_t size);
+
+#ifdef CPS_STRING_VIEW
+// @brief Compile the conversion plan of protobuf message type, for the read
+// only view struct declared with std::string_view instead of std::string
+// (include keys and values of std::map, and elements of std::vector). The
+// plan is used same as the one of CompilePlan, cached and shared too.
+//
+// Converted from message or wire by this plan, the std::string_view members
+// point to the strings stored in message or wire buffer, no string is copied.
+// So the view is valid only while the source is alive and not modified (for
+// message, include the map fields and the fields cleared or reassigned). The
+// string of message not stored as std::string can not be viewed, and the
+// conversion fails. Converted to message, the strings are copied.
+// @param[in] desc: protobuf message descriptor
+// @param[in] maps: the container of map members
+// @return the conversion plan.
+const Plan &CompileViewPlan(const google::protobuf::Descriptor *desc,
+	MapLayout maps = MAP_TREE);
+#endif
+
+// @brief Serialize struct to protobuf wire format directly, without message.
+// The output is same as the message serialized deterministically, the size is
+// calculated before write, so the string is allocated only once.
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[in] desc: protobuf message descriptor of wire
+// @param[out] out: serialized protobuf message
+// @return true for success, or false for failed.
+bool StructToWire(const void *bytes, size_t size,
+	const google::protobuf::Descriptor *desc, std::string &out);
+
+// @brief Serialize struct to protobuf wire format directly, without message.
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[in] desc: protobuf message descriptor of wire
+// @param[out] out: output stream of serialized protobuf message
+// @return true for success, or false for failed.
+bool StructToWire(const void *bytes, size_t size,
+	const google::protobuf::Descriptor *desc,
+	google::protobuf::io::ZeroCopyOutputStream *out);
+
+// @brief Serialize struct to protobuf wire format directly with compiled plan,
+// the maps of any layout are supported. The entries of std::unordered_map
+// (MAP_HASH) are written in its iteration order, so the output is not
+// deterministic, same as protobuf without deterministic serialization. The
+// plan of std::pmr containers is not supported.
+// @param[in] plan: plan compiled from descriptor of wire
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[out] out: serialized protobuf message
+// @return true for success, or false for failed.
+bool StructToWire(const Plan &plan, const void *bytes, size_t size,
+	std::string &out);
+
+// @brief Serialize struct to protobuf wire format directly with compiled plan.
+// @param[in] plan: plan compiled from descriptor of wire
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[out] out: output stream of serialized protobuf message
+// @return true for success, or false for failed.
+bool StructToWire(const Plan &plan, const void *bytes, size_t size,
+	google::protobuf::io::ZeroCopyOutputStream *out);
+
+// a column of the elements of repeated message, the values of a singular
+// field are contiguous in order of elements.
+struct Column
+{
+	const google::protobuf::FieldDescriptor *field; // field of element
+	size_t width; // sizeof value, or 0 for string
+	// the fundamental values, same type as the struct member: intN_t,
+	// uintN_t, float, double, bool, and int for enum. empty for string.
+	std::vector<uint8_t> values;
+	// string only, the string of element i is data[offsets[i], offsets[i + 1])
+	std::vector<uint64_t> offsets;
+	std::string data; // string only, the strings of elements concatenated
+
+	Column() : field(nullptr), width(0) {}
+
+	// get the values as array of Ty, which is the type of value.
+	template<typename Ty>
+	inline const Ty *cast() const
+	{
+		return reinterpret_cast<const Ty*>(values.data());
+	}
+};
+
+// the columns of repeated message field, one per singular fundamental or string
+// field of element, in order of declaration. the message, repeated and map
+// fields of element are not exported.
+struct Columns
+{
+	size_t rows; // count of elements
+	std::vector<Column> columns;
+
+	Columns() : rows(0) {}
+
+	// @brief Find column by name of field.
+	// @return the column, or null if not found.
+	const Column *find(const std::string &name) const;
+};
+
+// @brief Convert repeated message field to columns, the layout of values is
+// the same as the struct members of element. The existing columns are reused,
+// so the steady conversion allocates nothing.
+// @param[in] msg: protobuf message
+// @param[in] field: repeated message field of msg
+// @param[in,out] columns: the columns of elements
+// @return true for success, or false if field is not repeated message of msg.
+bool ProtoToColumns(const Message &msg,
+	const google::protobuf::FieldDescriptor *field, Columns &columns);
+
 // @brief Convert struct to protobuf message.
 template<typename STRUCT, typename PROTO>
 bool StructToProto(const STRUCT &in, PROTO &out)
@@ -46,6 +383,23 @@ bool StructToProto(const STRUCT &in, PROTO &out)
 	return StructToProto(&in, sizeof(STRUCT), out);
 }
 
+// @brief Convert rvalue struct to protobuf message, move strings to message.
+template<typename STRUCT, typename PROTO>
+typename std::enable_if<!std::is_reference<STRUCT>::value &&
+	!std::is_const<STRUCT>::value, bool>::type
+StructToProto(STRUCT &&in, PROTO &out)
+{
+	return MoveStructToProto(&in, sizeof(STRUCT), out);
+}
+
+// @brief Convert struct to a new PROTO allocated on arena.
+template<typename PROTO, typename STRUCT>
+PROTO *StructToProto(const STRUCT &in, google::protobuf::Arena *arena)
+{
+	return static_cast<PROTO*>(StructToProto(&in, sizeof(STRUCT),
+		PROTO::default_instance(), arena));
+}
+
 // @brief Convert protobuf message to struct.
 template<typename PROTO, typename STRUCT>
 bool ProtoToStruct(const PROTO &in, STRUCT &out)
@@ -53,6 +407,187 @@ bool ProtoToStruct(const PROTO &in, STRUCT &out)
 	return ProtoToStruct(in, &out, sizeof(STRUCT));
 }
 
+// @brief Convert rvalue protobuf message to struct, steal strings of message.
+template<typename PROTO, typename STRUCT>
+typename std::enable_if<!std::is_reference<PROTO>::value &&
+	!std::is_const<PROTO>::value, bool>::type
+ProtoToStruct(PROTO &&in, STRUCT &out)
+{
+	return MoveProtoToStruct(in, &out, sizeof(STRUCT));
+}
+
+// @brief Convert the members of cur changed from prev to protobuf message.
+template<typename STRUCT, typename PROTO>
+bool StructDeltaToProto(const STRUCT &prev, const STRUCT &cur, PROTO &msg,
+	google::protobuf::FieldMask *mask = nullptr)
+{
+	return StructDeltaToProto(&prev, &cur, sizeof(STRUCT), msg, mask);
+}
+
+// @brief Convert the fields of struct selected by selection to protobuf
+// message.
+template<typename STRUCT, typename PROTO>
+bool StructToProto(const STRUCT &in, PROTO &out, const Selection &selection)
+{
+	return StructToProto(selection, &in, sizeof(STRUCT), out);
+}
+
+// @brief Convert the fields of protobuf message selected by selection to
+// struct.
+template<typename PROTO, typename STRUCT>
+bool ProtoToStruct(const PROTO &in, STRUCT &out, const Selection &selection)
+{
+	return ProtoToStruct(selection, in, &out, sizeof(STRUCT));
+}
+
+// @brief Convert the fields of struct selected by mask to protobuf message.
+// The mask is compiled on each call, use the selection from CompileFieldMask
+// in the hot path.
+template<typename STRUCT, typename PROTO>
+bool StructToProto(const STRUCT &in, PROTO &out,
+	const google::protobuf::FieldMask &mask)
+{
+	auto selection = CompileFieldMask(PROTO::descriptor(), mask);
+	return selection != nullptr && StructToProto(in, out, *selection);
+}
+
+// @brief Convert the fields of protobuf message selected by mask to struct.
+// The mask is compiled on each call, use the selection from CompileFieldMask
+// in the hot path.
+template<typename PROTO, typename STRUCT>
+bool ProtoToStruct(const PROTO &in, STRUCT &out,
+	const google::protobuf::FieldMask &mask)
+{
+	auto selection = CompileFieldMask(PROTO::descriptor(), mask);
+	return selection != nullptr && ProtoToStruct(in, out, *selection);
+}
+
+// @brief Convert protobuf message to the existing struct in place.
+template<typename PROTO, typename STRUCT>
+bool OverwriteProtoToStruct(const PROTO &in, STRUCT &out)
+{
+	return OverwriteProtoToStruct(in, &out, sizeof(STRUCT));
+}
+
+// @brief Convert sparse protobuf message to struct.
+template<typename PROTO, typename STRUCT>
+bool SparseProtoToStruct(const PROTO &in, STRUCT &out)
+{
+	return SparseProtoToStruct(in, &out, sizeof(STRUCT));
+}
+
+#ifdef CPS_MEMORY_RESOURCE
+// @brief Convert protobuf message to struct with std::pmr containers, which
+// are allocated from resource.
+template<typename PROTO, typename STRUCT>
+bool ProtoToStruct(const PROTO &in, STRUCT &out,
+	std::pmr::memory_resource *resource)
+{
+	return ProtoToStruct(CompilePmrPlan(PROTO::descriptor()), in, &out,
+		sizeof(STRUCT), resource);
+}
+#endif
+
+// @brief Parse protobuf wire format of PROTO to struct.
+template<typename PROTO, typename STRUCT>
+bool ProtoToStruct(const void *wire, size_t len, STRUCT &out)
+{
+	return ProtoToStruct(wire, len, PROTO::descriptor(), &out, sizeof(STRUCT));
+}
+
+#ifdef CPS_STRING_VIEW
+// @brief Convert protobuf message to view struct, the std::string_view members
+// point to the strings of message, see CompileViewPlan.
+template<typename PROTO, typename STRUCT>
+bool ProtoToView(const PROTO &in, STRUCT &out)
+{
+	return ProtoToStruct(CompileViewPlan(PROTO::descriptor()), in, &out,
+		sizeof(STRUCT));
+}
+
+// @brief Parse protobuf wire format of PROTO to view struct, the
+// std::string_view members point to the wire buffer, see CompileViewPlan.
+template<typename PROTO, typename STRUCT>
+bool ProtoToView(const void *wire, size_t len, STRUCT &out)
+{
+	return ProtoToStruct(CompileViewPlan(PROTO::descriptor()), wire, len,
+		&out, sizeof(STRUCT));
+}
+
+// @brief Convert view struct to protobuf message, the strings are copied.
+template<typename STRUCT, typename PROTO>
+bool ViewToProto(const STRUCT &in, PROTO &out)
+{
+	return StructToProto(CompileViewPlan(PROTO::descriptor()), &in,
+		sizeof(STRUCT), out);
+}
+#endif
+
+// @brief Serialize struct to protobuf wire format of PROTO.
+template<typename PROTO, typename STRUCT>
+bool StructToWire(const STRUCT &in, std::string &out)
+{
+	return StructToWire(&in, sizeof(STRUCT), PROTO::descriptor(), out);
+}
+
+// @brief Batch converter between array of STRUCT and repeated PROTO. The
+// plan is resolved once when constructed, and the output is reserved before
+// conversion, so the cost per record is only the conversion of fields.
+// The converter is immutable, and can be shared between threads.
+template<typename STRUCT, typename PROTO>
+class Converter
+{
+private:
+	const Plan &_plan; // plan of PROTO
+public:
+	Converter() : _plan(CompilePlan(PROTO::descriptor())) {}
+
+	// @brief Convert structs, and append to repeated messages.
+	// @param[in] in: pointer to the first struct
+	// @param[in] count: count of structs
+	// @param[out] out: repeated messages, the messages are appended
+	// @return true for success, or false for failed and out is not changed.
+	bool to_proto(const STRUCT *in, size_t count,
+		google::protobuf::RepeatedPtrField<PROTO> &out) const
+	{
+		int base = out.size();
+		out.Reserve(base + static_cast<int>(count));
+		for (size_t i = 0; i < count; ++i) {
+			if (!StructToProto(_plan, &in[i], sizeof(STRUCT), *out.Add())) {
+				out.DeleteSubrange(base, out.size() - base);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// @brief Convert structs, and append to repeated messages.
+	bool to_proto(const std::vector<STRUCT> &in,
+		google::protobuf::RepeatedPtrField<PROTO> &out) const
+	{
+		return to_proto(in.data(), in.size(), out);
+	}
+
+	// @brief Convert repeated messages, and append to structs.
+	// @param[in] in: repeated messages
+	// @param[out] out: structs, the structs are appended
+	// @return true for success, or false for failed and out is not changed.
+	bool to_struct(const google::protobuf::RepeatedPtrField<PROTO> &in,
+		std::vector<STRUCT> &out) const
+	{
+		size_t base = out.size();
+		out.resize(base + static_cast<size_t>(in.size()));
+		STRUCT *data = out.data() + base;
+		for (const PROTO &msg : in) {
+			if (!ProtoToStruct(_plan, msg, data++, sizeof(STRUCT))) {
+				out.resize(base); // the partial structs are dropped
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
 } // namespace cps
 
 #endif // _CONVERT_PROTO_STRUCT_INC_
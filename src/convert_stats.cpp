@@ -0,0 +1,279 @@
+#include "convert_stats.h"
+#include "convert_plan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace cps
+{
+
+// ==================== latency histogram ====================
+
+uint64_t Histogram::percentile(double ratio) const
+{
+	uint64_t total = 0;
+	for (int i = 0; i < BUCKETS; ++i) {
+		total += counts[i];
+	}
+	if (total == 0) {
+		return 0;
+	}
+	// the rank of call in order of latency, from 1.
+	auto rank = static_cast<uint64_t>(std::ceil(ratio * total));
+	if (rank < 1) {
+		rank = 1;
+	}
+	uint64_t seen = 0;
+	for (int i = 0; i < BUCKETS - 1; ++i) {
+		seen += counts[i];
+		if (seen >= rank) {
+			return static_cast<uint64_t>(1) << (i + 1);
+		}
+	}
+	return static_cast<uint64_t>(1) << BUCKETS;
+}
+
+#ifdef CPS_STATS
+
+// add the statistics of b to a.
+static void AddStats(Stats &a, const Stats &b, bool subtract = false)
+{
+	auto add = [subtract](uint64_t &x, uint64_t y) {
+		x = subtract ? x - y : x + y;
+	};
+	add(a.calls, b.calls);
+	for (int i = 0; i < FAILURE_COUNT; ++i) {
+		add(a.failures[i], b.failures[i]);
+	}
+	add(a.elements, b.elements);
+	add(a.bytes, b.bytes);
+	add(a.nanoseconds, b.nanoseconds);
+	for (int i = 0; i < Histogram::BUCKETS; ++i) {
+		add(a.latency.counts[i], b.latency.counts[i]);
+	}
+}
+
+// add the statistics of all types of b to a.
+static void AddSnapshot(StatsSnapshot &a, const StatsSnapshot &b,
+	bool subtract = false)
+{
+	for (auto &pair : b) {
+		auto &stats = a[pair.first];
+		AddStats(stats.to_proto, pair.second.to_proto, subtract);
+		AddStats(stats.to_struct, pair.second.to_struct, subtract);
+	}
+}
+
+// ==================== counters of threads ====================
+
+// the counters of a message type in a direction. only written by the owner
+// thread, so increased without read-modify-write, and read by snapshot
+// concurrently.
+struct Counters
+{
+	std::atomic<uint64_t> calls;
+	std::atomic<uint64_t> failures[FAILURE_COUNT];
+	std::atomic<uint64_t> elements;
+	std::atomic<uint64_t> bytes;
+	std::atomic<uint64_t> nanoseconds;
+	std::atomic<uint64_t> latency[Histogram::BUCKETS];
+};
+
+static inline void Increase(std::atomic<uint64_t> &counter, uint64_t count)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + count,
+		std::memory_order_relaxed);
+}
+
+static void ReadCounters(Stats &stats, const Counters &counters)
+{
+	stats.calls = counters.calls.load(std::memory_order_relaxed);
+	for (int i = 0; i < FAILURE_COUNT; ++i) {
+		stats.failures[i] =
+			counters.failures[i].load(std::memory_order_relaxed);
+	}
+	stats.elements = counters.elements.load(std::memory_order_relaxed);
+	stats.bytes = counters.bytes.load(std::memory_order_relaxed);
+	stats.nanoseconds = counters.nanoseconds.load(std::memory_order_relaxed);
+	for (int i = 0; i < Histogram::BUCKETS; ++i) {
+		stats.latency.counts[i] =
+			counters.latency[i].load(std::memory_order_relaxed);
+	}
+}
+
+// the counters of all message types converted by a thread.
+class Shard
+{
+private:
+	std::mutex _mutex; // guards insertion by owner and read by snapshot
+	std::unordered_map<const Descriptor*,
+		std::unique_ptr<Counters[]>> _types; // DIRECTION_COUNT per type
+public:
+	// get the counters of type, only called by the owner thread.
+	Counters &get(const Descriptor *desc, Direction direction)
+	{
+		// only the owner inserts, so it finds without lock.
+		auto iter = _types.find(desc);
+		if (iter == _types.end()) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			iter = _types.emplace(desc, std::unique_ptr<Counters[]>(
+				new Counters[DIRECTION_COUNT]())).first;
+		}
+		return iter->second[direction];
+	}
+
+	// add the counters to snapshot.
+	void read(StatsSnapshot &snapshot)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (auto &pair : _types) {
+			auto &stats = snapshot[pair.first->full_name()];
+			Stats counters;
+			ReadCounters(counters, pair.second[DIRECTION_TO_PROTO]);
+			AddStats(stats.to_proto, counters);
+			ReadCounters(counters, pair.second[DIRECTION_TO_STRUCT]);
+			AddStats(stats.to_struct, counters);
+		}
+	}
+};
+
+// the shards of running threads, and the counters of finished threads.
+class Registry
+{
+private:
+	std::mutex _mutex;
+	std::vector<Shard*> _shards; // shards of running threads
+	StatsSnapshot _finished; // counters of finished threads
+	StatsSnapshot _baseline; // counters at the last reset
+public:
+	// never destroyed, the threads may finish after exit.
+	static Registry &Get()
+	{
+		static Registry *registry = new Registry;
+		return *registry;
+	}
+
+	void add(Shard *shard)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_shards.push_back(shard);
+	}
+
+	// keep the counters of shard after its thread is finished.
+	void remove(Shard *shard)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		shard->read(_finished);
+		_shards.erase(std::find(_shards.begin(), _shards.end(), shard));
+	}
+
+	StatsSnapshot snapshot()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto snapshot = total();
+		AddSnapshot(snapshot, _baseline, true);
+		// the types not converted since the last reset.
+		for (auto iter = snapshot.begin(); iter != snapshot.end();) {
+			if (iter->second.to_proto.calls == 0 &&
+				iter->second.to_struct.calls == 0) {
+				iter = snapshot.erase(iter);
+			} else {
+				++iter;
+			}
+		}
+		return snapshot;
+	}
+
+	// the counters are only increased by owners, reset by a baseline.
+	void reset()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_baseline = total();
+	}
+private:
+	// the counters since started, the registry must be locked.
+	StatsSnapshot total()
+	{
+		auto snapshot = _finished;
+		for (auto shard : _shards) {
+			shard->read(snapshot);
+		}
+		return snapshot;
+	}
+};
+
+// the shard of this thread, registered at the first call.
+static Shard &LocalShard()
+{
+	struct Local
+	{
+		Shard shard;
+		Local() { Registry::Get().add(&shard); }
+		~Local() { Registry::Get().remove(&shard); }
+	};
+	static thread_local Local local;
+	return local.shard;
+}
+
+// ==================== probe of call ====================
+
+Probe::Probe(const Descriptor *desc, Direction direction)
+	: _desc(desc), _direction(direction), _failure(FAILURE_COUNT)
+	, _succeeded(false), _elements(0), _bytes(0)
+	, _start(std::chrono::steady_clock::now()), _outer(Current())
+{
+	Current() = this;
+}
+
+Probe::~Probe()
+{
+	auto elapsed = std::chrono::steady_clock::now() - _start;
+	Current() = _outer;
+	auto nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<
+		std::chrono::nanoseconds>(elapsed).count());
+	auto &counters = LocalShard().get(_desc, _direction);
+	Increase(counters.calls, 1);
+	if (!_succeeded) {
+		Increase(counters.failures[_failure != FAILURE_COUNT ? _failure
+			: FAILURE_FIELD], 1);
+	}
+	Increase(counters.elements, _elements);
+	Increase(counters.bytes, _bytes);
+	Increase(counters.nanoseconds, nanoseconds);
+	int bucket = 0;
+	for (uint64_t value = nanoseconds >> 1; value != 0 &&
+		bucket < Histogram::BUCKETS - 1; value >>= 1) {
+		++bucket;
+	}
+	Increase(counters.latency[bucket], 1);
+}
+
+StatsSnapshot SnapshotStats()
+{
+	return Registry::Get().snapshot();
+}
+
+void ResetStats()
+{
+	Registry::Get().reset();
+}
+
+#else
+
+StatsSnapshot SnapshotStats()
+{
+	return StatsSnapshot();
+}
+
+void ResetStats()
+{
+}
+
+#endif
+
+} // namespace cps
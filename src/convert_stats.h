@@ -0,0 +1,96 @@
+// Copyright 2021 genrwoody@163.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The statistics of conversions, collected only if the library is compiled
+// with CPS_STATS defined (cmake -DCPS_STATS=ON), otherwise the hooks are
+// compiled out, and the snapshot is always empty. Every public conversion
+// function of the library is counted as a call of its message type, the
+// nested messages are counted in the call. The inline converters generated
+// by protoc-gen-cps are not counted.
+
+#ifndef _CONVERT_STATS_INC_
+#define _CONVERT_STATS_INC_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace cps
+{
+
+// the reason of failed conversion.
+enum Failure
+{
+	FAILURE_DESCRIPTOR,     // plan or selection is not compiled for message
+	FAILURE_SIZE,           // sizeof struct is not match the plan
+	FAILURE_CONTAINERS,     // the containers of plan are not supported
+	FAILURE_VIEW,           // the string is not stored as std::string
+	FAILURE_DUPLICATED_KEY, // the keys of sorted vector are duplicated
+	FAILURE_WIRE,           // wire format is malformed or larger than 2GB
+	FAILURE_FIELD,          // a field can not be converted
+	FAILURE_COUNT,
+};
+
+// the histogram of latency, counts[i] is the count of calls taken
+// [2^i, 2^(i+1)) nanoseconds, counts[0] includes 0, and the last one includes
+// all the longer calls.
+struct Histogram
+{
+	static const int BUCKETS = 32;
+	uint64_t counts[BUCKETS];
+
+	// @brief Get the latency not less than ratio of calls taken.
+	// @param[in] ratio: in [0, 1], e.g. 0.99 for p99
+	// @return the upper bound of bucket in nanoseconds, or 0 if no call.
+	uint64_t percentile(double ratio) const;
+};
+
+// the statistics of a message type in one direction.
+struct Stats
+{
+	uint64_t calls; // count of calls, include the failed ones
+	uint64_t failures[FAILURE_COUNT]; // count of failed calls by reason
+	uint64_t elements; // elements of repeated fields and pairs of maps
+	uint64_t bytes; // bytes of strings, include keys and values of maps
+	uint64_t nanoseconds; // total latency of calls
+	Histogram latency; // latency of calls
+};
+
+// the statistics of a message type.
+struct TypeStats
+{
+	Stats to_proto; // struct to message or wire format
+	Stats to_struct; // message or wire format to struct
+};
+
+// the statistics keyed by Descriptor::full_name().
+typedef std::map<std::string, TypeStats> StatsSnapshot;
+
+// @brief Get the statistics of all threads since the last reset. The counters
+// are written by the converting threads without lock, the snapshot is never
+// blocked by them, but may miss the calls not finished yet. The elements and
+// bytes converted by the other threads of a parallel conversion are not
+// counted.
+// @return the statistics of message types converted since the last reset,
+// empty if the library is compiled without CPS_STATS.
+StatsSnapshot SnapshotStats();
+
+// @brief Reset the statistics of all threads, the later snapshot only counts
+// the calls after.
+void ResetStats();
+
+} // namespace cps
+
+#endif // _CONVERT_STATS_INC_
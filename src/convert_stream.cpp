@@ -0,0 +1,203 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "convert_stream.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace cps
+{
+
+// ==================== memory mapped file ====================
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+	: _data(nullptr), _size(0), _file(INVALID_HANDLE_VALUE), _mapping(nullptr)
+{
+}
+
+bool MappedFile::open(const std::string &path)
+{
+	close();
+	_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (_file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(_file, &size) ||
+		static_cast<uint64_t>(size.QuadPart) > SIZE_MAX) {
+		close();
+		return false;
+	}
+	_size = static_cast<size_t>(size.QuadPart);
+	if (_size == 0) {
+		return true; // the empty file can not be mapped
+	}
+	_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0,
+		nullptr);
+	if (_mapping == nullptr) {
+		close();
+		return false;
+	}
+	_data = static_cast<const uint8_t*>(MapViewOfFile(_mapping,
+		FILE_MAP_READ, 0, 0, 0));
+	if (_data == nullptr) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (_data != nullptr) {
+		UnmapViewOfFile(_data);
+	}
+	if (_mapping != nullptr) {
+		CloseHandle(_mapping);
+	}
+	if (_file != INVALID_HANDLE_VALUE) {
+		CloseHandle(_file);
+	}
+	_data = nullptr;
+	_size = 0;
+	_mapping = nullptr;
+	_file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile()
+	: _data(nullptr), _size(0)
+{
+}
+
+bool MappedFile::open(const std::string &path)
+{
+	close();
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 ||
+		static_cast<uint64_t>(info.st_size) > SIZE_MAX) {
+		::close(fd);
+		return false;
+	}
+	_size = static_cast<size_t>(info.st_size);
+	if (_size == 0) {
+		::close(fd);
+		return true; // the empty file can not be mapped
+	}
+	void *data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping is kept after the file is closed.
+	::close(fd);
+	if (data == MAP_FAILED) {
+		_size = 0;
+		return false;
+	}
+	// the records are read in order, the pages are read ahead.
+	madvise(data, _size, MADV_SEQUENTIAL);
+	_data = static_cast<const uint8_t*>(data);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (_data != nullptr) {
+		munmap(const_cast<uint8_t*>(_data), _size);
+	}
+	_data = nullptr;
+	_size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+// ==================== length delimited records ====================
+
+bool RecordReader::next(const uint8_t *&record, size_t &size)
+{
+	if (_ptr >= _end) {
+		return false; // end of buffer
+	}
+	uint64_t length = 0;
+	for (int shift = 0; ; shift += 7) {
+		if (shift >= 64 || _ptr >= _end) {
+			_failed = true; // truncated or too long
+			return false;
+		}
+		uint8_t byte = *_ptr++;
+		length |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			break;
+		}
+	}
+	if (length > static_cast<uint64_t>(_end - _ptr)) {
+		_failed = true; // truncated
+		return false;
+	}
+	record = _ptr;
+	size = static_cast<size_t>(length);
+	_ptr += size;
+	return true;
+}
+
+bool RecordWriter::open(const std::string &path)
+{
+	close();
+	_file = std::fopen(path.c_str(), "wb");
+	return _file != nullptr;
+}
+
+bool RecordWriter::close()
+{
+	if (_file == nullptr) {
+		return true;
+	}
+	bool result = std::fclose(_file) == 0;
+	_file = nullptr;
+	return result;
+}
+
+bool RecordWriter::write(const Plan &plan, const void *bytes, size_t size)
+{
+	if (_file == nullptr || !StructToWire(plan, bytes, size, _buffer)) {
+		return false;
+	}
+	// varint of length, the record is less than 2GB.
+	uint8_t prefix[10];
+	size_t count = 0;
+	for (uint64_t length = _buffer.size(); ; length >>= 7) {
+		if (length < 0x80) {
+			prefix[count++] = static_cast<uint8_t>(length);
+			break;
+		}
+		prefix[count++] = static_cast<uint8_t>(length | 0x80);
+	}
+	return std::fwrite(prefix, 1, count, _file) == count &&
+		std::fwrite(_buffer.data(), 1, _buffer.size(), _file) ==
+		_buffer.size();
+}
+
+bool RecordWriter::write(const void *bytes, size_t size,
+	const google::protobuf::Descriptor *desc)
+{
+	return write(CompilePlan(desc), bytes, size);
+}
+
+} // namespace cps
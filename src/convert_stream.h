@@ -0,0 +1,252 @@
+// Copyright 2021 genrwoody@163.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _CONVERT_STREAM_INC_
+#define _CONVERT_STREAM_INC_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "convert_proto_struct.h"
+
+namespace cps
+{
+
+// a read only file mapped to memory, the pages are read by the system on
+// demand, so the memory is not grown with the size of file.
+class MappedFile
+{
+private:
+	const uint8_t *_data; // the mapped file, or null if empty
+	size_t _size; // size of file
+#ifdef _WIN32
+	void *_file; // HANDLE of file
+	void *_mapping; // HANDLE of file mapping
+#endif
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile &operator=(const MappedFile&) = delete;
+
+	// @brief Map the whole file, the opened one is closed before.
+	// @param[in] path: path of file
+	// @return true for success, or false for failed.
+	bool open(const std::string &path);
+
+	// @brief Unmap the file, the pointers to it are invalid after.
+	void close();
+
+	// get the mapped file.
+	inline const uint8_t *data() const { return _data; }
+
+	// get size of file.
+	inline size_t size() const { return _size; }
+};
+
+// read the length delimited records in buffer, each record is the varint of
+// length followed by the serialized message, the same as
+// google::protobuf::util::SerializeDelimitedToOstream.
+class RecordReader
+{
+private:
+	const uint8_t *_ptr; // the next record
+	const uint8_t *_end; // end of buffer
+	bool _failed; // the record is truncated
+public:
+	RecordReader(const uint8_t *data = nullptr, size_t size = 0)
+		: _ptr(data), _end(data + size), _failed(false) {}
+
+	// @brief Read the next record.
+	// @param[out] record: the serialized message in buffer
+	// @param[out] size: size of record
+	// @return true for a record, or false at end of buffer, or the record is
+	// truncated, see failed().
+	bool next(const uint8_t *&record, size_t &size);
+
+	// the buffer is ended with a truncated record.
+	inline bool failed() const { return _failed; }
+};
+
+// write the length delimited records to file, the buffer of record is reused,
+// so the memory is not grown with the count of records.
+class RecordWriter
+{
+private:
+	std::FILE *_file;
+	std::string _buffer; // serialized record
+public:
+	RecordWriter() : _file(nullptr) {}
+	~RecordWriter() { close(); }
+	RecordWriter(const RecordWriter&) = delete;
+	RecordWriter &operator=(const RecordWriter&) = delete;
+
+	// @brief Create or truncate the file, the opened one is closed before.
+	// @param[in] path: path of file
+	// @return true for success, or false for failed.
+	bool open(const std::string &path);
+
+	// @brief Flush and close the file.
+	// @return true for success, or false if failed to write.
+	bool close();
+
+	// @brief Serialize struct to protobuf wire format, and write as a record.
+	// @param[in] plan: plan compiled from descriptor of record, the plan of
+	// std::pmr containers is not supported
+	// @param[in] bytes: pointer to struct
+	// @param[in] size: sizeof struct
+	// @return true for success, or false for failed.
+	bool write(const Plan &plan, const void *bytes, size_t size);
+
+	// @brief Serialize struct to protobuf wire format, and write as a record.
+	// @param[in] bytes: pointer to struct
+	// @param[in] size: sizeof struct
+	// @param[in] desc: protobuf message descriptor of record
+	// @return true for success, or false for failed.
+	bool write(const void *bytes, size_t size,
+		const google::protobuf::Descriptor *desc);
+};
+
+// @brief Reader of the file of length delimited PROTO records, which are
+// parsed to STRUCT directly from the mapped file one by one, no message is
+// created. The memory is constant regardless of the size of file.
+template<typename PROTO, typename STRUCT>
+class StreamReader
+{
+private:
+	const Plan &_plan; // plan of PROTO
+	MappedFile _file;
+	RecordReader _records;
+	bool _failed; // a record is failed to read or convert
+public:
+	// @param[in] plan: plan compiled from descriptor of PROTO. for the view
+	// struct compiled by CompileViewPlan, the strings view the mapped file,
+	// valid until the reader is closed.
+	explicit StreamReader(const Plan &plan = CompilePlan(PROTO::descriptor()))
+		: _plan(plan), _failed(false) {}
+
+	// @brief Map the file, and read from the first record.
+	// @param[in] path: path of file
+	// @return true for success, or false for failed.
+	bool open(const std::string &path)
+	{
+		_failed = false;
+		if (!_file.open(path)) {
+			return false;
+		}
+		_records = RecordReader(_file.data(), _file.size());
+		return true;
+	}
+
+	// @brief Unmap the file.
+	void close()
+	{
+		_file.close();
+		_records = RecordReader();
+	}
+
+	// @brief Read and convert the next record.
+	// @param[out] value: the struct, reset before converted
+	// @return true for a record, or false at end of file or failed, see
+	// failed().
+	bool next(STRUCT &value)
+	{
+		value = STRUCT();
+		return read(value);
+	}
+
+	// @brief Read and convert all the remaining records.
+	// @param[in] func: called as func(STRUCT &value) for every record, the
+	// value can be moved away.
+	// @return true for success, or false for failed.
+	template<typename Func>
+	bool for_each(Func func)
+	{
+		while (true) {
+			STRUCT value;
+			if (!read(value)) {
+				return !_failed;
+			}
+			func(value);
+		}
+	}
+
+	// a record is failed to read or convert.
+	inline bool failed() const { return _failed; }
+private:
+	// read and convert the next record to the newly constructed struct.
+	bool read(STRUCT &value)
+	{
+		const uint8_t *record = nullptr;
+		size_t size = 0;
+		if (_failed || !_records.next(record, size)) {
+			_failed = _failed || _records.failed();
+			return false;
+		}
+		if (!ProtoToStruct(_plan, record, size, &value, sizeof(STRUCT))) {
+			_failed = true;
+			return false;
+		}
+		return true;
+	}
+};
+
+// @brief Writer of the file of length delimited PROTO records, serialized from
+// STRUCT directly, no message is created.
+template<typename PROTO, typename STRUCT>
+class StreamWriter
+{
+private:
+	const Plan &_plan; // plan of PROTO
+	RecordWriter _records;
+public:
+	// @param[in] plan: plan compiled from descriptor of PROTO, such as the
+	// plan of sorted maps or view struct. the plan of std::pmr containers is
+	// not supported.
+	explicit StreamWriter(const Plan &plan = CompilePlan(PROTO::descriptor()))
+		: _plan(plan) {}
+
+	// @brief Create or truncate the file.
+	bool open(const std::string &path) { return _records.open(path); }
+
+	// @brief Flush and close the file.
+	// @return true for success, or false if failed to write.
+	bool close() { return _records.close(); }
+
+	// @brief Write struct as a record.
+	// @return true for success, or false for failed.
+	bool write(const STRUCT &value)
+	{
+		return _records.write(_plan, &value, sizeof(STRUCT));
+	}
+
+	// @brief Write the structs in [begin, end) as records.
+	// @return true for success, or false for failed.
+	template<typename Iter>
+	bool write(Iter begin, Iter end)
+	{
+		for (; begin != end; ++begin) {
+			if (!write(*begin)) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+} // namespace cps
+
+#endif // _CONVERT_STREAM_INC_
@@ -0,0 +1,1196 @@
+#include "convert_proto_struct.h"
+#include "convert_plan.h"
+
+#include <climits>
+#include <cstring>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format_lite.h>
+
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::ZeroCopyOutputStream;
+using google::protobuf::internal::WireFormatLite;
+
+namespace cps
+{
+
+// ==================== parse protobuf wire format to struct ====================
+
+// max depth of nested messages and groups, same as the default recursion limit
+// of protobuf.
+static const int kMaxDepth = 100;
+
+// decode protobuf wire format, and write to struct.
+class WireDecoder
+{
+private:
+	const uint8_t *_ptr; // read position
+	const uint8_t *_end; // end of buffer
+	int _depth; // depth of the message decoded, 0 for the outermost one
+public:
+	WireDecoder(const uint8_t *ptr, const uint8_t *end, int depth = 0)
+		: _ptr(ptr), _end(end), _depth(depth) {}
+
+	// decode message to struct.
+	bool decode(const Plan &plan, uint8_t *bytes);
+
+private:
+	inline bool eof() const { return _ptr >= _end; }
+
+	bool read_varint(uint64_t &value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 64 && _ptr < _end; shift += 7) {
+			uint8_t byte = *_ptr++;
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0) {
+				return true;
+			}
+		}
+		return false; // truncated or too long
+	}
+
+	bool read_tag(int &number, int &wire_type)
+	{
+		uint64_t tag = 0;
+		if (!read_varint(tag) || tag > 0xFFFFFFFF) {
+			return false;
+		}
+		number = WireFormatLite::GetTagFieldNumber(static_cast<uint32_t>(tag));
+		wire_type = WireFormatLite::GetTagWireType(static_cast<uint32_t>(tag));
+		return number != 0;
+	}
+
+	template<typename Ty>
+	bool read_fixed(Ty &value)
+	{
+		if (_end - _ptr < static_cast<ptrdiff_t>(sizeof(Ty))) {
+			return false;
+		}
+		// protobuf is little endian
+		value = 0;
+		for (size_t i = 0; i < sizeof(Ty); ++i) {
+			value |= static_cast<Ty>(_ptr[i]) << (i * 8);
+		}
+		_ptr += sizeof(Ty);
+		return true;
+	}
+
+	// read length delimited data.
+	bool read_length(const uint8_t *&data, size_t &size)
+	{
+		uint64_t length = 0;
+		if (!read_varint(length) ||
+			length > static_cast<uint64_t>(_end - _ptr)) {
+			return false;
+		}
+		data = _ptr;
+		size = static_cast<size_t>(length);
+		_ptr += size;
+		return true;
+	}
+
+	// skip an unknown field.
+	bool skip(int number, int wire_type);
+
+	// skip the fields of group until the end group of number.
+	bool skip_group(int number);
+
+	// read a scalar value, and convert to the c++ type of field.
+	template<typename Ty>
+	bool read_scalar(FieldDescriptor::Type type, Ty &value);
+
+	// decode one field value of op.
+	bool decode_field(const Op &op, int wire_type, uint8_t *bytes);
+
+	template<typename Ty>
+	bool decode_value(const Op &op, int wire_type, uint8_t *bytes);
+
+	bool decode_string(const Op &op, int wire_type, uint8_t *bytes);
+
+	// view the string in wire buffer.
+	bool view_string(const Op &op, const char *text, size_t size,
+		uint8_t *bytes);
+
+	bool decode_message(const Op &op, int wire_type, uint8_t *bytes);
+
+	bool decode_map(const Op &op, int wire_type, uint8_t *bytes);
+
+	// count the repeated messages, and construct all elements once, so the
+	// elements are never moved after constructed.
+	bool prepare_messages(const Plan &plan, uint8_t *bytes,
+		std::vector<size_t> &cursors);
+};
+
+bool WireDecoder::skip(int number, int wire_type)
+{
+	uint64_t value = 0;
+	uint32_t fixed32 = 0;
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+	switch (wire_type) {
+	case WireFormatLite::WIRETYPE_VARINT:
+		return read_varint(value);
+	case WireFormatLite::WIRETYPE_FIXED64:
+		return read_fixed(value);
+	case WireFormatLite::WIRETYPE_LENGTH_DELIMITED:
+		return read_length(data, size);
+	case WireFormatLite::WIRETYPE_FIXED32:
+		return read_fixed(fixed32);
+	case WireFormatLite::WIRETYPE_START_GROUP:
+		return skip_group(number);
+	default:
+		return false; // unexpected end group or invalid wire type
+	}
+}
+
+bool WireDecoder::skip_group(int number)
+{
+	if (_depth >= kMaxDepth) {
+		return false; // nested too deep
+	}
+	// the group is nested as a message.
+	WireDecoder group(_ptr, _end, _depth + 1);
+	while (!group.eof()) {
+		int sub_number = 0, sub_wire_type = 0;
+		if (!group.read_tag(sub_number, sub_wire_type)) {
+			return false;
+		}
+		if (sub_wire_type == WireFormatLite::WIRETYPE_END_GROUP) {
+			_ptr = group._ptr;
+			return sub_number == number;
+		}
+		if (!group.skip(sub_number, sub_wire_type)) {
+			return false;
+		}
+	}
+	return false;
+}
+
+template<typename Ty>
+bool WireDecoder::read_scalar(FieldDescriptor::Type type, Ty &value)
+{
+	uint64_t raw = 0;
+	uint32_t raw32 = 0;
+	switch (type) {
+	case FieldDescriptor::TYPE_INT32:
+	case FieldDescriptor::TYPE_INT64:
+	case FieldDescriptor::TYPE_UINT32:
+	case FieldDescriptor::TYPE_UINT64:
+	case FieldDescriptor::TYPE_ENUM:
+		if (!read_varint(raw)) {
+			return false;
+		}
+		value = static_cast<Ty>(raw);
+		return true;
+	case FieldDescriptor::TYPE_BOOL:
+		if (!read_varint(raw)) {
+			return false;
+		}
+		value = static_cast<Ty>(raw != 0);
+		return true;
+	case FieldDescriptor::TYPE_SINT32:
+		if (!read_varint(raw)) {
+			return false;
+		}
+		raw32 = static_cast<uint32_t>(raw);
+		value = static_cast<Ty>(WireFormatLite::ZigZagDecode32(raw32));
+		return true;
+	case FieldDescriptor::TYPE_SINT64:
+		if (!read_varint(raw)) {
+			return false;
+		}
+		value = static_cast<Ty>(WireFormatLite::ZigZagDecode64(raw));
+		return true;
+	case FieldDescriptor::TYPE_FIXED32:
+	case FieldDescriptor::TYPE_SFIXED32:
+		if (!read_fixed(raw32)) {
+			return false;
+		}
+		value = static_cast<Ty>(raw32);
+		return true;
+	case FieldDescriptor::TYPE_FIXED64:
+	case FieldDescriptor::TYPE_SFIXED64:
+		if (!read_fixed(raw)) {
+			return false;
+		}
+		value = static_cast<Ty>(raw);
+		return true;
+	case FieldDescriptor::TYPE_FLOAT:
+		if (!read_fixed(raw32)) {
+			return false;
+		}
+		value = static_cast<Ty>(WireFormatLite::DecodeFloat(raw32));
+		return true;
+	case FieldDescriptor::TYPE_DOUBLE:
+		if (!read_fixed(raw)) {
+			return false;
+		}
+		value = static_cast<Ty>(WireFormatLite::DecodeDouble(raw));
+		return true;
+	default:
+		return false; // never reached!
+	}
+}
+
+template<typename Ty>
+bool WireDecoder::decode_value(const Op &op, int wire_type, uint8_t *bytes)
+{
+	auto type = op.type;
+	auto expected = WireFormatLite::WireTypeForFieldType(
+		static_cast<WireFormatLite::FieldType>(type));
+	if (op.kind == Op::KIND_VALUE) {
+		if (wire_type != expected) {
+			return skip(op.number, wire_type);
+		}
+		return read_scalar(type, *(Ty*)(bytes + op.offset));
+	}
+	auto &values = *(std::vector<Ty>*)(bytes + op.offset);
+	Ty value;
+	if (wire_type == expected) {
+		if (!read_scalar(type, value)) {
+			return false;
+		}
+		Probe::CountElements(1);
+		values.push_back(value);
+		return true;
+	}
+	if (wire_type != WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+		return skip(op.number, wire_type);
+	}
+	// packed repeated field, accepted whether declared packed or not.
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+	if (!read_length(data, size)) {
+		return false;
+	}
+	if (expected == WireFormatLite::WIRETYPE_FIXED32) {
+		values.reserve(values.size() + size / 4);
+	} else if (expected == WireFormatLite::WIRETYPE_FIXED64) {
+		values.reserve(values.size() + size / 8);
+	} else {
+		// every varint is ended by a byte without the continuation bit.
+		size_t count = 0;
+		for (size_t i = 0; i < size; ++i) {
+			count += data[i] < 0x80;
+		}
+		values.reserve(values.size() + count);
+	}
+	size_t base = values.size();
+	WireDecoder packed(data, data + size);
+	while (!packed.eof()) {
+		if (!packed.read_scalar(type, value)) {
+			return false;
+		}
+		values.push_back(value);
+	}
+	Probe::CountElements(values.size() - base);
+	return true;
+}
+
+bool WireDecoder::decode_string(const Op &op, int wire_type, uint8_t *bytes)
+{
+	if (wire_type != WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+		return skip(op.number, wire_type);
+	}
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+	if (!read_length(data, size)) {
+		return false;
+	}
+	auto text = reinterpret_cast<const char*>(data);
+	Probe::CountBytes(size);
+	if (op.kind != Op::KIND_VALUE) {
+		Probe::CountElements(1);
+	}
+	if (op.containers == CONTAINERS_VIEW) {
+		return view_string(op, text, size, bytes);
+	}
+	if (op.kind == Op::KIND_VALUE) {
+		auto &value = *(std::string*)(bytes + op.offset);
+		value.assign(text, size);
+	} else {
+		auto &values = *(std::vector<std::string>*)(bytes + op.offset);
+		values.emplace_back(text, size);
+	}
+	return true;
+}
+
+bool WireDecoder::view_string(const Op &op, const char *text, size_t size,
+	uint8_t *bytes)
+{
+#ifdef CPS_STRING_VIEW
+	if (op.kind == Op::KIND_VALUE) {
+		auto &value = *(std::string_view*)(bytes + op.offset);
+		value = std::string_view(text, size);
+	} else {
+		auto &values = *(std::vector<std::string_view>*)(bytes + op.offset);
+		values.emplace_back(text, size);
+	}
+	return true;
+#else
+	(void)op, (void)text, (void)size, (void)bytes;
+	return false; // never reached!
+#endif
+}
+
+bool WireDecoder::decode_message(const Op &op, int wire_type, uint8_t *bytes)
+{
+	if (wire_type != WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+		return skip(op.number, wire_type);
+	}
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+	if (!read_length(data, size)) {
+		return false;
+	}
+	WireDecoder decoder(data, data + size, _depth + 1);
+	return decoder.decode(*op.plan, bytes + op.offset);
+}
+
+bool WireDecoder::decode_map(const Op &op, int wire_type, uint8_t *bytes)
+{
+	if (wire_type != WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+		return skip(op.number, wire_type);
+	}
+	if (op.emplace == nullptr) {
+		// the sorted vector is not supported
+		Probe::Fail(FAILURE_CONTAINERS);
+		return false;
+	}
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+	if (!read_length(data, size)) {
+		return false;
+	}
+	// find key and value of entry, the last one wins.
+	auto &key = op.plan->ops()[0];
+	auto &value = op.plan->ops()[1];
+	WireDecoder entry(data, data + size, _depth + 1);
+	WireDecoder key_decoder(nullptr, nullptr, entry._depth);
+	WireDecoder value_decoder(nullptr, nullptr, entry._depth);
+	int key_wire_type = 0, value_wire_type = 0;
+	while (!entry.eof()) {
+		int number = 0, type = 0;
+		if (!entry.read_tag(number, type)) {
+			return false;
+		}
+		if (number == key.number) {
+			key_decoder = WireDecoder(entry._ptr, entry._end, entry._depth);
+			key_wire_type = type;
+		} else if (number == value.number) {
+			value_decoder = WireDecoder(entry._ptr, entry._end,
+				entry._depth);
+			value_wire_type = type;
+		}
+		if (!entry.skip(number, type)) {
+			return false;
+		}
+	}
+	Probe::CountElements(1);
+	// read key to a temporary, then insert to map. key is at offset 0.
+	alignas(std::string) uint8_t temp[sizeof(std::string)] = { 0 };
+	ConstructMember(key, temp);
+	bool result = key_decoder.eof() ||
+		key_decoder.decode_field(key, key_wire_type, temp);
+	bool inserted = false;
+	uint8_t *pair = nullptr;
+	if (result) {
+		pair = op.emplace(op, bytes + op.offset, temp, inserted);
+	}
+	DestroyMember(key, temp);
+	if (!result) {
+		return false;
+	}
+	if (inserted) {
+		ConstructMember(value, pair);
+	}
+	// for duplicated key, the value is overwritten, or merged if message.
+	return value_decoder.eof() ||
+		value_decoder.decode_field(value, value_wire_type, pair);
+}
+
+bool WireDecoder::decode_field(const Op &op, int wire_type, uint8_t *bytes)
+{
+	switch (op.kind) {
+	case Op::KIND_MESSAGE:
+		return decode_message(op, wire_type, bytes);
+	case Op::KIND_MAP:
+		return decode_map(op, wire_type, bytes);
+	case Op::KIND_REPEATED_MESSAGE:
+		return false; // decoded by decode(), never reached!
+	default:
+		break;
+	}
+	switch (op.cpp_type) {
+	case FieldDescriptor::CPPTYPE_INT32:
+		return decode_value<int32_t>(op, wire_type, bytes);
+	case FieldDescriptor::CPPTYPE_INT64:
+		return decode_value<int64_t>(op, wire_type, bytes);
+	case FieldDescriptor::CPPTYPE_UINT32:
+		return decode_value<uint32_t>(op, wire_type, bytes);
+	case FieldDescriptor::CPPTYPE_UINT64:
+		return decode_value<uint64_t>(op, wire_type, bytes);
+	case FieldDescriptor::CPPTYPE_DOUBLE:
+		return decode_value<double>(op, wire_type, bytes);
+	case FieldDescriptor::CPPTYPE_FLOAT:
+		return decode_value<float>(op, wire_type, bytes);
+	case FieldDescriptor::CPPTYPE_BOOL:
+		return decode_value<bool>(op, wire_type, bytes);
+	case FieldDescriptor::CPPTYPE_ENUM:
+		return decode_value<int>(op, wire_type, bytes);
+	case FieldDescriptor::CPPTYPE_STRING:
+		return decode_string(op, wire_type, bytes);
+	default:
+		return false; // never reached!
+	}
+}
+
+bool WireDecoder::prepare_messages(const Plan &plan, uint8_t *bytes,
+	std::vector<size_t> &cursors)
+{
+	auto &ops = plan.ops();
+	std::vector<size_t> counts(ops.size(), 0);
+	WireDecoder scanner(_ptr, _end, _depth);
+	while (!scanner.eof()) {
+		int number = 0, wire_type = 0;
+		if (!scanner.read_tag(number, wire_type)) {
+			return false;
+		}
+		auto op = plan.find(number);
+		if (op != nullptr && op->kind == Op::KIND_REPEATED_MESSAGE &&
+			wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+			++counts[op - ops.data()];
+		}
+		if (!scanner.skip(number, wire_type)) {
+			return false;
+		}
+	}
+	cursors.assign(ops.size(), 0);
+	for (size_t i = 0; i < ops.size(); ++i) {
+		if (counts[i] == 0) {
+			continue;
+		}
+		auto &info = *ops[i].plan;
+		uint8_t *member = bytes + ops[i].offset;
+		UnitVector<StdContainers> values(member, info.align());
+		size_t step = info.size();
+		size_t count = values.size() / step;
+		size_t total = (count + counts[i]) * step;
+		if (count != 0 && total > values.capacity()) {
+			// the message is merged again, the vector of bytes can not move
+			// the decoded structs, they are moved to the grown one by plan.
+			// both are allocated with the alignment of struct.
+			alignas(Vector) uint8_t storage[sizeof(Vector)];
+			new(storage) Vector;
+			UnitVector<StdContainers> grown(storage, info.align());
+			grown.resize(total);
+			for (size_t j = 0; j < count; ++j) {
+				MoveStruct(info, values.data() + j * step,
+					grown.data() + j * step);
+				DestroyStruct(info, values.data() + j * step);
+			}
+			((Vector*)member)->swap(*(Vector*)storage);
+			grown.destroy();
+		} else {
+			values.resize(total);
+		}
+		for (size_t j = count; j < count + counts[i]; ++j) {
+			ConstructStruct(info, values.data() + j * step);
+		}
+		cursors[i] = count;
+	}
+	return true;
+}
+
+bool WireDecoder::decode(const Plan &plan, uint8_t *bytes)
+{
+	if (_depth > kMaxDepth) {
+		return false; // nested too deep
+	}
+	// cursor of each repeated message, prepared when first one is found.
+	std::vector<size_t> cursors;
+	const uint8_t *start = _ptr;
+	while (!eof()) {
+		int number = 0, wire_type = 0;
+		if (!read_tag(number, wire_type)) {
+			return false;
+		}
+		auto op = plan.find(number);
+		if (op == nullptr) {
+			if (!skip(number, wire_type)) {
+				return false;
+			}
+			continue;
+		}
+		if (op->kind != Op::KIND_REPEATED_MESSAGE) {
+			if (!decode_field(*op, wire_type, bytes)) {
+				return false;
+			}
+			continue;
+		}
+		if (wire_type != WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+			if (!skip(number, wire_type)) {
+				return false;
+			}
+			continue;
+		}
+		if (cursors.empty()) {
+			// no repeated message is decoded yet, count all of them.
+			WireDecoder scanner(start, _end, _depth);
+			if (!scanner.prepare_messages(plan, bytes, cursors)) {
+				return false;
+			}
+		}
+		const uint8_t *data = nullptr;
+		size_t size = 0;
+		if (!read_length(data, size)) {
+			return false;
+		}
+		auto &info = *op->plan;
+		auto &values = *(Vector*)(bytes + op->offset);
+		size_t &cursor = cursors[op - plan.ops().data()];
+		WireDecoder decoder(data, data + size, _depth + 1);
+		if (!decoder.decode(info, values.data() + cursor * info.size())) {
+			return false;
+		}
+		Probe::CountElements(1);
+		++cursor;
+	}
+	return true;
+}
+
+// @brief Parse protobuf wire format to struct directly with compiled plan.
+// @param[in] plan: plan compiled from descriptor of wire
+// @param[in] wire: serialized protobuf message
+// @param[in] len: length of wire
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool ProtoToStruct(const Plan &plan, const void *wire, size_t len,
+	void *bytes, size_t size)
+{
+	Probe probe(plan.descriptor(), DIRECTION_TO_STRUCT);
+	if (plan.size() != static_cast<int>(size)) {
+		// protobuf message is not match struct
+		return probe.fail(FAILURE_SIZE);
+	}
+	if (plan.containers() == CONTAINERS_PMR) {
+		// the std::pmr containers are not supported
+		return probe.fail(FAILURE_CONTAINERS);
+	}
+	// the absent field is default value, same as the message.
+	DefaultStruct(plan, static_cast<uint8_t*>(bytes));
+	auto data = static_cast<const uint8_t*>(wire);
+	WireDecoder decoder(data, data + len);
+	return probe.done(decoder.decode(plan, static_cast<uint8_t*>(bytes)),
+		FAILURE_WIRE);
+}
+
+// @brief Parse protobuf wire format to struct directly, without message.
+// @param[in] wire: serialized protobuf message
+// @param[in] len: length of wire
+// @param[in] desc: protobuf message descriptor of wire
+// @param[out] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @return true for success, or false for failed.
+bool ProtoToStruct(const void *wire, size_t len,
+	const google::protobuf::Descriptor *desc, void *bytes, size_t size)
+{
+	return ProtoToStruct(Plan::Get(desc), wire, len, bytes, size);
+}
+
+// ==================== serialize struct to protobuf wire format ====================
+
+// proto3 field without presence is not serialized if it is zero.
+template<typename Ty>
+static inline bool IsZero(Ty value)
+{
+	return value == 0;
+}
+
+// float and double are compared by bits, so -0.0 is serialized.
+static inline bool IsZero(float value)
+{
+	uint32_t raw = 0;
+	memcpy(&raw, &value, sizeof(raw));
+	return raw == 0;
+}
+
+static inline bool IsZero(double value)
+{
+	uint64_t raw = 0;
+	memcpy(&raw, &value, sizeof(raw));
+	return raw == 0;
+}
+
+static inline bool IsZero(const std::string &value)
+{
+	return value.empty();
+}
+
+#ifdef CPS_STRING_VIEW
+static inline bool IsZero(std::string_view value)
+{
+	return value.empty();
+}
+#endif
+
+// size of tag, the wire type is not matter.
+static inline size_t TagSize(int number)
+{
+	return CodedOutputStream::VarintSize32(static_cast<uint32_t>(number) << 3);
+}
+
+static inline void WriteTag(int number, WireFormatLite::WireType wire_type,
+	CodedOutputStream &out)
+{
+	out.WriteTag(WireFormatLite::MakeTag(number, wire_type));
+}
+
+// size of fixed length value, or 0 if varint.
+static inline size_t FixedSize(FieldDescriptor::Type type)
+{
+	switch (type) {
+	case FieldDescriptor::TYPE_FIXED32:
+	case FieldDescriptor::TYPE_SFIXED32:
+	case FieldDescriptor::TYPE_FLOAT:
+		return 4;
+	case FieldDescriptor::TYPE_FIXED64:
+	case FieldDescriptor::TYPE_SFIXED64:
+	case FieldDescriptor::TYPE_DOUBLE:
+		return 8;
+	case FieldDescriptor::TYPE_BOOL:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+// size of scalar value without tag.
+template<typename Ty>
+static inline size_t ScalarSize(FieldDescriptor::Type type, Ty value)
+{
+	switch (type) {
+	case FieldDescriptor::TYPE_INT32:
+		return WireFormatLite::Int32Size(static_cast<int32_t>(value));
+	case FieldDescriptor::TYPE_INT64:
+		return WireFormatLite::Int64Size(static_cast<int64_t>(value));
+	case FieldDescriptor::TYPE_UINT32:
+		return WireFormatLite::UInt32Size(static_cast<uint32_t>(value));
+	case FieldDescriptor::TYPE_UINT64:
+		return WireFormatLite::UInt64Size(static_cast<uint64_t>(value));
+	case FieldDescriptor::TYPE_SINT32:
+		return WireFormatLite::SInt32Size(static_cast<int32_t>(value));
+	case FieldDescriptor::TYPE_SINT64:
+		return WireFormatLite::SInt64Size(static_cast<int64_t>(value));
+	case FieldDescriptor::TYPE_ENUM:
+		return WireFormatLite::EnumSize(static_cast<int>(value));
+	default:
+		return FixedSize(type);
+	}
+}
+
+// write scalar value without tag.
+template<typename Ty>
+static inline void WriteScalar(FieldDescriptor::Type type, Ty value,
+	CodedOutputStream &out)
+{
+	switch (type) {
+	case FieldDescriptor::TYPE_INT32:
+		return WireFormatLite::WriteInt32NoTag(static_cast<int32_t>(value), &out);
+	case FieldDescriptor::TYPE_INT64:
+		return WireFormatLite::WriteInt64NoTag(static_cast<int64_t>(value), &out);
+	case FieldDescriptor::TYPE_UINT32:
+		return WireFormatLite::WriteUInt32NoTag(static_cast<uint32_t>(value), &out);
+	case FieldDescriptor::TYPE_UINT64:
+		return WireFormatLite::WriteUInt64NoTag(static_cast<uint64_t>(value), &out);
+	case FieldDescriptor::TYPE_SINT32:
+		return WireFormatLite::WriteSInt32NoTag(static_cast<int32_t>(value), &out);
+	case FieldDescriptor::TYPE_SINT64:
+		return WireFormatLite::WriteSInt64NoTag(static_cast<int64_t>(value), &out);
+	case FieldDescriptor::TYPE_ENUM:
+		return WireFormatLite::WriteEnumNoTag(static_cast<int>(value), &out);
+	case FieldDescriptor::TYPE_FIXED32:
+		return WireFormatLite::WriteFixed32NoTag(static_cast<uint32_t>(value), &out);
+	case FieldDescriptor::TYPE_SFIXED32:
+		return WireFormatLite::WriteSFixed32NoTag(static_cast<int32_t>(value), &out);
+	case FieldDescriptor::TYPE_FIXED64:
+		return WireFormatLite::WriteFixed64NoTag(static_cast<uint64_t>(value), &out);
+	case FieldDescriptor::TYPE_SFIXED64:
+		return WireFormatLite::WriteSFixed64NoTag(static_cast<int64_t>(value), &out);
+	case FieldDescriptor::TYPE_FLOAT:
+		return WireFormatLite::WriteFloatNoTag(static_cast<float>(value), &out);
+	case FieldDescriptor::TYPE_DOUBLE:
+		return WireFormatLite::WriteDoubleNoTag(static_cast<double>(value), &out);
+	case FieldDescriptor::TYPE_BOOL:
+		return WireFormatLite::WriteBoolNoTag(value != 0, &out);
+	default:
+		return; // never reached!
+	}
+}
+
+// encode struct to protobuf wire format, same as the message serialized
+// deterministically. encoded by two passes, the first pass calculates the
+// exact size, and the second pass writes with the measured sizes.
+class WireEncoder
+{
+private:
+	// size of every length delimited data, in order of writing.
+	std::vector<uint32_t> _sizes;
+	size_t _next; // next size to write
+public:
+	WireEncoder() : _next(0) {}
+
+	// calculate the byte size of struct.
+	// @param entry: struct is map entry, all fields are serialized.
+	bool measure(const Plan &plan, const uint8_t *bytes, bool entry,
+		size_t &size);
+
+	// write struct, must be measured before.
+	void write(const Plan &plan, const uint8_t *bytes, bool entry,
+		CodedOutputStream &out);
+
+private:
+	// reserve the size of length delimited data before measured.
+	inline size_t reserve()
+	{
+		_sizes.push_back(0);
+		return _sizes.size() - 1;
+	}
+
+	inline bool commit(size_t slot, size_t size)
+	{
+		if (size > INT_MAX) {
+			return false; // protobuf message should less than 2GB
+		}
+		_sizes[slot] = static_cast<uint32_t>(size);
+		return true;
+	}
+
+	// the measured size of length delimited data.
+	inline uint32_t next() { return _sizes[_next++]; }
+
+	bool measure_field(const Op &op, const uint8_t *bytes, bool entry,
+		size_t &size);
+
+	template<typename Ty>
+	size_t measure_value(const Op &op, const uint8_t *bytes, bool entry);
+
+	template<typename String>
+	size_t measure_string(const Op &op, const uint8_t *bytes, bool entry);
+
+	template<typename Ty>
+	bool measure_map(const Op &op, const uint8_t *bytes, size_t &size);
+
+	void write_field(const Op &op, const uint8_t *bytes, bool entry,
+		CodedOutputStream &out);
+
+	template<typename Ty>
+	void write_value(const Op &op, const uint8_t *bytes, bool entry,
+		CodedOutputStream &out);
+
+	template<typename String>
+	void write_string(const Op &op, const uint8_t *bytes, bool entry,
+		CodedOutputStream &out);
+
+	template<typename Ty>
+	void write_map(const Op &op, const uint8_t *bytes, CodedOutputStream &out);
+};
+
+bool WireEncoder::measure(const Plan &plan, const uint8_t *bytes, bool entry,
+	size_t &size)
+{
+	size = 0;
+	for (auto op : plan.numbers()) {
+		if (!measure_field(*op, bytes, entry, size)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template<typename Ty>
+size_t WireEncoder::measure_value(const Op &op, const uint8_t *bytes,
+	bool entry)
+{
+	if (op.kind == Op::KIND_VALUE) {
+		Ty value = *(const Ty*)(bytes + op.offset);
+		if (!entry && !op.presence && IsZero(value)) {
+			return 0;
+		}
+		return TagSize(op.number) + ScalarSize(op.type, value);
+	}
+	auto &values = *(const std::vector<Ty>*)(bytes + op.offset);
+	if (values.empty()) {
+		return 0;
+	}
+	size_t size = 0;
+	size_t fixed = FixedSize(op.type);
+	if (fixed != 0) {
+		size = values.size() * fixed;
+	} else {
+		for (Ty value : values) {
+			size += ScalarSize(op.type, value);
+		}
+	}
+	if (!op.packed) {
+		return size + values.size() * TagSize(op.number);
+	}
+	_sizes.push_back(static_cast<uint32_t>(size));
+	return TagSize(op.number) + WireFormatLite::LengthDelimitedSize(size);
+}
+
+template<typename String>
+size_t WireEncoder::measure_string(const Op &op, const uint8_t *bytes,
+	bool entry)
+{
+	if (op.kind == Op::KIND_VALUE) {
+		auto &value = *(const String*)(bytes + op.offset);
+		if (!entry && !op.presence && IsZero(value)) {
+			return 0;
+		}
+		return TagSize(op.number) +
+			WireFormatLite::LengthDelimitedSize(value.size());
+	}
+	auto &values = *(const std::vector<String>*)(bytes + op.offset);
+	size_t size = values.size() * TagSize(op.number);
+	for (auto &value : values) {
+		size += WireFormatLite::LengthDelimitedSize(value.size());
+	}
+	return size;
+}
+
+template<typename Ty>
+bool WireEncoder::measure_map(const Op &op, const uint8_t *bytes,
+	size_t &size)
+{
+	// Ty is only for the node layout of map, same as StructReader.
+	return ForEachPair<Ty, StdContainers>(op, bytes + op.offset,
+		[&](const uint8_t *pair) {
+		size_t slot = reserve();
+		size_t entry_size = 0;
+		if (!measure(*op.plan, pair, true, entry_size) ||
+			!commit(slot, entry_size)) {
+			return false;
+		}
+		size += TagSize(op.number) +
+			WireFormatLite::LengthDelimitedSize(entry_size);
+		return true;
+	});
+}
+
+bool WireEncoder::measure_field(const Op &op, const uint8_t *bytes,
+	bool entry, size_t &size)
+{
+	switch (op.kind) {
+	case Op::KIND_MESSAGE: {
+		// the message member is always present.
+		size_t slot = reserve();
+		size_t message_size = 0;
+		if (!measure(*op.plan, bytes + op.offset, false, message_size) ||
+			!commit(slot, message_size)) {
+			return false;
+		}
+		size += TagSize(op.number) +
+			WireFormatLite::LengthDelimitedSize(message_size);
+		return true;
+	}
+	case Op::KIND_REPEATED_MESSAGE: {
+		auto &info = *op.plan;
+		auto &values = *(const Vector*)(bytes + op.offset);
+		if (values.size() % info.size()) {
+			return false; // should never reached!
+		}
+		for (size_t i = 0; i < values.size(); i += info.size()) {
+			size_t slot = reserve();
+			size_t message_size = 0;
+			if (!measure(info, values.data() + i, false, message_size) ||
+				!commit(slot, message_size)) {
+				return false;
+			}
+			size += TagSize(op.number) +
+				WireFormatLite::LengthDelimitedSize(message_size);
+		}
+		return true;
+	}
+	case Op::KIND_MAP:
+		switch (op.plan->align()) {
+		case 4:
+			return measure_map<int32_t>(op, bytes, size);
+		case 8:
+			return measure_map<int64_t>(op, bytes, size);
+		default:
+			return false; // the map entry is not supported
+		}
+	default:
+		break;
+	}
+	switch (op.cpp_type) {
+	case FieldDescriptor::CPPTYPE_INT32:
+		size += measure_value<int32_t>(op, bytes, entry);
+		return true;
+	case FieldDescriptor::CPPTYPE_INT64:
+		size += measure_value<int64_t>(op, bytes, entry);
+		return true;
+	case FieldDescriptor::CPPTYPE_UINT32:
+		size += measure_value<uint32_t>(op, bytes, entry);
+		return true;
+	case FieldDescriptor::CPPTYPE_UINT64:
+		size += measure_value<uint64_t>(op, bytes, entry);
+		return true;
+	case FieldDescriptor::CPPTYPE_DOUBLE:
+		size += measure_value<double>(op, bytes, entry);
+		return true;
+	case FieldDescriptor::CPPTYPE_FLOAT:
+		size += measure_value<float>(op, bytes, entry);
+		return true;
+	case FieldDescriptor::CPPTYPE_BOOL:
+		size += measure_value<bool>(op, bytes, entry);
+		return true;
+	case FieldDescriptor::CPPTYPE_ENUM:
+		size += measure_value<int>(op, bytes, entry);
+		return true;
+	case FieldDescriptor::CPPTYPE_STRING:
+		if (op.containers == CONTAINERS_VIEW) {
+			size += measure_string<ViewContainers::String>(op, bytes, entry);
+		} else {
+			size += measure_string<std::string>(op, bytes, entry);
+		}
+		return true;
+	default:
+		return false; // never reached!
+	}
+}
+
+void WireEncoder::write(const Plan &plan, const uint8_t *bytes, bool entry,
+	CodedOutputStream &out)
+{
+	for (auto op : plan.numbers()) {
+		write_field(*op, bytes, entry, out);
+	}
+}
+
+template<typename Ty>
+void WireEncoder::write_value(const Op &op, const uint8_t *bytes, bool entry,
+	CodedOutputStream &out)
+{
+	auto wire_type = WireFormatLite::WireTypeForFieldType(
+		static_cast<WireFormatLite::FieldType>(op.type));
+	if (op.kind == Op::KIND_VALUE) {
+		Ty value = *(const Ty*)(bytes + op.offset);
+		if (!entry && !op.presence && IsZero(value)) {
+			return;
+		}
+		WriteTag(op.number, wire_type, out);
+		WriteScalar(op.type, value, out);
+		return;
+	}
+	auto &values = *(const std::vector<Ty>*)(bytes + op.offset);
+	if (values.empty()) {
+		return;
+	}
+	Probe::CountElements(values.size());
+	if (op.packed) {
+		WriteTag(op.number, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, out);
+		out.WriteVarint32(next());
+		for (Ty value : values) {
+			WriteScalar(op.type, value, out);
+		}
+		return;
+	}
+	for (Ty value : values) {
+		WriteTag(op.number, wire_type, out);
+		WriteScalar(op.type, value, out);
+	}
+}
+
+template<typename String>
+void WireEncoder::write_string(const Op &op, const uint8_t *bytes, bool entry,
+	CodedOutputStream &out)
+{
+	if (op.kind == Op::KIND_VALUE) {
+		auto &value = *(const String*)(bytes + op.offset);
+		if (!entry && !op.presence && IsZero(value)) {
+			return;
+		}
+		Probe::CountBytes(value.size());
+		WriteTag(op.number, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, out);
+		out.WriteVarint32(static_cast<uint32_t>(value.size()));
+		out.WriteRaw(value.data(), static_cast<int>(value.size()));
+		return;
+	}
+	auto &values = *(const std::vector<String>*)(bytes + op.offset);
+	Probe::CountElements(values.size());
+	for (auto &value : values) {
+		Probe::CountBytes(value.size());
+		WriteTag(op.number, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, out);
+		out.WriteVarint32(static_cast<uint32_t>(value.size()));
+		out.WriteRaw(value.data(), static_cast<int>(value.size()));
+	}
+}
+
+template<typename Ty>
+void WireEncoder::write_map(const Op &op, const uint8_t *bytes,
+	CodedOutputStream &out)
+{
+	// std::map and the sorted vector are ordered, same as the deterministic
+	// serialization.
+	ForEachPair<Ty, StdContainers>(op, bytes + op.offset,
+		[&](const uint8_t *pair) {
+		Probe::CountElements(1);
+		WriteTag(op.number, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, out);
+		out.WriteVarint32(next());
+		write(*op.plan, pair, true, out);
+		return true;
+	});
+}
+
+void WireEncoder::write_field(const Op &op, const uint8_t *bytes, bool entry,
+	CodedOutputStream &out)
+{
+	switch (op.kind) {
+	case Op::KIND_MESSAGE:
+		WriteTag(op.number, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, out);
+		out.WriteVarint32(next());
+		return write(*op.plan, bytes + op.offset, false, out);
+	case Op::KIND_REPEATED_MESSAGE: {
+		auto &info = *op.plan;
+		auto &values = *(const Vector*)(bytes + op.offset);
+		Probe::CountElements(values.size() / info.size());
+		for (size_t i = 0; i < values.size(); i += info.size()) {
+			WriteTag(op.number, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, out);
+			out.WriteVarint32(next());
+			write(info, values.data() + i, false, out);
+		}
+		return;
+	}
+	case Op::KIND_MAP:
+		if (op.plan->align() == 4) {
+			return write_map<int32_t>(op, bytes, out);
+		}
+		return write_map<int64_t>(op, bytes, out);
+	default:
+		break;
+	}
+	switch (op.cpp_type) {
+	case FieldDescriptor::CPPTYPE_INT32:
+		return write_value<int32_t>(op, bytes, entry, out);
+	case FieldDescriptor::CPPTYPE_INT64:
+		return write_value<int64_t>(op, bytes, entry, out);
+	case FieldDescriptor::CPPTYPE_UINT32:
+		return write_value<uint32_t>(op, bytes, entry, out);
+	case FieldDescriptor::CPPTYPE_UINT64:
+		return write_value<uint64_t>(op, bytes, entry, out);
+	case FieldDescriptor::CPPTYPE_DOUBLE:
+		return write_value<double>(op, bytes, entry, out);
+	case FieldDescriptor::CPPTYPE_FLOAT:
+		return write_value<float>(op, bytes, entry, out);
+	case FieldDescriptor::CPPTYPE_BOOL:
+		return write_value<bool>(op, bytes, entry, out);
+	case FieldDescriptor::CPPTYPE_ENUM:
+		return write_value<int>(op, bytes, entry, out);
+	case FieldDescriptor::CPPTYPE_STRING:
+		if (op.containers == CONTAINERS_VIEW) {
+			return write_string<ViewContainers::String>(op, bytes, entry,
+				out);
+		}
+		return write_string<std::string>(op, bytes, entry, out);
+	default:
+		return; // never reached!
+	}
+}
+
+// measure struct, check the plan and size of struct and result.
+static bool MeasureStruct(WireEncoder &encoder, const Plan &plan,
+	const void *bytes, size_t size, size_t &wire_size, Probe &probe)
+{
+	if (plan.size() != static_cast<int>(size)) {
+		// protobuf message is not match struct
+		return probe.fail(FAILURE_SIZE);
+	}
+	if (plan.containers() == CONTAINERS_PMR) {
+		// the std::pmr containers are not supported
+		return probe.fail(FAILURE_CONTAINERS);
+	}
+	if (!encoder.measure(plan, static_cast<const uint8_t*>(bytes), false,
+		wire_size) || wire_size > INT_MAX) {
+		return probe.fail(FAILURE_WIRE);
+	}
+	return true;
+}
+
+// @brief Serialize struct to protobuf wire format directly with compiled plan.
+// The plan of std::pmr containers is not supported.
+// @param[in] plan: plan compiled from descriptor of wire
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[out] out: serialized protobuf message
+// @return true for success, or false for failed.
+bool StructToWire(const Plan &plan, const void *bytes, size_t size,
+	std::string &out)
+{
+	Probe probe(plan.descriptor(), DIRECTION_TO_PROTO);
+	WireEncoder encoder;
+	size_t wire_size = 0;
+	if (!MeasureStruct(encoder, plan, bytes, size, wire_size, probe)) {
+		return false;
+	}
+	out.resize(wire_size);
+	google::protobuf::io::ArrayOutputStream stream(&out[0],
+		static_cast<int>(wire_size));
+	CodedOutputStream coded(&stream);
+	encoder.write(plan, static_cast<const uint8_t*>(bytes), false, coded);
+	coded.Trim();
+	return probe.done(!coded.HadError() && coded.ByteCount() ==
+		static_cast<int64_t>(wire_size), FAILURE_WIRE);
+}
+
+// @brief Serialize struct to protobuf wire format directly, without message.
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[in] desc: protobuf message descriptor of wire
+// @param[out] out: serialized protobuf message
+// @return true for success, or false for failed.
+bool StructToWire(const void *bytes, size_t size,
+	const google::protobuf::Descriptor *desc, std::string &out)
+{
+	return StructToWire(Plan::Get(desc), bytes, size, out);
+}
+
+// @brief Serialize struct to protobuf wire format directly with compiled plan.
+// @param[in] plan: plan compiled from descriptor of wire
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[out] out: output stream of serialized protobuf message
+// @return true for success, or false for failed.
+bool StructToWire(const Plan &plan, const void *bytes, size_t size,
+	ZeroCopyOutputStream *out)
+{
+	Probe probe(plan.descriptor(), DIRECTION_TO_PROTO);
+	WireEncoder encoder;
+	size_t wire_size = 0;
+	if (!MeasureStruct(encoder, plan, bytes, size, wire_size, probe)) {
+		return false;
+	}
+	CodedOutputStream coded(out);
+	encoder.write(plan, static_cast<const uint8_t*>(bytes), false, coded);
+	coded.Trim();
+	// the stream may fail, or the struct may be changed while written.
+	return probe.done(!coded.HadError() && coded.ByteCount() ==
+		static_cast<int64_t>(wire_size), FAILURE_WIRE);
+}
+
+// @brief Serialize struct to protobuf wire format directly, without message.
+// @param[in] bytes: pointer to struct
+// @param[in] size: sizeof struct
+// @param[in] desc: protobuf message descriptor of wire
+// @param[out] out: output stream of serialized protobuf message
+// @return true for success, or false for failed.
+bool StructToWire(const void *bytes, size_t size,
+	const google::protobuf::Descriptor *desc, ZeroCopyOutputStream *out)
+{
+	return StructToWire(Plan::Get(desc), bytes, size, out);
+}
+
+} // namespace cps
@@ -3,15 +3,32 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
 #include <string>
+#include <thread>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/field_mask.pb.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/util/message_differencer.h>
 
 #include "message.h"
 #include "message.pb.h"
 #include "convert_proto_struct.h"
+#include "convert_aggregate.h"
+#include "convert_parallel.h"
+#include "convert_pipeline.h"
+#include "convert_stats.h"
+#include "convert_stream.h"
+#include "message.cps.h"
 
-int main()
+using google::protobuf::util::MessageDifferencer;
+
+static Message2 MakeMessage2()
 {
 	Message2 msg2;
 	Message2::Message3 msg3;
@@ -37,26 +54,1361 @@ int main()
 	msg1.member8.emplace("msg1mem8key2", 654321);
 	msg1.member9.emplace_back(898989);
 	msg1.member9.emplace_back(767676);
+	msg1.member10 = false;
+	msg1.member11.assign({ 0.5, -1.25, 1e100 });
+	msg1.member12.assign({ Enum::EnFlag2, Enum::EnFlag1, Enum::EnFlag2 });
+	msg1.member13.assign({ true, false, true, true });
 	msg2.member2.emplace_back(msg1);
 	msg2.member2.emplace_back(msg1);
 	msg2.member3 = 3.1415926;
 	msg2.member4 = 1.4142135f;
+	msg2.member5 = msg1;
+	msg2.member6 = msg3;
+	msg2.member7.emplace("msg2mem7key1", 7);
+	return msg2;
+}
 
-	proto::Message2 proto_msg;
-	if (!cps::StructToProto(msg2, proto_msg)) {
+// convert with the reflection converter.
+static bool TestReflection(const Message2 &msg2, proto::Message2 &proto_msg)
+{
+	if (!cps::StructToProto(&msg2, sizeof(msg2), proto_msg)) {
 		printf("struct to proto failed.\n");
-		return -1;
+		return false;
 	}
 	proto_msg.PrintDebugString();
 	Message2 struct_msg;
-	if (!cps::ProtoToStruct(proto_msg, struct_msg)) {
+	if (!cps::ProtoToStruct(proto_msg, &struct_msg, sizeof(struct_msg))) {
 		printf("proto to struct failed.\n");
-		return -1;
+		return false;
+	}
+	if (!(struct_msg == msg2)) {
+		printf("proto to struct failed.\n");
+		return false;
+	}
+	return true;
+}
+
+// convert with the converter generated by protoc-gen-cps.
+static bool TestGenerated(const Message2 &msg2,
+	const proto::Message2 &expected)
+{
+	proto::Message2 proto_msg;
+	if (!cps::StructToProto(msg2, proto_msg)) {
+		printf("generated struct to proto failed.\n");
+		return false;
+	}
+	if (!MessageDifferencer::Equals(proto_msg, expected)) {
+		printf("generated struct to proto mismatch.\n");
+		return false;
+	}
+	Message2 struct_msg;
+	if (!cps::ProtoToStruct(proto_msg, struct_msg)) {
+		printf("generated proto to struct failed.\n");
+		return false;
+	}
+	if (!(struct_msg == msg2)) {
+		printf("generated proto to struct mismatch.\n");
+		return false;
+	}
+	return true;
+}
+
+// parse wire format to struct directly.
+static bool TestWire(const Message2 &msg2, const proto::Message2 &proto_msg)
+{
+	std::string wire;
+	if (!proto_msg.SerializeToString(&wire)) {
+		printf("serialize failed.\n");
+		return false;
+	}
+	Message2 struct_msg;
+	if (!cps::ProtoToStruct<proto::Message2>(wire.data(), wire.size(),
+		struct_msg)) {
+		printf("wire to struct failed.\n");
+		return false;
+	}
+	if (!(struct_msg == msg2)) {
+		printf("wire to struct mismatch.\n");
+		return false;
+	}
+	// parsed again, the repeated messages are appended, and the decoded ones
+	// are moved to the grown vector.
+	if (!cps::ProtoToStruct<proto::Message2>(wire.data(), wire.size(),
+		struct_msg) || struct_msg.member2.size() != 4 ||
+		!(struct_msg.member2[3] == msg2.member2[1]) ||
+		!(struct_msg.member2[0] == msg2.member2[0])) {
+		printf("wire merged to struct mismatch.\n");
+		return false;
+	}
+	// truncated input should fail, and never crash.
+	for (size_t len = 0; len < wire.size(); len += 7) {
+		Message2 truncated;
+		cps::ProtoToStruct<proto::Message2>(wire.data(), len, truncated);
+	}
+	return true;
+}
+
+// the wire of Message5 nested depth times by member2, or by an unknown group
+// of field 3.
+static std::string DeepWire(size_t depth, bool group)
+{
+	std::string wire;
+	if (group) {
+		wire.append(depth, '\x1B'); // start group 3
+		wire.append(depth, '\x1C'); // end group 3
+		return wire;
+	}
+	// sizes[i] is the size of message nested i times.
+	std::vector<size_t> sizes(depth + 1, 0);
+	for (size_t i = depth; i > 0; --i) {
+		sizes[i - 1] = 1 + google::protobuf::io::CodedOutputStream::
+			VarintSize64(sizes[i]) + sizes[i];
+	}
+	wire.reserve(sizes[0]);
+	for (size_t i = 1; i <= depth; ++i) {
+		wire.push_back('\x12'); // member2, length delimited
+		for (uint64_t size = sizes[i]; ; size >>= 7) {
+			if (size < 0x80) {
+				wire.push_back(static_cast<char>(size));
+				break;
+			}
+			wire.push_back(static_cast<char>(size | 0x80));
+		}
+	}
+	return wire;
+}
+
+// the nested messages deeper than the recursion limit of protobuf are failed,
+// and never overflow the stack.
+static bool TestDeepWire()
+{
+	const size_t depths[] = { 100, 101, 200000 };
+	for (size_t depth : depths) {
+		for (bool group : { false, true }) {
+			auto wire = DeepWire(depth, group);
+			proto::Message5 proto_msg;
+			bool expected = depth <= 100;
+			if (depth <= 101 &&
+				proto_msg.ParseFromString(wire) != expected) {
+				printf("protobuf parse deep wire unexpected.\n");
+				return false;
+			}
+			Message5 msg5;
+			if (cps::ProtoToStruct<proto::Message5>(wire.data(), wire.size(),
+				msg5) != expected) {
+				printf("parse wire of depth %zu unexpected.\n", depth);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// serialize struct to wire format directly.
+static bool TestToWire(const Message2 &msg2, const proto::Message2 &proto_msg)
+{
+	// std::map is ordered, compare with the deterministic serialization.
+	std::string expected;
+	{
+		google::protobuf::io::StringOutputStream stream(&expected);
+		google::protobuf::io::CodedOutputStream coded(&stream);
+		coded.SetSerializationDeterministic(true);
+		if (!proto_msg.SerializeToCodedStream(&coded)) {
+			printf("serialize failed.\n");
+			return false;
+		}
+	}
+	std::string wire;
+	if (!cps::StructToWire<proto::Message2>(msg2, wire)) {
+		printf("struct to wire failed.\n");
+		return false;
+	}
+	if (wire != expected) {
+		printf("struct to wire mismatch.\n");
+		return false;
+	}
+	std::string streamed;
+	{
+		google::protobuf::io::StringOutputStream stream(&streamed);
+		if (!cps::StructToWire(&msg2, sizeof(msg2),
+			proto::Message2::descriptor(), &stream)) {
+			printf("struct to stream failed.\n");
+			return false;
+		}
+	}
+	if (streamed != expected) {
+		printf("struct to stream mismatch.\n");
+		return false;
+	}
+	// the stream is full before the whole struct written.
+	std::string buffer(expected.size() / 2, '\0');
+	google::protobuf::io::ArrayOutputStream array(&buffer[0],
+		static_cast<int>(buffer.size()));
+	if (cps::StructToWire(&msg2, sizeof(msg2), proto::Message2::descriptor(),
+		&array)) {
+		printf("struct to full stream not failed.\n");
+		return false;
+	}
+	return true;
+}
+
+// convert to message allocated on arena.
+static bool TestArena(const Message2 &msg2, const proto::Message2 &expected)
+{
+	google::protobuf::Arena arena;
+	auto proto_msg = cps::StructToProto<proto::Message2>(msg2, &arena);
+	if (proto_msg == nullptr) {
+		printf("struct to arena proto failed.\n");
+		return false;
+	}
+	if (proto_msg->GetArena() != &arena ||
+		proto_msg->member5().GetArena() != &arena ||
+		proto_msg->member2(0).GetArena() != &arena) {
+		printf("struct to proto is not on arena.\n");
+		return false;
+	}
+	if (!MessageDifferencer::Equals(*proto_msg, expected)) {
+		printf("struct to arena proto mismatch.\n");
+		return false;
+	}
+	Message2 struct_msg;
+	if (!cps::ProtoToStruct(*proto_msg, &struct_msg, sizeof(struct_msg)) ||
+		!(struct_msg == msg2)) {
+		printf("arena proto to struct failed.\n");
+		return false;
+	}
+	return true;
+}
+
+// convert with move semantics, the strings are moved.
+static bool TestMove(const Message2 &msg2, const proto::Message2 &expected)
+{
+	Message2 source = msg2;
+	proto::Message2 proto_msg;
+	if (!cps::StructToProto(std::move(source), proto_msg)) {
+		printf("move struct to proto failed.\n");
+		return false;
+	}
+	if (!MessageDifferencer::Equals(proto_msg, expected)) {
+		printf("move struct to proto mismatch.\n");
+		return false;
+	}
+	if (!source.member5.member7.empty()) {
+		printf("move struct to proto copied string.\n");
+		return false;
+	}
+	Message2 struct_msg;
+	if (!cps::ProtoToStruct(std::move(proto_msg), struct_msg)) {
+		printf("move proto to struct failed.\n");
+		return false;
 	}
 	if (!(struct_msg == msg2)) {
+		printf("move proto to struct mismatch.\n");
+		return false;
+	}
+	if (!proto_msg.member5().member7().empty()) {
+		printf("move proto to struct copied string.\n");
+		return false;
+	}
+	return true;
+}
+
+// convert array of structs with batch converter.
+static bool TestBatch(const Message2 &msg2, const proto::Message2 &expected)
+{
+	std::vector<Message2> structs(3, msg2);
+	google::protobuf::RepeatedPtrField<proto::Message2> protos;
+	cps::Converter<Message2, proto::Message2> converter;
+	if (!converter.to_proto(structs, protos) || protos.size() != 3) {
+		printf("batch struct to proto failed.\n");
+		return false;
+	}
+	for (auto &proto_msg : protos) {
+		if (!MessageDifferencer::Equals(proto_msg, expected)) {
+			printf("batch struct to proto mismatch.\n");
+			return false;
+		}
+	}
+	std::vector<Message2> result;
+	if (!converter.to_struct(protos, result) || !(result == structs)) {
+		printf("batch proto to struct failed.\n");
+		return false;
+	}
+	// the struct does not match the message, the output is not changed.
+	cps::Converter<Message1, proto::Message2> mismatch;
+	std::vector<Message1> others(1);
+	if (mismatch.to_struct(protos, others) || others.size() != 1 ||
+		mismatch.to_proto(others, protos) || protos.size() != 3) {
+		printf("batch failure changed output.\n");
+		return false;
+	}
+	return true;
+}
+
+// convert large repeated message concurrently.
+static bool TestParallel(const Message2 &msg2)
+{
+	Message2 large = msg2;
+	for (int i = 0; i < 1000; ++i) {
+		large.member2.push_back(msg2.member5);
+		large.member2.back().member1 = i;
+	}
+	proto::Message2 expected;
+	if (!cps::StructToProto(large, expected)) {
+		printf("struct to proto failed.\n");
+		return false;
+	}
+	cps::ThreadPool pool(4);
+	cps::Parallel parallel(&pool, 64, 16);
+	proto::Message2 proto_msg;
+	if (!cps::StructToProto(large, proto_msg, parallel) ||
+		!MessageDifferencer::Equals(proto_msg, expected)) {
+		printf("parallel struct to proto failed.\n");
+		return false;
+	}
+	Message2 struct_msg;
+	if (!cps::ProtoToStruct(proto_msg, struct_msg, parallel) ||
+		!(struct_msg == large)) {
+		printf("parallel proto to struct failed.\n");
+		return false;
+	}
+	return true;
+}
+
+// convert only the present fields, same as the full conversion.
+static bool TestSparse(const Message2 &msg2, const proto::Message2 &expected)
+{
+	Message2 struct_msg;
+	if (!cps::SparseProtoToStruct(expected, struct_msg) ||
+		!(struct_msg == msg2)) {
+		printf("sparse proto to struct failed.\n");
+		return false;
+	}
+	proto::Message2 sparse;
+	sparse.mutable_member5()->set_member7("sparse");
+	sparse.add_member2()->set_member1(7);
+	Message2 full;
+	if (!cps::ProtoToStruct(sparse, full)) {
+		printf("proto to struct failed.\n");
+		return false;
+	}
+	Message2 partial;
+	if (!cps::SparseProtoToStruct(sparse, partial) || !(partial == full)) {
+		printf("sparse proto to struct mismatch.\n");
+		return false;
+	}
+	return true;
+}
+
+// convert only the changed members, and the mask of changed fields.
+static bool TestDelta(const Message2 &msg2, const proto::Message2 &expected)
+{
+	proto::Message2 proto_msg = expected;
+	google::protobuf::FieldMask mask;
+	if (!cps::StructDeltaToProto(msg2, msg2, proto_msg, &mask) ||
+		mask.paths_size() != 0 ||
+		!MessageDifferencer::Equals(proto_msg, expected)) {
+		printf("delta of same struct failed.\n");
+		return false;
+	}
+	Message2 cur = msg2;
+	cur.member2[1].member1 = 1;
+	cur.member3 = 2.5;
+	cur.member5.member7 = "delta";
+	cur.member5.member9.push_back(1);
+	cur.member7.emplace("delta", 1);
+	if (!cps::StructDeltaToProto(msg2, cur, proto_msg, &mask)) {
+		printf("delta struct to proto failed.\n");
+		return false;
+	}
+	proto::Message2 full;
+	if (!cps::StructToProto(cur, full) ||
+		!MessageDifferencer::Equals(proto_msg, full)) {
+		printf("delta struct to proto mismatch.\n");
+		return false;
+	}
+	const char *paths[] = { "member2", "member3", "member5.member7",
+		"member5.member9", "member7" };
+	if (mask.paths_size() != 5) {
+		printf("delta mask mismatch.\n");
+		return false;
+	}
+	for (int i = 0; i < mask.paths_size(); ++i) {
+		if (mask.paths(i) != paths[i]) {
+			printf("delta mask mismatch.\n");
+			return false;
+		}
+	}
+	return true;
+}
+
+// convert only the fields selected by mask.
+static bool TestFieldMask(const Message2 &msg2, const proto::Message2 &expected)
+{
+	google::protobuf::FieldMask mask;
+	mask.add_paths("member5.member7");
+	mask.add_paths("member2.member1");
+	mask.add_paths("member3");
+	proto::Message2 partial;
+	partial.set_member3(msg2.member3);
+	partial.mutable_member5()->set_member7(msg2.member5.member7);
+	for (auto &msg1 : msg2.member2) {
+		partial.add_member2()->set_member1(msg1.member1);
+	}
+	proto::Message2 proto_msg;
+	if (!cps::StructToProto(msg2, proto_msg, mask) ||
+		!MessageDifferencer::Equals(proto_msg, partial)) {
+		printf("mask struct to proto failed.\n");
+		return false;
+	}
+	// the members not selected are not changed, value initialize them.
+	Message2 struct_msg = Message2(), full = Message2();
+	if (!cps::ProtoToStruct(expected, struct_msg, mask) ||
+		!cps::ProtoToStruct(partial, full) || !(struct_msg == full)) {
+		printf("mask proto to struct failed.\n");
+		return false;
+	}
+	// the compiled selection is reused.
+	auto selection = cps::CompileFieldMask(proto::Message2::descriptor(), mask);
+	for (int i = 0; i < 2; ++i) {
+		Message2 selected = Message2();
+		if (selection == nullptr ||
+			!cps::ProtoToStruct(expected, selected, *selection) ||
+			!(selected == full)) {
+			printf("mask selection reused failed.\n");
+			return false;
+		}
+	}
+	mask.add_paths("member7.key");
+	if (cps::CompileFieldMask(proto::Message2::descriptor(), mask) != nullptr) {
+		printf("invalid mask compiled.\n");
+		return false;
+	}
+	return true;
+}
+
+// convert to the existing struct again and again, the buffers are reused.
+static bool TestOverwrite(const Message2 &msg2, const proto::Message2 &expected)
+{
+	Message2 other = msg2;
+	other.member1.erase(other.member1.begin());
+	other.member1["overwrite"].member2.push_back(1);
+	other.member2.pop_back();
+	other.member2[0].member7 = "overwrite";
+	other.member2[0].member8.clear();
+	other.member5.member9.assign(1, 1);
+	proto::Message2 proto_other;
+	if (!cps::StructToProto(other, proto_other)) {
+		printf("struct to proto failed.\n");
+		return false;
+	}
+	Message2 struct_msg;
+	if (!cps::ProtoToStruct(expected, struct_msg)) {
 		printf("proto to struct failed.\n");
+		return false;
+	}
+	auto values = struct_msg.member5.member9.data();
+	for (int i = 0; i < 3; ++i) {
+		if (!cps::OverwriteProtoToStruct(proto_other, struct_msg) ||
+			!(struct_msg == other)) {
+			printf("overwrite proto to struct failed.\n");
+			return false;
+		}
+		if (!cps::OverwriteProtoToStruct(expected, struct_msg) ||
+			!(struct_msg == msg2)) {
+			printf("overwrite proto to struct failed.\n");
+			return false;
+		}
+	}
+	if (struct_msg.member5.member9.data() != values) {
+		printf("overwrite proto to struct reallocated.\n");
+		return false;
+	}
+	return true;
+}
+
+// same as the structs of message.h, but the maps are std::unordered_map.
+namespace hash
+{
+
+struct Message1
+{
+	int32_t member1;
+	int64_t member2;
+	uint32_t member3;
+	uint64_t member4;
+	Enum member5;
+	bool member6;
+	std::string member7;
+	std::unordered_map<std::string, int32_t> member8;
+	std::vector<int32_t> member9;
+	bool member10;
+	std::vector<double> member11;
+	std::vector<Enum> member12;
+	std::vector<bool> member13;
+};
+
+struct Message2
+{
+	struct Message3
+	{
+		std::unordered_map<std::string, int64_t> member1;
+		std::vector<int64_t> member2;
+		std::unordered_map<int64_t, std::string> member3;
+	};
+	std::unordered_map<std::string, Message3> member1;
+	std::vector<Message1> member2;
+	double member3;
+	float member4;
+	Message1 member5;
+	Message3 member6;
+	std::unordered_map<std::string, int32_t> member7;
+};
+
+struct Message4
+{
+	struct Large
+	{
+		Message1 member1;
+		Message1 member2;
+		Message1 member3;
+		Message1 member4;
+		Message1 member5;
+		Message1 member6;
+		Message1 member7;
+		Message1 member8;
+		Message1 member9;
+		Message1 member10;
+	};
+	std::unordered_map<int32_t, Large> member1;
+	std::unordered_map<std::string, Large> member2;
+};
+
+} // namespace hash
+
+// same as the structs of message.h, but the maps are sorted vectors.
+namespace sorted
+{
+
+struct Message1
+{
+	int32_t member1;
+	int64_t member2;
+	uint32_t member3;
+	uint64_t member4;
+	Enum member5;
+	bool member6;
+	std::string member7;
+	std::vector<std::pair<std::string, int32_t>> member8;
+	std::vector<int32_t> member9;
+	bool member10;
+	std::vector<double> member11;
+	std::vector<Enum> member12;
+	std::vector<bool> member13;
+};
+
+struct Message2
+{
+	struct Message3
+	{
+		std::vector<std::pair<std::string, int64_t>> member1;
+		std::vector<int64_t> member2;
+		std::vector<std::pair<int64_t, std::string>> member3;
+	};
+	std::vector<std::pair<std::string, Message3>> member1;
+	std::vector<Message1> member2;
+	double member3;
+	float member4;
+	Message1 member5;
+	Message3 member6;
+	std::vector<std::pair<std::string, int32_t>> member7;
+};
+
+} // namespace sorted
+
+// convert the maps declared as std::unordered_map or sorted vector.
+static bool TestMapLayout(const proto::Message2 &expected)
+{
+	auto desc = proto::Message2::descriptor();
+	auto &hash_plan = cps::CompilePlan(desc, cps::MAP_HASH);
+	hash::Message2 hash_msg;
+	if (!cps::ProtoToStruct(hash_plan, expected, &hash_msg,
+		sizeof(hash_msg))) {
+		printf("proto to hash map failed.\n");
+		return false;
+	}
+	proto::Message2 proto_msg;
+	if (!cps::StructToProto(hash_plan, &hash_msg, sizeof(hash_msg),
+		proto_msg) || !MessageDifferencer::Equals(proto_msg, expected)) {
+		printf("hash map to proto failed.\n");
+		return false;
+	}
+	// the converted pairs are found by the map after rehashed.
+	auto &values = hash_msg.member1;
+	for (int i = 0; i < 100; ++i) {
+		values.emplace("rehash" + std::to_string(i), hash::Message2::Message3());
+	}
+	size_t count = 0;
+	for (size_t i = 0; i < values.bucket_count(); ++i) {
+		for (auto it = values.begin(i); it != values.end(i); ++it, ++count) {
+			if (values.bucket(it->first) != i) {
+				printf("hash map is misplaced.\n");
+				return false;
+			}
+		}
+	}
+	auto iter = values.find("msg2mem1key2");
+	if (values.size() != 103 || count != 103 || iter == values.end() ||
+		iter->second.member3.at(456) != "msg3mem3value2") {
+		printf("hash map is broken.\n");
+		return false;
+	}
+	if (!cps::OverwriteProtoToStruct(hash_plan, expected, &hash_msg,
+		sizeof(hash_msg)) || values.size() != 3) {
+		printf("overwrite hash map failed.\n");
+		return false;
+	}
+	std::string wire;
+	if (!expected.SerializeToString(&wire)) {
+		printf("serialize failed.\n");
+		return false;
+	}
+	hash::Message2 wire_msg;
+	proto_msg.Clear();
+	if (!cps::ProtoToStruct(hash_plan, wire.data(), wire.size(), &wire_msg,
+		sizeof(wire_msg)) || !cps::StructToProto(hash_plan, &wire_msg,
+		sizeof(wire_msg), proto_msg) ||
+		!MessageDifferencer::Equals(proto_msg, expected)) {
+		printf("wire to hash map failed.\n");
+		return false;
+	}
+	// the decoded hash maps are moved to the grown vector.
+	if (!cps::ProtoToStruct(hash_plan, wire.data(), wire.size(), &wire_msg,
+		sizeof(wire_msg)) || wire_msg.member2.size() != 4 ||
+		wire_msg.member2[1].member8.at("msg1mem8key2") != 654321) {
+		printf("wire merged to hash map failed.\n");
+		return false;
+	}
+	auto &sorted_plan = cps::CompilePlan(desc, cps::MAP_SORTED);
+	sorted::Message2 sorted_msg;
+	if (!cps::ProtoToStruct(sorted_plan, expected, &sorted_msg,
+		sizeof(sorted_msg))) {
+		printf("proto to sorted map failed.\n");
+		return false;
+	}
+	auto &pairs = sorted_msg.member1;
+	if (pairs.size() != 3 || !std::is_sorted(pairs.begin(), pairs.end(),
+		[](const std::pair<std::string, sorted::Message2::Message3> &a,
+			const std::pair<std::string, sorted::Message2::Message3> &b) {
+			return a.first < b.first;
+		}) || pairs[1].second.member3[1].second != "msg3mem3value2") {
+		printf("proto to sorted map unsorted.\n");
+		return false;
+	}
+	proto_msg.Clear();
+	if (!cps::StructToProto(sorted_plan, &sorted_msg, sizeof(sorted_msg),
+		proto_msg) || !MessageDifferencer::Equals(proto_msg, expected)) {
+		printf("sorted map to proto failed.\n");
+		return false;
+	}
+#ifdef CPS_AGGREGATE_REFLECTION
+	// the containers are detected at compile time.
+	hash::Message2 aggregate_hash;
+	sorted::Message2 aggregate_sorted;
+	if (!cps::aggregate::ProtoToStruct(expected, aggregate_hash) ||
+		!cps::aggregate::ProtoToStruct(expected, aggregate_sorted) ||
+		aggregate_sorted.member1.size() != 3 ||
+		aggregate_sorted.member1[0].first != "msg2mem1key1") {
+		printf("aggregate proto to map layout failed.\n");
+		return false;
+	}
+	proto::Message2 hash_proto, sorted_proto;
+	if (!cps::aggregate::StructToProto(aggregate_hash, hash_proto) ||
+		!cps::aggregate::StructToProto(aggregate_sorted, sorted_proto) ||
+		!MessageDifferencer::Equals(hash_proto, expected) ||
+		!MessageDifferencer::Equals(sorted_proto, expected)) {
+		printf("aggregate map layout to proto failed.\n");
+		return false;
 	}
+#endif
+	return true;
+}
+
+// convert the map whose value is larger than 0x800 bytes, with the nodes of
+// exact size.
+static bool TestLargeMap(const Message2 &msg2)
+{
+	static_assert(sizeof(Message4::Large) > 0x800, "the value is too small");
+	Message4 large;
+	for (int i = 0; i < 3; ++i) {
+		auto &value = large.member1[i * 1000];
+		value.member1 = msg2.member5;
+		value.member10 = msg2.member2[0];
+		value.member10.member1 = i;
+		large.member2["large" + std::to_string(i)] = value;
+	}
+	proto::Message4 proto_msg;
+	Message4 struct_msg;
+#if !defined(CPS_MAP_NODES) || !defined(__GLIBCXX__)
+	// the value is larger than the punned maps without CPS_MAP_NODES.
+	if (!cps::StructToProto(large, proto_msg) ||
+		cps::ProtoToStruct(proto_msg, &struct_msg, sizeof(struct_msg))) {
+		printf("large map without exact nodes failed.\n");
+		return false;
+	}
+	return true;
+#endif
+	if (!cps::StructToProto(large, proto_msg) ||
+		!cps::ProtoToStruct(proto_msg, struct_msg) || !(struct_msg == large)) {
+		printf("convert large map failed.\n");
+		return false;
+	}
+	std::string wire;
+	Message4 wire_msg;
+	if (!proto_msg.SerializeToString(&wire) ||
+		!cps::ProtoToStruct<proto::Message4>(wire.data(), wire.size(),
+		wire_msg) ||
+		!(wire_msg == large)) {
+		printf("wire to large map failed.\n");
+		return false;
+	}
+	// erase the pairs not in message.
+	Message4 other = large;
+	other.member1.erase(0);
+	other.member2.erase("large2");
+	proto::Message4 proto_other;
+	if (!cps::StructToProto(other, proto_other) ||
+		!cps::OverwriteProtoToStruct(proto_other, struct_msg) ||
+		!(struct_msg == other)) {
+		printf("overwrite large map failed.\n");
+		return false;
+	}
+	auto &hash_plan = cps::CompilePlan(proto::Message4::descriptor(),
+		cps::MAP_HASH);
+	hash::Message4 hash_msg;
+	proto::Message4 hash_proto;
+	if (!cps::ProtoToStruct(hash_plan, proto_msg, &hash_msg,
+		sizeof(hash_msg)) || hash_msg.member2.at("large1").member10.member1
+		!= 1 || !cps::StructToProto(hash_plan, &hash_msg, sizeof(hash_msg),
+		hash_proto) || !MessageDifferencer::Equals(hash_proto, proto_msg)) {
+		printf("convert large hash map failed.\n");
+		return false;
+	}
+	return true;
+}
+
+// write structs to the file of length delimited records, and read back.
+static bool TestStream(const Message2 &msg2)
+{
+	const std::string path = "test_stream.bin";
+	std::vector<Message2> records(3, msg2);
+	for (size_t i = 0; i < records.size(); ++i) {
+		records[i].member3 = i * 0.5;
+	}
+	cps::StreamWriter<proto::Message2, Message2> writer;
+	if (!writer.open(path) || !writer.write(records.begin(), records.end()) ||
+		!writer.close()) {
+		printf("write stream failed.\n");
+		return false;
+	}
+	// same as the delimited messages of protobuf.
+	cps::MappedFile file;
+	if (!file.open(path)) {
+		printf("map file failed.\n");
+		return false;
+	}
+	google::protobuf::io::CodedInputStream input(file.data(),
+		static_cast<int>(file.size()));
+	for (auto &record : records) {
+		proto::Message2 expected, proto_msg;
+		uint32_t length = 0;
+		if (!cps::StructToProto(&record, sizeof(record), expected) ||
+			!input.ReadVarint32(&length)) {
+			printf("read delimited message failed.\n");
+			return false;
+		}
+		auto limit = input.PushLimit(static_cast<int>(length));
+		if (!proto_msg.ParseFromCodedStream(&input) ||
+			!MessageDifferencer::Equals(proto_msg, expected)) {
+			printf("stream is not delimited messages.\n");
+			return false;
+		}
+		input.PopLimit(limit);
+	}
+	// the sorted maps are written in order, same as std::map.
+	auto &sorted_plan = cps::CompilePlan(proto::Message2::descriptor(),
+		cps::MAP_SORTED);
+	const std::string sorted_path = "test_stream_sorted.bin";
+	cps::StreamWriter<proto::Message2, sorted::Message2> sorted_writer(
+		sorted_plan);
+	bool written = sorted_writer.open(sorted_path);
+	for (size_t i = 0; i < records.size() && written; ++i) {
+		proto::Message2 proto_msg;
+		sorted::Message2 sorted_msg;
+		written = cps::StructToProto(&records[i], sizeof(records[i]),
+			proto_msg) && cps::ProtoToStruct(sorted_plan, proto_msg,
+			&sorted_msg, sizeof(sorted_msg)) && sorted_writer.write(sorted_msg);
+	}
+	cps::MappedFile sorted_file;
+	written = sorted_writer.close() && written &&
+		sorted_file.open(sorted_path) && sorted_file.size() == file.size() &&
+		memcmp(sorted_file.data(), file.data(), file.size()) == 0;
+	sorted_file.close();
+	std::remove(sorted_path.c_str());
+	if (!written) {
+		printf("write stream with plan failed.\n");
+		return false;
+	}
+	cps::StreamReader<proto::Message2, Message2> reader;
+	std::vector<Message2> values;
+	if (!reader.open(path) || !reader.for_each([&](Message2 &value) {
+		values.push_back(std::move(value));
+	}) || !(values == records)) {
+		printf("read stream failed.\n");
+		return false;
+	}
+	Message2 value;
+	if (!reader.open(path) || !reader.next(value) || !(value == records[0])) {
+		printf("read next record failed.\n");
+		return false;
+	}
+	// the last record is truncated.
+	std::string truncated((const char*)file.data(), file.size() - 1);
+	file.close();
+	std::FILE *out = std::fopen(path.c_str(), "wb");
+	if (out == nullptr || std::fwrite(truncated.data(), 1, truncated.size(),
+		out) != truncated.size() || std::fclose(out) != 0) {
+		printf("write truncated stream failed.\n");
+		return false;
+	}
+	values.clear();
+	bool result = reader.open(path) && !reader.for_each([&](Message2 &value) {
+		values.push_back(std::move(value));
+	}) && reader.failed() && values.size() == records.size() - 1;
+	reader.close();
+	std::remove(path.c_str());
+	if (!result) {
+		printf("truncated stream not detected.\n");
+		return false;
+	}
+	return true;
+}
+
+// convert on the workers of pipeline, the results are in order of push.
+static bool TestPipeline(const Message2 &msg2)
+{
+	const size_t count = 100;
+	std::vector<Message2> records(count, msg2);
+	for (size_t i = 0; i < count; ++i) {
+		records[i].member3 = i * 0.5;
+	}
+	std::vector<proto::Message2> messages;
+	std::vector<Message2> values;
+	bool result = true;
+	{
+		cps::StructToProtoPipeline<Message2, proto::Message2> egress(
+			[&](Message2 &, proto::Message2 &out, bool converted) {
+			result = result && converted;
+			messages.push_back(std::move(out));
+		}, cps::PipelineOptions(4, 8, 3));
+		cps::ProtoToStructPipeline<proto::Message2, Message2> ingress(
+			[&](proto::Message2 &, Message2 &out, bool converted) {
+			result = result && converted;
+			values.push_back(std::move(out));
+		}, cps::PipelineOptions(3, 16, 5));
+		for (auto &record : records) {
+			egress.push(Message2(record));
+		}
+		egress.wait();
+		for (auto &message : messages) {
+			ingress.push(message);
+		}
+	}
+	if (!result || !(values == records)) {
+		printf("convert by pipeline failed.\n");
+		return false;
+	}
+	// the producer gets back-pressure when the pipeline is full.
+	std::atomic<bool> release(false);
+	std::vector<int> delivered;
+	cps::Pipeline<int, int> blocked([&](int &in, int &out) {
+		while (!release.load()) {
+			std::this_thread::yield();
+		}
+		out = in * 2;
+		return true;
+	}, [&](int &, int &out, bool) {
+		delivered.push_back(out);
+	}, cps::PipelineOptions(2, 4, 2));
+	for (int i = 0; i < 4; ++i) {
+		int value = i;
+		if (!blocked.try_push(value)) {
+			printf("push to pipeline failed.\n");
+			return false;
+		}
+	}
+	int value = 4;
+	if (blocked.try_push(value)) {
+		printf("full pipeline not detected.\n");
+		return false;
+	}
+	release.store(true);
+	blocked.push(value);
+	blocked.wait();
+	if (delivered != std::vector<int>({ 0, 2, 4, 6, 8 })) {
+		printf("pipeline is not in order.\n");
+		return false;
+	}
+	return true;
+}
+
+// convert the repeated message field to a column per field of element.
+static bool TestColumns(const proto::Message2 &expected)
+{
+	proto::Message2 proto_msg = expected;
+	auto element = proto_msg.add_member2();
+	*element = proto_msg.member2(0);
+	element->set_member2(-7);
+	element->set_member5(proto::EnFlag1);
+	element->set_member7("");
+	auto desc = proto::Message2::descriptor();
+	cps::Columns columns;
+	if (!cps::ProtoToColumns(proto_msg, desc->FindFieldByName("member2"),
+		columns) || columns.rows != 3 || columns.columns.size() != 8) {
+		printf("convert to columns failed.\n");
+		return false;
+	}
+	auto member2 = columns.find("member2");
+	auto member5 = columns.find("member5");
+	auto member7 = columns.find("member7");
+	if (member2 == nullptr || member5 == nullptr || member7 == nullptr ||
+		member2->width != sizeof(int64_t) || member7->width != 0 ||
+		columns.find("member9") != nullptr) {
+		printf("columns are not the fields of element.\n");
+		return false;
+	}
+	for (int i = 0; i < proto_msg.member2_size(); ++i) {
+		auto &proto_element = proto_msg.member2(i);
+		auto &offsets = member7->offsets;
+		if (member2->cast<int64_t>()[i] != proto_element.member2() ||
+			member5->cast<int>()[i] != proto_element.member5() ||
+			member7->data.substr(offsets[i], offsets[i + 1] - offsets[i]) !=
+			proto_element.member7()) {
+			printf("columns are not match elements.\n");
+			return false;
+		}
+	}
+	// the columns are reused.
+	proto_msg.mutable_member2()->DeleteSubrange(0, 2);
+	if (!cps::ProtoToColumns(proto_msg, desc->FindFieldByName("member2"),
+		columns) || columns.rows != 1 || member2->values.size() !=
+		sizeof(int64_t) || member2->cast<int64_t>()[0] != -7 ||
+		member7->offsets.size() != 2 || !member7->data.empty()) {
+		printf("convert to existing columns failed.\n");
+		return false;
+	}
+	if (cps::ProtoToColumns(proto_msg, desc->FindFieldByName("member3"),
+		columns)) {
+		printf("columns of scalar field not failed.\n");
+		return false;
+	}
+	return true;
+}
+
+#ifdef CPS_MEMORY_RESOURCE
+// same as the structs of message.h, but declared with std::pmr containers.
+namespace pmr
+{
+
+struct Message1
+{
+	int32_t member1;
+	int64_t member2;
+	uint32_t member3;
+	uint64_t member4;
+	Enum member5;
+	bool member6;
+	std::pmr::string member7;
+	std::pmr::map<std::pmr::string, int32_t> member8;
+	std::pmr::vector<int32_t> member9;
+	bool member10;
+	std::pmr::vector<double> member11;
+	std::pmr::vector<Enum> member12;
+	std::pmr::vector<bool> member13;
+};
+
+struct Message2
+{
+	struct Message3
+	{
+		std::pmr::map<std::pmr::string, int64_t> member1;
+		std::pmr::vector<int64_t> member2;
+		std::pmr::map<int64_t, std::pmr::string> member3;
+	};
+	std::pmr::map<std::pmr::string, Message3> member1;
+	std::pmr::vector<Message1> member2;
+	double member3;
+	float member4;
+	Message1 member5;
+	Message3 member6;
+	std::pmr::map<std::pmr::string, int32_t> member7;
+};
+
+// Message2::Message3 with the maps of MAP_SORTED.
+struct SortedMessage3
+{
+	std::pmr::vector<std::pair<std::pmr::string, int64_t>> member1;
+	std::pmr::vector<int64_t> member2;
+	std::pmr::vector<std::pair<int64_t, std::pmr::string>> member3;
+};
+
+} // namespace pmr
+
+// check the elements of vector are aligned.
+template<typename Ty>
+static bool Aligned(const std::pmr::vector<Ty> &values)
+{
+	return reinterpret_cast<uintptr_t>(values.data()) % alignof(Ty) == 0;
+}
+
+// the vectors of structs are allocated with the alignment of struct, even
+// after an odd-sized allocation of monotonic resource.
+static bool TestMemoryAlignment(const proto::Message2 &expected)
+{
+	static char buffer[0x10000];
+	std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer),
+		std::pmr::null_memory_resource());
+	proto::Message2 repeated;
+	*repeated.mutable_member2() = expected.member2();
+	pmr::Message2 struct_msg;
+	(void)resource.allocate(1, 1); // the next one is not aligned
+	if (!cps::ProtoToStruct(repeated, struct_msg, &resource) ||
+		struct_msg.member2.size() != 2 || !Aligned(struct_msg.member2)) {
+		printf("pmr vector of structs not aligned.\n");
+		return false;
+	}
+	auto &plan = cps::CompilePmrPlan(proto::Message2::Message3::descriptor(),
+		cps::MAP_SORTED);
+	pmr::SortedMessage3 sorted;
+	(void)resource.allocate(1, 1); // the next one is not aligned
+	if (!cps::ProtoToStruct(plan, expected.member6(), &sorted, sizeof(sorted),
+		&resource) || sorted.member1.empty() || !Aligned(sorted.member1) ||
+		!Aligned(sorted.member3)) {
+		printf("pmr sorted map not aligned.\n");
+		return false;
+	}
+	return true;
+}
+
+// convert to struct with std::pmr containers allocated from resource.
+static bool TestMemoryResource(const proto::Message2 &expected)
+{
+	static char buffer[0x10000];
+	std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer),
+		std::pmr::null_memory_resource());
+	// nothing is allocated from the default resource.
+	auto fallback = std::pmr::set_default_resource(
+		std::pmr::null_memory_resource());
+	pmr::Message2 struct_msg;
+	bool result = cps::ProtoToStruct(expected, struct_msg, &resource);
+	std::pmr::set_default_resource(fallback);
+	if (!result) {
+		printf("pmr proto to struct failed.\n");
+		return false;
+	}
+	if (struct_msg.member2.get_allocator().resource() != &resource ||
+		struct_msg.member2[1].member7.get_allocator().resource() !=
+		&resource) {
+		printf("pmr proto to struct not allocated from resource.\n");
+		return false;
+	}
+	proto::Message2 proto_msg;
+	auto &plan = cps::CompilePmrPlan(proto::Message2::descriptor());
+	if (!cps::StructToProto(plan, &struct_msg, sizeof(struct_msg),
+		proto_msg) || !MessageDifferencer::Equals(proto_msg, expected)) {
+		printf("pmr struct to proto failed.\n");
+		return false;
+	}
+	// the plan of std containers is rejected.
+	if (cps::ProtoToStruct(cps::CompilePlan(proto::Message2::descriptor()),
+		expected, &struct_msg, sizeof(struct_msg), &resource)) {
+		printf("pmr plan mismatch not detected.\n");
+		return false;
+	}
+	return true;
+}
+#endif
+
+#ifdef CPS_STRING_VIEW
+// same as the structs of message.h, but the strings are std::string_view.
+namespace view
+{
+
+struct Message1
+{
+	int32_t member1;
+	int64_t member2;
+	uint32_t member3;
+	uint64_t member4;
+	Enum member5;
+	bool member6;
+	std::string_view member7;
+	std::map<std::string_view, int32_t> member8;
+	std::vector<int32_t> member9;
+	bool member10;
+	std::vector<double> member11;
+	std::vector<Enum> member12;
+	std::vector<bool> member13;
+};
+
+struct Message2
+{
+	struct Message3
+	{
+		std::map<std::string_view, int64_t> member1;
+		std::vector<int64_t> member2;
+		std::map<int64_t, std::string_view> member3;
+	};
+	std::map<std::string_view, Message3> member1;
+	std::vector<Message1> member2;
+	double member3;
+	float member4;
+	Message1 member5;
+	Message3 member6;
+	std::map<std::string_view, int32_t> member7;
+};
+
+} // namespace view
+
+// view the strings of message and wire buffer, without copy.
+static bool TestView(const proto::Message2 &expected)
+{
+	view::Message2 struct_msg;
+	if (!cps::ProtoToView(expected, struct_msg)) {
+		printf("proto to view failed.\n");
+		return false;
+	}
+	if (struct_msg.member5.member7.data() !=
+		expected.member5().member7().data()) {
+		printf("proto to view copied.\n");
+		return false;
+	}
+	proto::Message2 proto_msg;
+	if (!cps::ViewToProto(struct_msg, proto_msg) ||
+		!MessageDifferencer::Equals(proto_msg, expected)) {
+		printf("view to proto failed.\n");
+		return false;
+	}
+	std::string wire;
+	if (!expected.SerializeToString(&wire)) {
+		printf("serialize failed.\n");
+		return false;
+	}
+	view::Message2 wire_msg;
+	if (!cps::ProtoToView<proto::Message2>(wire.data(), wire.size(),
+		wire_msg)) {
+		printf("wire to view failed.\n");
+		return false;
+	}
+	auto text = wire_msg.member1.begin()->first.data();
+	if (text < wire.data() || text >= wire.data() + wire.size()) {
+		printf("wire to view copied.\n");
+		return false;
+	}
+	proto_msg.Clear();
+	if (!cps::ViewToProto(wire_msg, proto_msg) ||
+		!MessageDifferencer::Equals(proto_msg, expected)) {
+		printf("wire to view mismatch.\n");
+		return false;
+	}
+	// serialized from view with the plan, parsed back by protobuf.
+	auto &plan = cps::CompileViewPlan(proto::Message2::descriptor());
+	std::string view_wire;
+	proto_msg.Clear();
+	if (!cps::StructToWire(plan, &wire_msg, sizeof(wire_msg), view_wire) ||
+		!proto_msg.ParseFromString(view_wire) ||
+		!MessageDifferencer::Equals(proto_msg, expected)) {
+		printf("view to wire failed.\n");
+		return false;
+	}
+	return true;
+}
+#endif
+
+#ifdef CPS_AGGREGATE_REFLECTION
+// Message2::Message3 with a scalar member for the repeated field member2.
+struct ScalarForRepeated
+{
+	std::map<std::string, int64_t> member1;
+	int64_t member2;
+	std::map<int64_t, std::string> member3;
+};
+
+// convert with the members enumerated at compile time.
+static bool TestAggregate(const Message2 &msg2, const proto::Message2 &expected)
+{
+	static_assert(cps::aggregate::detail::MemberCount<Message2>::value == 7,
+		"count of members of Message2");
+	proto::Message2 proto_msg;
+	if (!cps::aggregate::StructToProto(msg2, proto_msg) ||
+		!MessageDifferencer::Equals(proto_msg, expected)) {
+		printf("aggregate struct to proto failed.\n");
+		return false;
+	}
+	Message2 struct_msg;
+	if (!cps::aggregate::ProtoToStruct(expected, struct_msg) ||
+		!(struct_msg == msg2)) {
+		printf("aggregate proto to struct failed.\n");
+		return false;
+	}
+	// the members are not matched to the fields.
+	proto::Message1 msg1;
+	if (cps::aggregate::StructToProto(msg2.member6, msg1)) {
+		printf("aggregate mismatch not detected.\n");
+		return false;
+	}
+	// the scalar member is not matched to the repeated field.
+	ScalarForRepeated scalar{};
+	proto::Message2::Message3 msg3;
+	if (cps::aggregate::StructToProto(scalar, msg3) ||
+		cps::aggregate::ProtoToStruct(expected.member6(), scalar)) {
+		printf("aggregate repeated mismatch not detected.\n");
+		return false;
+	}
+	return true;
+}
+#endif
+
+#ifdef CPS_STATS
+// count the conversions by message type, include the failed ones.
+static bool TestStats(const Message2 &msg2, const proto::Message2 &expected)
+{
+	cps::ResetStats();
+	proto::Message2 proto_msg;
+	Message2 struct_msg;
+	std::string wire;
+	// the generated converters are not counted, call by reflection.
+	if (!cps::StructToProto(&msg2, sizeof(msg2), proto_msg) ||
+		!cps::StructToWire<proto::Message2>(msg2, wire) ||
+		!cps::ProtoToStruct(expected, &struct_msg, sizeof(struct_msg)) ||
+		cps::ProtoToStruct(expected, &struct_msg, sizeof(struct_msg) - 1)) {
+		printf("convert with statistics failed.\n");
+		return false;
+	}
+	// the counters of finished thread are kept.
+	std::thread thread([&expected] {
+		Message2 other;
+		cps::ProtoToStruct(expected, &other, sizeof(other));
+	});
+	thread.join();
+	auto snapshot = cps::SnapshotStats();
+	auto &to_proto = snapshot["proto.Message2"].to_proto;
+	auto &to_struct = snapshot["proto.Message2"].to_struct;
+	uint64_t latency = 0;
+	for (auto count : to_struct.latency.counts) {
+		latency += count;
+	}
+	// the nested messages are counted by the outer call.
+	if (snapshot.size() != 1 || to_proto.calls != 2 ||
+		to_proto.failures[cps::FAILURE_SIZE] != 0 || to_struct.calls != 3 ||
+		to_struct.failures[cps::FAILURE_SIZE] != 1 || latency != 3 ||
+		to_struct.latency.percentile(1.0) == 0 || to_proto.elements == 0 ||
+		to_proto.elements != to_struct.elements || to_proto.bytes == 0 ||
+		to_proto.bytes != to_struct.bytes) {
+		printf("statistics of conversions failed.\n");
+		return false;
+	}
+	cps::ResetStats();
+	snapshot = cps::SnapshotStats();
+	if (snapshot["proto.Message2"].to_struct.calls != 0) {
+		printf("reset statistics failed.\n");
+		return false;
+	}
+	return true;
+}
+#endif
+
+int main()
+{
+	Message2 msg2 = MakeMessage2();
+	proto::Message2 proto_msg;
+	if (!TestReflection(msg2, proto_msg)) {
+		return -1;
+	}
+	if (!TestGenerated(msg2, proto_msg)) {
+		return -1;
+	}
+	if (!TestWire(msg2, proto_msg)) {
+		return -1;
+	}
+	if (!TestDeepWire()) {
+		return -1;
+	}
+	if (!TestToWire(msg2, proto_msg)) {
+		return -1;
+	}
+	if (!TestArena(msg2, proto_msg)) {
+		return -1;
+	}
+	if (!TestMove(msg2, proto_msg)) {
+		return -1;
+	}
+	if (!TestBatch(msg2, proto_msg)) {
+		return -1;
+	}
+	if (!TestParallel(msg2)) {
+		return -1;
+	}
+	if (!TestSparse(msg2, proto_msg)) {
+		return -1;
+	}
+	if (!TestDelta(msg2, proto_msg)) {
+		return -1;
+	}
+	if (!TestFieldMask(msg2, proto_msg)) {
+		return -1;
+	}
+	if (!TestOverwrite(msg2, proto_msg)) {
+		return -1;
+	}
+	if (!TestMapLayout(proto_msg)) {
+		return -1;
+	}
+	if (!TestLargeMap(msg2)) {
+		return -1;
+	}
+	if (!TestStream(msg2)) {
+		return -1;
+	}
+	if (!TestPipeline(msg2)) {
+		return -1;
+	}
+	if (!TestColumns(proto_msg)) {
+		return -1;
+	}
+#ifdef CPS_MEMORY_RESOURCE
+	if (!TestMemoryResource(proto_msg)) {
+		return -1;
+	}
+	if (!TestMemoryAlignment(proto_msg)) {
+		return -1;
+	}
+#endif
+#ifdef CPS_STRING_VIEW
+	if (!TestView(proto_msg)) {
+		return -1;
+	}
+#endif
+#ifdef CPS_AGGREGATE_REFLECTION
+	if (!TestAggregate(msg2, proto_msg)) {
+		return -1;
+	}
+#endif
+#ifdef CPS_STATS
+	if (!TestStats(msg2, proto_msg)) {
+		return -1;
+	}
+#endif
 	printf("test success!\n");
 	return 0;
 }
-
@@ -23,6 +23,9 @@ struct Message1
 	std::map<std::string, int32_t> member8;
 	std::vector<int32_t> member9;
 	bool member10;
+	std::vector<double> member11;
+	std::vector<Enum> member12;
+	std::vector<bool> member13;
 
 	bool operator==(const Message1 &rh) const
 	{
@@ -36,7 +39,10 @@ struct Message1
 			member7 == rh.member7 &&
 			member8 == rh.member8 &&
 			member9 == rh.member9 &&
-			member10 == rh.member10
+			member10 == rh.member10 &&
+			member11 == rh.member11 &&
+			member12 == rh.member12 &&
+			member13 == rh.member13
 		);
 	}
 };
@@ -64,7 +70,7 @@ struct Message2
 	float member4;
 	Message1 member5;
 	Message3 member6;
-	std::map<int32_t, bool> member7;
+	std::map<std::string, int32_t> member7;
 
 	bool operator==(const Message2 &rh) const
 	{
@@ -80,3 +86,51 @@ struct Message2
 	}
 };
 
+struct Message4
+{
+	struct Large
+	{
+		Message1 member1;
+		Message1 member2;
+		Message1 member3;
+		Message1 member4;
+		Message1 member5;
+		Message1 member6;
+		Message1 member7;
+		Message1 member8;
+		Message1 member9;
+		Message1 member10;
+
+		bool operator==(const Large &rh) const
+		{
+			return (
+				member1 == rh.member1 &&
+				member2 == rh.member2 &&
+				member3 == rh.member3 &&
+				member4 == rh.member4 &&
+				member5 == rh.member5 &&
+				member6 == rh.member6 &&
+				member7 == rh.member7 &&
+				member8 == rh.member8 &&
+				member9 == rh.member9 &&
+				member10 == rh.member10
+			);
+		}
+	};
+	std::map<int32_t, Large> member1;
+	std::map<std::string, Large> member2;
+
+	bool operator==(const Message4 &rh) const
+	{
+		return (
+			member1 == rh.member1 &&
+			member2 == rh.member2
+		);
+	}
+};
+
+struct Message5
+{
+	int32_t member1;
+	std::vector<Message5> member2;
+};